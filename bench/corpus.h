@@ -0,0 +1,307 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstdint>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <algorithm>
+
+// lunghezza dei pezzi scritti su disco dal generatore e letti dal checksum
+#define CORPUS_CHUNK_DIM	(1<<20)
+// seme fisso: lo stesso corpus su ogni macchina e ad ogni esecuzione
+#define CORPUS_SEED			0x48554642ull
+// esponente della distribuzione Zipf dei simboli (zipf) e delle parole (text)
+#define CORPUS_ZIPF_S		1.1
+// frazione di byte diversi da zero nel corpus sparse
+#define CORPUS_SPARSE_DENSITY	0.05
+
+//! Kind of a synthetic corpus.
+enum CorpusKind {
+	//! Uniform random bytes, incompressible: the worst case of the encoder.
+	CORPUS_UNIFORM,
+	//! Bytes drawn from a Zipf distribution over the 256 symbols.
+	CORPUS_ZIPF,
+	//! English-like text: common words with Zipf frequencies, sentences and lines.
+	CORPUS_TEXT,
+	//! Log lines: timestamps, levels, thread names and a few message templates.
+	CORPUS_LOGS,
+	//! Mostly zero bytes with short runs of random bytes.
+	CORPUS_SPARSE
+};
+
+//! The number of corpus kinds.
+#define CORPUS_KINDS	5
+
+
+//! CorpusGenerator class
+/*!
+  This class generates a synthetic corpus of a given kind, a piece at a time, so a file of many GB
+  can be written with a few MB of memory.
+  The output only depends on the kind and on the seed: the random numbers come from std::mt19937_64,
+  whose sequence is fixed by the standard, and the distributions are computed here instead of using
+  the ones of the standard library, which differ between implementations.
+*/
+class CorpusGenerator {
+	//! The kind of corpus.
+	CorpusKind _kind;
+	//! The random number generator.
+	std::mt19937_64 _rng;
+	//! The cumulative distribution of the Zipf symbols or words.
+	std::vector<double> _cdf;
+	//! The text generated but not returned yet, for the kinds made of words and lines.
+	std::string _pending;
+	//! The position of the first byte of _pending not returned yet.
+	std::size_t _pending_pos;
+	//! The number of lines generated, used by the log timestamps.
+	std::uint64_t _lines;
+	//! The length of the current line of text.
+	std::size_t _line_len;
+
+public:
+	//! Constructor
+	/*!
+	\param kind The kind of corpus.
+	\param seed The seed of the random number generator.
+	*/
+	CorpusGenerator(CorpusKind kind, std::uint64_t seed = CORPUS_SEED) : _kind(kind), _rng(seed + (std::uint64_t)kind), _pending_pos(0), _lines(0), _line_len(0) {
+		std::size_t n = (kind == CORPUS_ZIPF) ? 256 : (kind == CORPUS_TEXT) ? words().size() : 0;
+		double sum = 0;
+		for(std::size_t i=0; i<n; ++i){
+			sum += 1.0 / std::pow((double)(i+1), CORPUS_ZIPF_S);
+			_cdf.push_back(sum);
+		}
+		for(std::size_t i=0; i<n; ++i)
+			_cdf[i] /= sum;
+	}
+
+	//! Name function
+	/*!
+	\param kind The kind of corpus.
+	\return The name of the kind, used in the filenames and in the results.
+	*/
+	static const char* name(CorpusKind kind){
+		static const char* names[CORPUS_KINDS] = {"uniform", "zipf", "text", "logs", "sparse"};
+		return names[kind];
+	}
+
+	//! Parse function
+	/*!
+	\param name The name of a kind.
+	\param kind The output kind.
+	\return false if the name is not a kind.
+	*/
+	static bool parse(const std::string& name, CorpusKind& kind){
+		for(int k=0; k<CORPUS_KINDS; ++k)
+			if(name == CorpusGenerator::name((CorpusKind)k)){
+				kind = (CorpusKind)k;
+				return true;
+			}
+		return false;
+	}
+
+	//! Fill function
+	/*!
+	Generates the next bytes of the corpus.
+	\param out The output buffer.
+	\param n The number of bytes to generate.
+	*/
+	void fill(std::uint8_t* out, std::size_t n){
+		switch(_kind){
+		case CORPUS_UNIFORM:
+			for(std::size_t i=0; i<n; ++i)
+				out[i] = (std::uint8_t)(_rng() >> 56);
+			break;
+		case CORPUS_ZIPF:
+			for(std::size_t i=0; i<n; ++i)
+				out[i] = (std::uint8_t)zipf();
+			break;
+		case CORPUS_SPARSE:
+			for(std::size_t i=0; i<n; ){
+				// una sequenza di zeri e poi da 1 a 8 byte casuali
+				std::size_t run = 1 + (std::size_t)(_rng() % 8);
+				std::size_t zeros = (std::size_t)(uniform() * 2 * run * (1-CORPUS_SPARSE_DENSITY) / CORPUS_SPARSE_DENSITY);
+				for(; zeros > 0 && i < n; --zeros, ++i)
+					out[i] = 0;
+				for(; run > 0 && i < n; --run, ++i)
+					out[i] = (std::uint8_t)(1 + _rng() % 255);
+			}
+			break;
+		default:
+			for(std::size_t i=0; i<n; ){
+				if(_pending_pos == _pending.size()){
+					_pending.clear();
+					_pending_pos = 0;
+					if(_kind == CORPUS_TEXT)
+						sentence();
+					else
+						log_line();
+				}
+				std::size_t len = std::min(n-i, _pending.size()-_pending_pos);
+				std::copy(_pending.begin()+_pending_pos, _pending.begin()+_pending_pos+len, out+i);
+				_pending_pos += len;
+				i += len;
+			}
+			break;
+		}
+	}
+
+	//! Write file function
+	/*!
+	Writes a new corpus file, a piece at a time.
+	\param filename The output filename.
+	\param size The length of the file.
+	\return false if the file cannot be written.
+	*/
+	bool write_file(const std::string& filename, std::uint64_t size){
+		std::ofstream file_out(filename, std::fstream::out|std::fstream::binary);
+		std::vector<std::uint8_t> chunk(CORPUS_CHUNK_DIM);
+		for(std::uint64_t written=0; written < size && file_out; ){
+			std::size_t len = (std::size_t)std::min<std::uint64_t>(CORPUS_CHUNK_DIM, size-written);
+			fill(chunk.data(), len);
+			file_out.write(reinterpret_cast<const char*>(chunk.data()), len);
+			written += len;
+		}
+		file_out.close();
+		return !file_out.fail();
+	}
+
+	//! File checksum function
+	/*!
+	Computes the FNV-1a hash of a file, used to check that the decompressed file is the original one.
+	\param filename The file.
+	\param size The output length of the file.
+	\return The hash, 0 with size 0 if the file cannot be read.
+	*/
+	static std::uint64_t file_checksum(const std::string& filename, std::uint64_t& size){
+		std::ifstream file_in(filename, std::ifstream::in|std::ifstream::binary);
+		std::vector<char> chunk(CORPUS_CHUNK_DIM);
+		std::uint64_t hash = 0xcbf29ce484222325ull;
+		size = 0;
+		if(!file_in)
+			return 0;
+		while(file_in){
+			file_in.read(chunk.data(), chunk.size());
+			std::streamsize len = file_in.gcount();
+			for(std::streamsize i=0; i<len; ++i)
+				hash = (hash ^ (std::uint8_t)chunk[i]) * 0x100000001b3ull;
+			size += (std::uint64_t)len;
+		}
+		return hash;
+	}
+
+private:
+	// numero casuale in [0,1) dai 53 bit alti, uguale su ogni piattaforma
+	double uniform(){
+		return (double)(_rng() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	// indice estratto dalla distribuzione cumulativa
+	std::size_t zipf(){
+		std::size_t i = (std::size_t)(std::upper_bound(_cdf.begin(), _cdf.end(), uniform()) - _cdf.begin());
+		return std::min(i, _cdf.size()-1);
+	}
+
+	// le parole piu' comuni dell'inglese, in ordine di frequenza
+	static const std::vector<std::string>& words(){
+		static const std::vector<std::string> list = {
+			"the", "of", "and", "to", "a", "in", "is", "that", "it", "was", "for", "on", "are", "as", "with",
+			"his", "they", "at", "be", "this", "from", "have", "or", "by", "one", "had", "not", "but", "what",
+			"all", "were", "when", "we", "there", "can", "an", "your", "which", "their", "said", "if", "do",
+			"will", "each", "about", "how", "up", "out", "them", "then", "she", "many", "some", "so", "these",
+			"would", "other", "into", "has", "more", "her", "two", "like", "him", "see", "time", "could", "no",
+			"make", "than", "first", "been", "its", "who", "now", "people", "my", "made", "over", "did", "down",
+			"only", "way", "find", "use", "may", "water", "long", "little", "very", "after", "words", "called",
+			"just", "where", "most", "know", "get", "through", "back", "much", "before", "go", "good", "new",
+			"write", "our", "used", "me", "man", "too", "any", "day", "same", "right", "look", "think", "also",
+			"around", "another", "came", "come", "work", "three", "word", "must", "because", "does", "part",
+			"even", "place", "well", "such", "here", "take", "why", "things", "help", "put", "years", "different",
+			"away", "again", "off", "went", "old", "number", "great", "tell", "men", "say", "small", "every",
+			"found", "still", "between", "name", "should", "home", "big", "give", "air", "line", "set", "own",
+			"under", "read", "last", "never", "us", "left", "end", "along", "while", "might", "next", "sound",
+			"below", "saw", "something", "thought", "both", "few", "those", "always", "looked", "show", "large",
+			"often", "together", "asked", "house", "world", "going", "want", "school", "important", "until",
+			"form", "food", "keep", "children", "feet", "land", "side", "without", "boy", "once", "animals",
+			"life", "enough", "took", "sometimes", "four", "head", "above", "kind", "began", "almost", "live",
+			"page", "got", "earth", "need", "far", "hand", "high", "year", "mother", "light", "parts", "country",
+			"father", "let", "night", "following", "picture", "being", "study", "second", "eyes", "soon", "times",
+			"story", "boys", "since", "white", "days", "ever", "paper", "hard", "near", "sentence", "better",
+			"best", "across", "during", "today", "others", "however", "sure", "means", "knew", "try", "told",
+			"young", "miles", "sun", "ways", "thing", "whole", "hear", "example", "heard", "several", "change",
+			"answer", "room", "sea", "against", "top", "turned", "learn", "point", "city", "play", "toward"
+		};
+		return list;
+	}
+
+	// una frase: da 4 a 20 parole, la prima maiuscola, a capo intorno alla colonna 72
+	void sentence(){
+		std::size_t n = 4 + (std::size_t)(_rng() % 17);
+		for(std::size_t w=0; w<n; ++w){
+			std::string word = words()[zipf()];
+			if(w == 0)
+				word[0] = (char)(word[0] - 'a' + 'A');
+			if(_line_len + word.size() + 1 > 72){
+				_pending += '\n';
+				_line_len = 0;
+			} else if(_line_len > 0){
+				_pending += ' ';
+				_line_len++;
+			}
+			_pending += word;
+			_line_len += word.size();
+			if(w+1 < n && _rng() % 12 == 0){
+				_pending += ',';
+				_line_len++;
+			}
+		}
+		std::uint64_t end = _rng() % 10;
+		_pending += (end == 0) ? '?' : (end == 1) ? '!' : '.';
+		_line_len++;
+		// ogni tanto un nuovo paragrafo
+		if(_rng() % 8 == 0){
+			_pending += "\n\n";
+			_line_len = 0;
+		}
+	}
+
+	// una riga di log: timestamp crescente, livello, thread e uno dei messaggi tipici
+	void log_line(){
+		static const char* levels[] = {"INFO ", "INFO ", "INFO ", "INFO ", "INFO ", "DEBUG", "DEBUG", "WARN ", "ERROR"};
+		static const char* paths[] = {"/index.html", "/api/v1/users", "/api/v1/orders", "/static/app.js", "/login", "/health"};
+		char line[256];
+		std::uint64_t ms = 1417860000000ull + _lines * 37 + _rng() % 37;
+		std::uint64_t s = ms / 1000;
+		int len = 0;
+		const char* level = levels[_rng() % 9];
+		unsigned thread = (unsigned)(_rng() % 16);
+		switch(_rng() % 4){
+		case 0:
+			len = std::snprintf(line, sizeof(line), "2014-12-06 %02u:%02u:%02u.%03u %s [worker-%u] GET %s 200 %u bytes in %u ms\n",
+				(unsigned)(s/3600%24), (unsigned)(s/60%60), (unsigned)(s%60), (unsigned)(ms%1000), level, thread,
+				paths[_rng() % 6], (unsigned)(_rng() % 65536), (unsigned)(_rng() % 500));
+			break;
+		case 1:
+			len = std::snprintf(line, sizeof(line), "2014-12-06 %02u:%02u:%02u.%03u %s [worker-%u] session %08x opened for user %u\n",
+				(unsigned)(s/3600%24), (unsigned)(s/60%60), (unsigned)(s%60), (unsigned)(ms%1000), level, thread,
+				(unsigned)_rng(), (unsigned)(_rng() % 100000));
+			break;
+		case 2:
+			len = std::snprintf(line, sizeof(line), "2014-12-06 %02u:%02u:%02u.%03u %s [worker-%u] cache miss for key item:%u, loading from database\n",
+				(unsigned)(s/3600%24), (unsigned)(s/60%60), (unsigned)(s%60), (unsigned)(ms%1000), level, thread,
+				(unsigned)(_rng() % 1000000));
+			break;
+		default:
+			len = std::snprintf(line, sizeof(line), "2014-12-06 %02u:%02u:%02u.%03u %s [worker-%u] query took %u ms, %u rows\n",
+				(unsigned)(s/3600%24), (unsigned)(s/60%60), (unsigned)(s%60), (unsigned)(ms%1000), level, thread,
+				(unsigned)(_rng() % 2000), (unsigned)(_rng() % 10000));
+			break;
+		}
+		_pending.assign(line, (len > 0) ? std::min((std::size_t)len, sizeof(line)-1) : 0);
+		_lines++;
+	}
+};
+
+#endif /*CORPUS_H*/
@@ -0,0 +1,420 @@
+#define TBB_PREVIEW_GLOBAL_CONTROL 1
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include "tbb/tbb.h"
+#include "tbb/global_control.h"
+#include "tbb/tick_count.h"
+#include "../seq_huffman.h"
+#include "../par_huffman.h"
+#include "../memory_budget.h"
+#include "../huffman_timer.h"
+#include "corpus.h"
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace tbb;
+
+//! BenchConfig struct
+/*!
+The options of the benchmark, from the command line.
+*/
+struct BenchConfig{
+	//! The kinds of corpus.
+	vector<CorpusKind> kinds;
+	//! The lengths of the corpus files.
+	vector<uint64_t> sizes;
+	//! The engines: "seq" and/or "par".
+	vector<string> engines;
+	//! The numbers of threads, the first one is the baseline of the speedup.
+	vector<unsigned> threads;
+	//! How many times every run is repeated, the fastest one is kept.
+	unsigned repeat;
+	//! The directory of the corpus and of the compressed files.
+	string dir;
+	//! The JSON output, none if empty.
+	string json;
+	//! The CSV output, none if empty.
+	string csv;
+	//! The memory budget given to the engines.
+	uint64_t memory;
+	//! The number of interleaved streams of the encoder.
+	unsigned streams;
+};
+
+//! BenchResult struct
+/*!
+One measure: a stage of an engine on a corpus file with a number of threads.
+*/
+struct BenchResult{
+	//! The kind of corpus.
+	string corpus;
+	//! The length of the corpus file.
+	uint64_t size;
+	//! The engine, "seq" or "par".
+	string engine;
+	//! The number of threads allowed by tbb::global_control.
+	unsigned threads;
+	//! The stage, "compress" or "decompress".
+	string stage;
+	//! The time of the fastest repetition, in seconds.
+	double seconds;
+	//! The length of the compressed file.
+	uint64_t compressed;
+	//! The time with the first number of threads divided by this time.
+	double speedup;
+	//! true if the decompressed file is the original one (always true for compress).
+	bool verified;
+	//! The seconds of every stage of the engine in the fastest repetition (see HuffmanTimer).
+	double stage_seconds[HUF_STAGES];
+	//! The bytes of every stage of the engine in the fastest repetition.
+	uint64_t stage_bytes[HUF_STAGES];
+};
+
+// streambuf che butta via tutto: zittisce i messaggi di avanzamento dei motori durante le misure
+class NullBuffer : public streambuf {
+protected:
+	int overflow(int c){ return c; }
+	streamsize xsputn(const char*, streamsize n){ return n; }
+};
+
+// "4K", "16M", "2G": potenze di 2, come le dimensioni dei file
+static bool parse_size(const string& token, uint64_t& size){
+	char* end = NULL;
+	unsigned long long value = strtoull(token.c_str(), &end, 10);
+	if(end == token.c_str())
+		return false;
+	string unit(end);
+	if(unit == "K" || unit == "k") value <<= 10;
+	else if(unit == "M" || unit == "m") value <<= 20;
+	else if(unit == "G" || unit == "g") value <<= 30;
+	else if(!unit.empty()) return false;
+	size = value;
+	return (size > 0);
+}
+
+static string size_name(uint64_t size){
+	ostringstream name;
+	if(size % (1ull<<30) == 0) name << (size>>30) << "G";
+	else if(size % (1ull<<20) == 0) name << (size>>20) << "M";
+	else if(size % (1ull<<10) == 0) name << (size>>10) << "K";
+	else name << size;
+	return name.str();
+}
+
+static vector<string> split_list(const string& list){
+	vector<string> tokens;
+	stringstream ss(list);
+	string token;
+	while(getline(ss, token, ','))
+		if(!token.empty())
+			tokens.push_back(token);
+	return tokens;
+}
+
+static void usage(){
+	cerr << "Usage: huffman_bench [options]" << endl
+		<< "  --kinds=uniform,zipf,text,logs,sparse   corpus kinds (default all)" << endl
+		<< "  --sizes=4K,64K,1M,16M,256M              corpus lengths, from 4K up to 16G" << endl
+		<< "  --engines=seq,par                       engines to measure (default both)" << endl
+		<< "  --threads=N                             run with 1, 2, 4, ... N threads (default all the cores)" << endl
+		<< "  --repeat=R                              repetitions of every run, the fastest is kept (default 3)" << endl
+		<< "  --dir=DIR                               directory of the corpus (default bench_corpus)" << endl
+		<< "  --json=FILE --csv=FILE                  results (default huffman_bench.json and huffman_bench.csv)" << endl
+		<< "  --max-memory=MB                         memory budget of the engines" << endl
+		<< "  --streams=N                             interleaved streams of the encoder" << endl;
+}
+
+static bool parse_args(int argc, char* argv[], BenchConfig& config){
+	config.repeat = 3;
+	config.dir = "bench_corpus";
+	config.json = "huffman_bench.json";
+	config.csv = "huffman_bench.csv";
+	config.streams = 1;
+	uint64_t max_memory = 0;
+	unsigned max_threads = (unsigned)task_scheduler_init::default_num_threads();
+	string kinds = "uniform,zipf,text,logs,sparse", sizes = "4K,64K,1M,16M,256M", engines = "seq,par";
+
+	for(int i=1; i<argc; ++i){
+		string arg(argv[i]);
+		size_t eq = arg.find('=');
+		string key = arg.substr(0, eq), value = (eq == string::npos) ? "" : arg.substr(eq+1);
+		if(key == "--kinds") kinds = value;
+		else if(key == "--sizes") sizes = value;
+		else if(key == "--engines") engines = value;
+		else if(key == "--threads") max_threads = (unsigned)atoi(value.c_str());
+		else if(key == "--repeat") config.repeat = (unsigned)atoi(value.c_str());
+		else if(key == "--dir") config.dir = value;
+		else if(key == "--json") config.json = value;
+		else if(key == "--csv") config.csv = value;
+		else if(key == "--max-memory") max_memory = strtoull(value.c_str(), NULL, 10) * HUF_ONE_MB;
+		else if(key == "--streams") config.streams = (unsigned)atoi(value.c_str());
+		else {
+			cerr << "Unknown option " << arg << endl;
+			return false;
+		}
+	}
+
+	vector<string> tokens = split_list(kinds);
+	for(size_t i=0; i<tokens.size(); ++i){
+		CorpusKind kind;
+		if(!CorpusGenerator::parse(tokens[i], kind)){
+			cerr << "Unknown corpus kind " << tokens[i] << endl;
+			return false;
+		}
+		config.kinds.push_back(kind);
+	}
+	tokens = split_list(sizes);
+	for(size_t i=0; i<tokens.size(); ++i){
+		uint64_t size;
+		if(!parse_size(tokens[i], size)){
+			cerr << "Bad size " << tokens[i] << endl;
+			return false;
+		}
+		config.sizes.push_back(size);
+	}
+	config.engines = split_list(engines);
+	for(size_t i=0; i<config.engines.size(); ++i)
+		if(config.engines[i] != "seq" && config.engines[i] != "par"){
+			cerr << "Unknown engine " << config.engines[i] << endl;
+			return false;
+		}
+
+	// 1, 2, 4, ... e infine il massimo, anche se non e' una potenza di 2
+	if(max_threads == 0)
+		max_threads = 1;
+	for(unsigned t=1; t<max_threads; t*=2)
+		config.threads.push_back(t);
+	config.threads.push_back(max_threads);
+
+	if(config.repeat == 0)
+		config.repeat = 1;
+	if(config.streams == 0 || config.streams > HUF_MAX_STREAMS)
+		config.streams = 1;
+	config.memory = memory_budget(max_memory);
+	return !config.kinds.empty() && !config.sizes.empty() && !config.engines.empty();
+}
+
+// comprime o decomprime un file con il motore richiesto, i messaggi dei motori sono zittiti
+static double run_engine(const BenchConfig& config, const string& engine, bool compress, const string& filename, HuffmanTimer* timer){
+	NullBuffer null_buffer;
+	streambuf* old_cout = cout.rdbuf(&null_buffer);
+	streambuf* old_cerr = cerr.rdbuf(&null_buffer);
+
+	tick_count t1 = tick_count::now();
+	if(engine == "par"){
+		ParHuffman par_huff;
+		par_huff._memory_budget = config.memory;
+		par_huff._streams = config.streams;
+		par_huff._timer = timer;
+		if(compress)
+			par_huff.compress_chunked(filename);
+		else
+			par_huff.decompress_chunked(filename);
+	} else {
+		SeqHuffman seq_huff;
+		seq_huff._memory_budget = config.memory;
+		seq_huff._streams = config.streams;
+		seq_huff._timer = timer;
+		if(compress)
+			seq_huff.compress_chunked(filename);
+		else
+			seq_huff.decompress_chunked(filename);
+	}
+	tick_count t2 = tick_count::now();
+
+	cout.rdbuf(old_cout);
+	cerr.rdbuf(old_cerr);
+	return (t2-t1).seconds();
+}
+
+// la directory del corpus, se esiste gia' non succede niente
+static void make_directory(const string& dir){
+#if defined(_WIN32)
+	_mkdir(dir.c_str());
+#else
+	mkdir(dir.c_str(), 0755);
+#endif
+}
+
+static uint64_t file_size(const string& filename){
+	ifstream file_in(filename, ifstream::in|ifstream::binary|fstream::ate);
+	return file_in.good() ? (uint64_t)file_in.tellg() : 0;
+}
+
+static double throughput(const BenchResult& r){
+	return (r.seconds > 0) ? (r.size/(double)HUF_ONE_MB)/r.seconds : 0;
+}
+
+static double compression_ratio(const BenchResult& r){
+	return (r.compressed > 0) ? r.size/(double)r.compressed : 0;
+}
+
+static void write_json(const BenchConfig& config, const vector<BenchResult>& results){
+	ofstream out(config.json);
+	out << "{" << endl
+		<< "  \"threads\": " << config.threads.back() << "," << endl
+		<< "  \"memory_budget\": " << config.memory << "," << endl
+		<< "  \"repeat\": " << config.repeat << "," << endl
+		<< "  \"streams\": " << config.streams << "," << endl
+		<< "  \"results\": [" << endl;
+	for(size_t i=0; i<results.size(); ++i){
+		const BenchResult& r = results[i];
+		out << "    {\"corpus\": \"" << r.corpus << "\", \"size\": " << r.size << ", \"engine\": \"" << r.engine
+			<< "\", \"threads\": " << r.threads << ", \"stage\": \"" << r.stage << "\", \"seconds\": " << r.seconds
+			<< ", \"throughput_mbs\": " << throughput(r) << ", \"speedup\": " << r.speedup
+			<< ", \"compressed\": " << r.compressed << ", \"ratio\": " << compression_ratio(r)
+			<< ", \"verified\": " << (r.verified ? "true" : "false") << ", \"stages\": {";
+		// le fasi misurate dentro il motore, senza il totale che e' gia' seconds
+		bool first = true;
+		for(int s=0; s<HUF_STAGE_TOTAL; ++s){
+			if(r.stage_seconds[s] == 0 && r.stage_bytes[s] == 0)
+				continue;
+			out << (first ? "" : ", ") << "\"" << HuffmanTimer::stage_name((HufStage)s) << "\": {\"seconds\": " << r.stage_seconds[s]
+				<< ", \"bytes\": " << r.stage_bytes[s] << ", \"throughput_mbs\": "
+				<< ((r.stage_seconds[s] > 0) ? (r.stage_bytes[s]/(double)HUF_ONE_MB)/r.stage_seconds[s] : 0) << "}";
+			first = false;
+		}
+		out << "}}" << ((i+1 < results.size()) ? "," : "") << endl;
+	}
+	out << "  ]" << endl << "}" << endl;
+}
+
+static void write_csv(const BenchConfig& config, const vector<BenchResult>& results){
+	ofstream out(config.csv);
+	out << "corpus,size,engine,threads,stage,seconds,throughput_mbs,speedup,compressed,ratio,verified";
+	for(int s=0; s<HUF_STAGE_TOTAL; ++s)
+		out << "," << HuffmanTimer::stage_name((HufStage)s) << "_seconds";
+	out << endl;
+	for(size_t i=0; i<results.size(); ++i){
+		const BenchResult& r = results[i];
+		out << r.corpus << "," << r.size << "," << r.engine << "," << r.threads << "," << r.stage << ","
+			<< r.seconds << "," << throughput(r) << "," << r.speedup << "," << r.compressed << "," << compression_ratio(r) << ","
+			<< (r.verified ? 1 : 0);
+		for(int s=0; s<HUF_STAGE_TOTAL; ++s)
+			out << "," << r.stage_seconds[s];
+		out << endl;
+	}
+}
+
+//! Benchmark of the compression and decompression engines.
+/*!
+For every corpus kind and length a file is generated in the corpus directory (or reused, if a file with
+the same name and length is there), then every engine compresses and decompresses it with 1, 2, 4, ...
+threads, each run limited by a tbb::global_control. The decompressed file overwrites the original and
+is checked against the checksum of the corpus. The results go to the console, to a JSON and a CSV file:
+seconds, throughput of the original data in MB/s, speedup over the first number of threads, compressed
+length and ratio (original/compressed), and the time of every stage of the engine (see HuffmanTimer).
+\return 0, 1 if a decompressed file is not the original one or the options are wrong.
+*/
+int main(int argc, char* argv[]){
+
+	BenchConfig config;
+	if(!parse_args(argc, argv, config)){
+		usage();
+		return 1;
+	}
+	make_directory(config.dir);
+
+	cout << "Corpus in " << config.dir << ", memory budget " << config.memory/HUF_ONE_MB << " MB, threads";
+	for(size_t i=0; i<config.threads.size(); ++i)
+		cout << " " << config.threads[i];
+	cout << endl << endl;
+	cout << left << setw(9) << "corpus" << setw(7) << "size" << setw(7) << "engine" << setw(8) << "threads"
+		<< setw(11) << "stage" << right << setw(12) << "MB/s" << setw(9) << "speedup" << setw(8) << "ratio" << endl;
+
+	vector<BenchResult> results;
+	int failed = 0;
+	for(size_t k=0; k<config.kinds.size(); ++k){
+		for(size_t s=0; s<config.sizes.size(); ++s){
+
+			// il file del corpus: rigenerato solo se manca o ha un'altra lunghezza
+			CorpusKind kind = config.kinds[k];
+			uint64_t size = config.sizes[s];
+			string base = config.dir + "/" + CorpusGenerator::name(kind) + "_" + size_name(size);
+			string filename = base + ".dat";
+			uint64_t checksum_size = 0;
+			uint64_t checksum = CorpusGenerator::file_checksum(filename, checksum_size);
+			if(checksum_size != size){
+				CorpusGenerator generator(kind);
+				if(!generator.write_file(filename, size)){
+					cerr << "Error: cannot write " << filename << endl;
+					return 1;
+				}
+				checksum = CorpusGenerator::file_checksum(filename, checksum_size);
+			}
+
+			for(size_t e=0; e<config.engines.size(); ++e){
+				double baseline[2] = {0, 0};
+				for(size_t t=0; t<config.threads.size(); ++t){
+					global_control control(global_control::max_allowed_parallelism, config.threads[t]);
+
+					for(int stage=0; stage<2; ++stage){
+						BenchResult r;
+						r.corpus = CorpusGenerator::name(kind);
+						r.size = size;
+						r.engine = config.engines[e];
+						r.threads = config.threads[t];
+						r.stage = (stage == 0) ? "compress" : "decompress";
+						r.seconds = 0;
+						r.verified = true;
+						HuffmanTimer timer;
+						for(unsigned rep=0; rep<config.repeat; ++rep){
+							timer.reset();
+							double seconds = run_engine(config, r.engine, stage == 0, (stage == 0) ? filename : base + ".bcp", &timer);
+							if(rep == 0 || seconds < r.seconds){
+								r.seconds = seconds;
+								for(int s=0; s<HUF_STAGES; ++s){
+									r.stage_seconds[s] = timer.seconds((HufStage)s);
+									r.stage_bytes[s] = timer._bytes[s];
+								}
+							}
+						}
+						r.compressed = file_size(base + ".bcp");
+
+						// la decompressione riscrive il file originale: deve tornare identico
+						if(stage == 1){
+							uint64_t decoded_size;
+							r.verified = (CorpusGenerator::file_checksum(filename, decoded_size) == checksum && decoded_size == size);
+							if(!r.verified){
+								failed = 1;
+								CorpusGenerator generator(kind);
+								generator.write_file(filename, size);
+							}
+						}
+						if(t == 0)
+							baseline[stage] = r.seconds;
+						r.speedup = (r.seconds > 0) ? baseline[stage]/r.seconds : 0;
+						results.push_back(r);
+
+						cout << left << setw(9) << r.corpus << setw(7) << size_name(r.size) << setw(7) << r.engine << setw(8) << r.threads
+							<< setw(11) << r.stage << right << fixed << setprecision(1) << setw(12) << throughput(r)
+							<< setprecision(2) << setw(9) << r.speedup << setw(8) << compression_ratio(r)
+							<< (r.verified ? "" : "  MISMATCH") << endl;
+						cout.unsetf(ios_base::floatfield);
+						cout << setprecision(6);
+					}
+				}
+			}
+			remove((base + ".bcp").c_str());
+		}
+	}
+
+	if(!config.json.empty())
+		write_json(config, results);
+	if(!config.csv.empty())
+		write_csv(config, results);
+	if(!config.json.empty() || !config.csv.empty())
+		cout << endl << "Results written to " << config.json << " " << config.csv << endl;
+	return failed;
+}
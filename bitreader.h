@@ -4,49 +4,149 @@
 #include <iostream>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
 
 //!  BitReader class is used to read bit-by-bit
 /*!
   This class is responsible for the bit-by-bit reading operations during the
   compression/decompression process.
-  It is designed to operate on a uint8_t vector, not a file (ifstream).
+  It is designed to operate on a uint8_t buffer, not a file (ifstream).
+  The bits are kept in a 64-bit buffer that is refilled with a single unaligned 64-bit load,
+  after a refill there are always at least 56 bits buffered (unless the input is ending).
+  The decoders use the peek()/consume()/refill() primitives directly, read() and read_bit()
+  are kept for the header.
 */
 class BitReader {
-	//! Input vector.
-    /*! Input vector used for reading operations. */
-	std::vector<std::uint8_t>& _f;
-	//! One byte buffer
-    /*! A one byte buffer used for reading operations. */
-	std::uint8_t _buf;
+	//! Input buffer.
+    /*! Input buffer used for reading operations. */
+	const std::uint8_t* _f;
+	//! Input size
+    /*! The number of bytes in the input buffer. */
+	std::uint64_t _size;
+	//! 64-bit buffer
+    /*! The buffered bits, MSB aligned: the next bit to read is the most significant one. */
+	std::uint64_t _buf;
 	//! Counter
-    /*! A counter used to manage reading opreations inside the buffer. */
-	std::uint8_t _count;
+    /*! The number of valid bits in the buffer, the bits after the end of the input are not counted. */
+	std::uint32_t _count;
 	//! Index
-    /*! An index used to manage reading operations inside the input vector. */
-	std::uint32_t _index;
+    /*! The position in the input buffer of the first byte that is not in the bit buffer. */
+	std::uint64_t _index;
 
+	//! Load function
+	/*!
+	Loads 8 bytes as a big endian 64-bit word, the bitstream is written MSB first.
+	*/
+	static std::uint64_t load_be64(const std::uint8_t* p) {
+		std::uint64_t w;
+		memcpy(&w, p, 8);
+#if defined(_MSC_VER)
+		return _byteswap_uint64(w);
+#else
+		return __builtin_bswap64(w);
+#endif
+	}
 
+	//! Slow refill function
+	/*!
+	Used for the last 8 bytes of the input, it loads one byte at a time. The bits after
+	the end of the input are read as zeros.
+	*/
+	void refill_slow() {
+		while (_count<=56 && _index<_size) {
+			_buf |= (std::uint64_t)_f[_index] << (56-_count);
+			_index++;
+			_count += 8;
+		}
+	}
 
 public:
+	//! Empty constructor.
+    /*!
+      A bit reader on an empty input, it can be assigned later (e.g. in an array of bit readers).
+    */
+	BitReader () : _f(NULL), _size(0), _buf(0), _count(0), _index(0) {}
+
 	//! Constructor.
     /*!
       A constructor that takes the input vector that will be used for reading oeprations.
 	  This constructor also initializes other useful internal variables.
+	  The vector must not be resized while the bit reader is used.
 	  \param f The input vector from which the data will be read.
     */
-	BitReader (std::vector<std::uint8_t>& f) : _f(f), _count(0), _index(0) {}
+	BitReader (std::vector<std::uint8_t>& f) : _f(f.data()), _size(f.size()), _buf(0), _count(0), _index(0) {}
+
+	//! Constructor.
+    /*!
+      A constructor that takes the input buffer that will be used for reading oeprations.
+	  \param f The input buffer from which the data will be read.
+	  \param size The number of bytes in the input buffer.
+    */
+	BitReader (const std::uint8_t* f, std::uint64_t size) : _f(f), _size(size), _buf(0), _count(0), _index(0) {}
+
+	//! Refill function
+    /*!
+	  This function tops up the bit buffer to 56-63 bits with a single unaligned 64-bit load.
+	  The bytes that do not fit entirely are loaded again by the next refill, so no branch
+	  is needed on the number of bits; the only check is the end-of-stream guard.
+    */
+	void refill() {
+		if (_index+8 <= _size) {
+			_buf |= load_be64(_f+_index) >> _count;
+			_index += (63-_count)>>3;
+			_count |= 56;
+		} else {
+			refill_slow();
+		}
+	}
+
+	//! Peek function
+    /*!
+	  This function returns the next n bits without consuming them. The bits after the end
+	  of the input are read as zeros.
+      \param n The number of bits, between 1 and 56 after a refill.
+      \return The n bits, right aligned.
+    */
+	std::uint64_t peek(std::uint32_t n) const {
+		return _buf >> (64-n);
+	}
+
+	//! Consume function
+    /*!
+	  This function drops the next n bits from the buffer.
+      \param n The number of bits, it must not be greater than available().
+    */
+	void consume(std::uint32_t n) {
+		_buf <<= n;
+		_count -= n;
+	}
+
+	//! Available function
+    /*!
+      \return The number of valid bits in the buffer.
+    */
+	std::uint32_t available() const {
+		return _count;
+	}
 
 	//! Read bits function
     /*!
 	  This function allows the user to read a desired amount of bits from the input vector.
-	  The return value is of uint32_t type, so it's not possible to read more than 32 bits at a time. 
+	  The return value is of uint32_t type, so it's not possible to read more than 32 bits at a time.
       \param n The number of bits to be read.
       \return The n-bits read from the input vector.
     */
 	std::uint32_t read (std::uint32_t n) {
-		std::uint32_t u = 0;
-		while (n-->0)
-			u = (u<<1) | read_bit();
+		if (n==0)
+			return 0;
+		if (_count<n)
+			refill();
+		std::uint32_t u = (std::uint32_t)peek(n);
+		// oltre la fine dell'input i bit valgono zero e il buffer resta vuoto
+		consume(n<=_count ? n : _count);
 		return u;
 	}
 
@@ -56,14 +156,7 @@ public:
       \return A uin32_t containing the bit read from the input vector.
     */
 	std::uint32_t read_bit() {
-		if (_count==0) {
-			//! Extract one byte from the stream, stores it in _buf
-			_buf = _f[_index];
-			_index++;
-			//_f.read(reinterpret_cast<char*>(&_buf),1);
-			_count = 8;
-		}
-		return (_buf>>--_count)&1;
+		return read(1);
 	}
 
 	//! Read bytes function
@@ -73,43 +166,79 @@ public:
       \param n The number of bytes to be read.
       \return The vector<uint8_t> containing the n-bytes reda from the input vector.
     */
-	std::vector<std::uint8_t> read_n_bytes( std::uint8_t n){
-		std::vector<std::uint8_t> tmp;
-		
-		tmp.insert(tmp.begin(), _f.begin()+_index, _f.begin()+_index+n); 
-		_index += n;
+	std::vector<std::uint8_t> read_n_bytes( std::uint32_t n){
+		std::vector<std::uint8_t> tmp(n);
+		for (std::uint32_t i=0; i<n; ++i)
+			tmp[i] = (std::uint8_t)read(8);
 		return tmp;
 	}
 
 	//! Is good function
     /*!
-	  This function tells if the bit reader is still good for reading data. 
-	  It returns true if there is more data to be read, false if it is pointing to the
-	  last element in the input vector.
+	  This function tells if the bit reader is still good for reading data.
+	  It returns true if there are more bits to be read, false if the whole input has been read.
       \return A boolean telling if the bit reader is good or not.
     */
-	bool good(){ 
-		return (_index < _f.size());
+	bool good(){
+		return (_count>0 || _index<_size);
+	}
+
+	//! Data function
+    /*!
+      \return The input buffer.
+    */
+	const std::uint8_t* data() const {
+		return _f;
+	}
+
+	//! Size function
+    /*!
+      \return The number of bytes in the input buffer.
+    */
+	std::uint64_t size() const {
+		return _size;
+	}
+
+	//! Tell bit function
+    /*!
+      \return The position in bits of the next bit to read.
+    */
+	std::uint64_t tell_bit() const {
+		return _index*8 - _count;
+	}
+
+	//! Seek bit function
+    /*!
+	  This function sets the position in bits of the next bit to read, the buffer is emptied.
+      \param pos The new position in bits.
+    */
+	void seek_bit(std::uint64_t pos) {
+		_index = pos>>3;
+		_buf = 0;
+		_count = 0;
+		refill();
+		consume((pos&7)<=_count ? (std::uint32_t)(pos&7) : _count);
 	}
 
 	//! Tell index function
     /*!
 	  This function returns the current position of the input vector from which the bit reader
-	  is reading. It is similar to the ifstream's tellg() function.
+	  is reading, that is the byte containing the next bit to read.
+	  It is similar to the ifstream's tellg() function.
       \return The current position inside the input vector.
     */
-	std::uint32_t tell_index(){
-		return _index;
+	std::uint64_t tell_index(){
+		return tell_bit()>>3;
 	}
 
 	//! Seek index function
     /*!
 	  This function sets the position in the input vector from which the bit reader
 	  will read. It is similar to the ifstream's seekg() function.
-      \param idx The new index position in a uint32_t.
+      \param idx The new index position in a uint64_t.
     */
-	void seek_index(std::uint32_t idx){
-		_index = idx;
+	void seek_index(std::uint64_t idx){
+		seek_bit(idx*8);
 	}
 
 	//! reset index function
@@ -119,7 +248,7 @@ public:
 	  input vector
     */
 	void reset_index(){
-		_index = 0;
+		seek_bit(0);
 	}
 };
 
@@ -5,42 +5,59 @@
 #include <vector>
 #include <cstdint>
 
-//!  BitWriter class is used to write bit-by-bit 
+//!  BitWriter class is used to write bit-by-bit
 /*!
   This class is responsible for the bit-by-bit writing operations during the
   compression/decompression process.
-  It is designed to operate on a uint8_t vector, not a file (ofstream).*/
+  It is designed to operate on a uint8_t vector, not a file (ofstream).
+  The bits are collected in a 64-bit accumulator and moved to the output vector
+  32 bits at a time, the vector is used as a preallocated buffer: only the first
+  tell_index() bytes are valid, the rest is free space reserved for the next writes.*/
 class BitWriter {
 	//! Output vector.
     /*! Output vector used for writing operations. */
 	std::vector<std::uint8_t>& _f;
-	//! One byte buffer
-    /*! A one byte buffer used for reading operations. */
-	std::uint8_t _buf;
+	//! 64-bit accumulator
+    /*! The pending bits are the _count least significant bits of the accumulator. */
+	std::uint64_t _buf;
 	//! Counter
-    /*! A counter used to manage writing opreations inside the buffer. */
-	std::uint8_t _count;
+    /*! The number of pending bits in the accumulator, always less than 32 between two writes. */
+	std::uint32_t _count;
 	//! Index
-    /*! An index used to manage writing operations inside the output vector. */
-	std::uint32_t _index;
+    /*! The position in the output vector where the next byte will be written. */
+	std::uint64_t _index;
 
-	//! Write bit function
+	//! Grow function
 	/*!
-	This function is used to write only one bit to the output vector
-	\param u A uint32_t containing the bit (only the least significant bit will be considered).
+	This function makes sure that the output vector has room for n more bytes after _index.
+	If it has to grow, it doubles its size so that the cost is amortized over many writes.
+	\param n The number of bytes that will be written.
 	*/
-	void write_bit (std::uint32_t u) {
-		_buf = (_buf<<1) + (u&1);
-		_count++;
-		if (_count==8) {
-			//! Write one byte (_buf content) into the stream
-			_f.push_back(_buf);
-			_index++;
-			//_f.write(reinterpret_cast<const char*>(&_buf),1);
-			_count = 0;
+	void grow(std::uint64_t n) {
+		if (_index+n > _f.size()) {
+			std::uint64_t new_size = 2*_f.size();
+			if (new_size < _index+n)
+				new_size = _index+n;
+			_f.resize(new_size);
 		}
 	}
 
+	//! Store word function
+	/*!
+	This function moves the 32 oldest pending bits to the output vector, most significant byte first.
+	*/
+	void store_word() {
+		_count -= 32;
+		std::uint32_t w = (std::uint32_t)(_buf >> _count);
+		grow(4);
+		std::uint8_t* p = &_f[_index];
+		p[0] = (std::uint8_t)(w>>24);
+		p[1] = (std::uint8_t)(w>>16);
+		p[2] = (std::uint8_t)(w>>8);
+		p[3] = (std::uint8_t)w;
+		_index += 4;
+	}
+
 public:
 	//! Constructor.
 	/*!
@@ -48,19 +65,33 @@ public:
 	  This constructor also initializes other useful internal variables.
 	  \param f The output vector on which the data will be written.
 	*/
-	BitWriter (std::vector<std::uint8_t>& f) : _f(f), _count(0), _index(0) {}
+	BitWriter (std::vector<std::uint8_t>& f) : _f(f), _buf(0), _count(0), _index(0) {}
 
 	//! Write function
 	/*!
 	This function writes a varible using only the number of bits specified in the parameters.
+	The bits are added to the accumulator with a single shift and or, the accumulator is moved
+	to the output vector once 32 bits are collected.
 	\param u The uint32_t that will be written to the output vector.
-	\param n The number of bits that will be used for the writing operation.
+	\param n The number of bits that will be used for the writing operation (at most 32).
 	\return void
 	\sa BitWriter::flush()
 	*/
 	void write (std::uint32_t u, std::uint8_t n) {
-		while (n-->0)
-			write_bit(u>>n);
+		_buf = (_buf<<n) | (u & ((1ull<<n)-1));
+		_count += n;
+		if (_count>=32)
+			store_word();
+	}
+
+	//! Reserve function
+	/*!
+	This function makes room in the output vector for the next n bytes, so that the caller can
+	size the buffer once instead of letting it grow during the writes.
+	\param n The number of bytes that will be written.
+	*/
+	void reserve(std::uint64_t n) {
+		grow(n+8);
 	}
 
 	//! Flush function.
@@ -68,20 +99,90 @@ public:
 	This function is used to write to the output vector the data that is still in the buffer.
 	It is necessary to call thi function as the last write operation, in order to prevent the
 	loss of data that would occur, caused by the loss of the buffer's content.
+	The last byte is padded with zeros.
 	\sa BitWriter::write (uint32_t u, uint8_t n)
 	*/
 	void flush() {
-		while (_count>0)
-			write_bit(0);
+		grow(8);
+		while (_count>=8) {
+			_count -= 8;
+			_f[_index++] = (std::uint8_t)(_buf>>_count);
+		}
+		if (_count>0) {
+			_f[_index++] = (std::uint8_t)(_buf<<(8-_count));
+			_count = 0;
+		}
+	}
+
+	//! Align function
+	/*!
+	This function pads the pending bits with zeros up to the next byte boundary, the next write
+	starts on a new byte.
+	*/
+	void align() {
+		if (_count&7)
+			write(0, (std::uint8_t)(8-(_count&7)));
+	}
+
+	//! Sync function
+	/*!
+	This function moves the pending bits to the output vector so that the caller can write bits
+	directly after them: the whole bytes are stored, the last partial byte is written at
+	tell_index() padded with zeros but it is not counted as valid.
+	If the caller writes bits directly it must then call BitWriter::advance(), otherwise the
+	bit writer can keep writing as if sync() was never called.
+	\return The number of bits already used in the byte at tell_index() (0-7).
+	\sa BitWriter::advance(std::uint64_t nbits)
+	*/
+	std::uint32_t sync() {
+		grow(8);
+		while (_count>=8) {
+			_count -= 8;
+			_f[_index++] = (std::uint8_t)(_buf>>_count);
+		}
+		_f[_index] = (_count>0) ? (std::uint8_t)(_buf<<(8-_count)) : 0;
+		return _count;
+	}
+
+	//! Advance function
+	/*!
+	This function moves the bit writer after nbits bits written directly in the output vector
+	after a sync, the last partial byte becomes pending again.
+	\param nbits The number of bits written after the ones returned by BitWriter::sync().
+	\sa BitWriter::sync()
+	*/
+	void advance(std::uint64_t nbits) {
+		nbits += _count;
+		_index += nbits>>3;
+		_count = (std::uint32_t)(nbits&7);
+		_buf = (_count>0) ? (_f[_index]>>(8-_count)) : 0;
+	}
+
+	//! Current function
+	/*!
+	  \return The address of the byte at tell_index(), where the caller can write after a sync().
+	  It is valid until the next write or reserve.
+	*/
+	std::uint8_t* current() {
+		return &_f[_index];
+	}
+
+	//! Tell bit function
+    /*!
+      \return The number of bits written since the last reset_index(), pending bits included.
+    */
+	std::uint64_t tell_bit(){
+		return _index*8 + _count;
 	}
 
 	//! Tell index function
     /*!
 	  This function returns the current position of the output vector from which the bit writer
 	  is writing. It is similar to the ofstream's tellp() function.
+	  It is also the number of valid bytes in the output vector.
       \return The current position inside the output vector.
     */
-	std::uint32_t tell_index(){
+	std::uint64_t tell_index(){
 		return _index;
 	}
 
@@ -89,9 +190,9 @@ public:
     /*!
 	  This function sets the position in the output vector from which the bit writer
 	  will write. It is similar to the ifstream's seekp() function.
-      \param idx The new index position in a uint32_t.
+      \param idx The new index position in a uint64_t.
     */
-	void seek_index(std::uint32_t idx){
+	void seek_index(std::uint64_t idx){
 		_index = idx;
 	}
 
@@ -99,7 +200,7 @@ public:
     /*!
 	  This function resets the position in the output vector from which the bit writer
 	  will write to 0. The bit writer will start writing again from the beginning of the
-	  output vector
+	  output vector, the pending bits in the accumulator are kept.
     */
 	void reset_index(){
 		_index = 0;
@@ -1,8 +1,15 @@
 #include <array>
 #include <iostream>
 #include <algorithm> //std::find
+#include <climits>
+#if defined(_WIN32)
 #include "dirent.h"
+#else
+#include <dirent.h>
+#endif
 #include "cmd_line_interface.h"
+#include "huffman_utils.h"
+#include "huffman_trace.h"
 
 using namespace std;
 
@@ -28,9 +35,13 @@ int CMDLineInterface::verify_inputs() {
 
 // Inizializza la lista di parametri consentiti
 void CMDLineInterface::init(){
-	array<string,10> myarray = {"-c","--compress", "-d", "--decompress", "-p", "--parallel",
-		"-t", "--timer", 	"-v", "--verbose"};
+	array<string,17> myarray = {"-c","--compress", "-d", "--decompress", "-p", "--parallel",
+		"-t", "--timer", 	"-v", "--verbose", "-s", "--single-pass", "-b", "--batch", "--json", "--trace", "--counters"};
 	allowed_parameters.insert(myarray.begin(), myarray.end());
+	allowed_valued_parameters.insert("--tokens");
+	allowed_valued_parameters.insert("--max-code-len");
+	allowed_valued_parameters.insert("--streams");
+	allowed_valued_parameters.insert("--max-memory");
 }
 
 
@@ -50,6 +61,105 @@ bool CMDLineInterface::is_parallel(){
 	return false;
 }
 
+bool CMDLineInterface::is_single_pass(){
+	if ( any_of(par_vector.begin(), par_vector.end(),
+		[](string s){return ( !s.compare("-s") || !s.compare("--single-pass"));}) )  
+		return true;
+
+	return false;
+}
+
+bool CMDLineInterface::is_batch(){
+	if ( any_of(par_vector.begin(), par_vector.end(),
+		[](string s){return ( !s.compare("-b") || !s.compare("--batch"));}) )  
+		return true;
+
+	return false;
+}
+
+bool CMDLineInterface::is_timer(){
+	// -v stampa anche i tempi delle fasi
+	if ( any_of(par_vector.begin(), par_vector.end(),
+		[](string s){return ( !s.compare("-t") || !s.compare("--timer") || !s.compare("-v") || !s.compare("--verbose"));}) )  
+		return true;
+
+	return false;
+}
+
+bool CMDLineInterface::is_json(){
+	if ( any_of(par_vector.begin(), par_vector.end(),
+		[](string s){return !s.compare("--json");}) )  
+		return true;
+
+	return false;
+}
+
+bool CMDLineInterface::is_trace(){
+	if ( any_of(par_vector.begin(), par_vector.end(),
+		[](string s){return !s.compare("--trace");}) )  
+		return true;
+
+	return false;
+}
+
+bool CMDLineInterface::is_counters(){
+	if ( any_of(par_vector.begin(), par_vector.end(),
+		[](string s){return !s.compare("--counters");}) )  
+		return true;
+
+	return false;
+}
+
+
+uint64_t CMDLineInterface::get_value(string name, uint64_t default_value){
+	for (vector<string>::iterator it = par_vector.begin(); it != par_vector.end(); ++it)
+		if(it->compare(0, name.size()+1, name+"=") == 0)
+			return stoull(it->substr(name.size()+1));
+
+	return default_value;
+}
+
+unsigned CMDLineInterface::get_tokens(){
+	uint64_t tokens = get_value("--tokens", HUF_PIPELINE_TOKENS);
+	if(tokens > UINT_MAX)
+		return UINT_MAX;
+	return (tokens > 0) ? (unsigned)tokens : 1;
+}
+
+uint32_t CMDLineInterface::get_max_code_len(){
+	uint64_t len = get_value("--max-code-len", HUF_MAX_CODE_LEN);
+	if(len < HUF_MAX_CODE_LEN_MIN)
+		return HUF_MAX_CODE_LEN_MIN;
+	if(len > HUF_MAX_CODE_LEN_MAX)
+		return HUF_MAX_CODE_LEN_MAX;
+	return (uint32_t)len;
+}
+
+uint32_t CMDLineInterface::get_streams(){
+	// il formato ammette 1, 2, 4 o 8 bitstream, arrotondo per difetto
+	uint64_t streams = get_value("--streams", 1);
+	if(streams >= HUF_MAX_STREAMS)
+		return HUF_MAX_STREAMS;
+	if(streams >= 4)
+		return 4;
+	if(streams >= 2)
+		return 2;
+	return 1;
+}
+
+uint64_t CMDLineInterface::get_max_memory(){
+	// in MB, 0 se non e' dato: il budget viene dal sistema
+	uint64_t mb = get_value("--max-memory", 0);
+	// oltre il massimo rappresentabile in byte il budget e' illimitato
+	if(mb > UINT64_MAX/HUF_ONE_MB)
+		return UINT64_MAX;
+	return mb*HUF_ONE_MB;
+}
+
+bool CMDLineInterface::is_streaming(){
+	return find(file_vector.begin(), file_vector.end(), "-") != file_vector.end();
+}
+
 
 vector<string> CMDLineInterface::get_files(){
 	return file_vector;
@@ -64,9 +174,17 @@ int CMDLineInterface::check_par_consistency() {
 		return ARGC_ERROR;
 
 	// Check if all the parameters provided are allowed
-	for (vector<string>::iterator it = par_vector.begin(); it != par_vector.end(); ++it)
-		if(allowed_parameters.find (*it)==allowed_parameters.end())
+	for (vector<string>::iterator it = par_vector.begin(); it != par_vector.end(); ++it){
+		// i parametri numerici sono nella forma --nome=valore
+		size_t eq = it->find('=');
+		if(eq != string::npos){
+			string value = it->substr(eq+1);
+			if(allowed_valued_parameters.find (it->substr(0, eq))==allowed_valued_parameters.end() || value.empty() || value.size() > 18 ||
+				!all_of(value.begin(), value.end(), [](char c){return (c >= '0' && c <= '9');}))
+				return PAR_ERROR;
+		} else if(allowed_parameters.find (*it)==allowed_parameters.end())
 			return PAR_ERROR;
+	}
 
 	// Check if at least one between compression and decompression has been chosen
 	if ( none_of(par_vector.begin(), par_vector.end(),[](string s){
@@ -115,9 +233,12 @@ int CMDLineInterface::check_file_existence() {
         exit (EXIT_FAILURE);
     }
 
-	// Control that all files in the file vector actually exist in the current directory
+	// Control that all files in the file vector actually exist in the current directory,
+	// "-" is stdin/stdout and can be given only once
+	if(count(file_vector.begin(), file_vector.end(), "-") > 1)
+		return FILE_ERROR;
 	for (vector<string>::iterator it = file_vector.begin(); it != file_vector.end(); ++it)
-		if(files_listed.find (*it)==files_listed.end())
+		if(it->compare("-") && files_listed.find (*it)==files_listed.end())
 			return FILE_ERROR;
 	
 	return 1;
@@ -128,7 +249,8 @@ int CMDLineInterface::check_file_existence() {
 void CMDLineInterface::separate_par_from_files(int argc, char** argv){
 	num_par = argc-1;
 	for(int i=1; i<= num_par; ++i){
-		if(string(argv[i]).at(0)=='-')
+		// "-" da solo non e' un parametro ma lo stream standard
+		if(string(argv[i]).at(0)=='-' && string(argv[i]).compare("-"))
 			par_vector.push_back(argv[i]);
 		else
 			file_vector.push_back(argv[i]);
@@ -167,6 +289,17 @@ void CMDLineInterface::error_message(int code){
 void CMDLineInterface::usage_message(void){
 	cout << "	Use: huffman_tbb.exe <mode> [options] <file>" << endl;
 	cout << "	<mode>: -c (--compress), -d (--decompress)" << endl;
-	cout << "	[options]: -p (--parallel), -t (--timer), -v (--verbose)" << endl;
+	cout << "	[options]: -p (--parallel)" << endl;
+	cout << "	           -t, -v (--timer, --verbose, time of every stage of every file: read, histogram, tree, encode, pack, decode, write)" << endl;
+	cout << "	           --json (with -t or -v, the times as JSON instead of a table)" << endl;
+	cout << "	           --trace (timeline of every thread in " << HUF_TRACE_FILENAME << ", for chrome://tracing or Perfetto)" << endl;
+	cout << "	           --counters (hardware counters of every stage: IPC, branch, L1D and LLC misses per byte, Linux only)" << endl;
+	cout << "	           -s (--single-pass, compress reading the input once, one code table per block)" << endl;
+	cout << "	           -b (--batch, compress many files at the same time, the smallest first)" << endl;
+	cout << "	           --max-code-len=N (longest code in bits, " << HUF_MAX_CODE_LEN_MIN << "-" << HUF_MAX_CODE_LEN_MAX << ", default " << HUF_MAX_CODE_LEN << ")" << endl;
+	cout << "	           --streams=N (interleaved bitstreams per block for faster decoding: 1, 2, 4 or 8, default 1)" << endl;
+	cout << "	           --tokens=N (blocks in flight while compressing, default " << HUF_PIPELINE_TOKENS << ")" << endl;
+	cout << "	           --max-memory=MB (memory budget, default the memory available to the process or its cgroup)" << endl;
 	cout << "	<file>: filename1 filename2 ... filenameN" << endl;
+	cout << "	        - (stdin to stdout, compression is always single-pass)" << endl;
 }
\ No newline at end of file
@@ -2,8 +2,10 @@
 #define CMD_LINE_INTERFACE
 
 #include <string>
+#include <vector>
 #include <unordered_set>
 #include <tuple> 
+#include <cstdint>
 
 #define ARGC_ERROR -1
 #define PAR_ERROR  -2
@@ -31,6 +33,8 @@ private:
 	std::vector<std::string> file_vector;
 	//! Set of parameters allowed by the program
 	std::unordered_set<std::string> allowed_parameters;
+	//! Set of parameters allowed by the program that take a numeric value (--name=value)
+	std::unordered_set<std::string> allowed_valued_parameters;
 
 	//! Initialization of allowed parameters
 	void init();
@@ -86,6 +90,96 @@ public:
 	*/
 	bool is_parallel(void);
 
+	//! Ask the interface if the file has to be compressed in a single pass
+    /*!
+	  If the user gave as parameters either "-s" or "--single-pass", every block gets its own code table
+	  and the input is read only once.
+      \return bool single pass
+	*/
+	bool is_single_pass(void);
+	//! Ask the interface if the files have to be compressed in batch mode
+    /*!
+	  If the user gave as parameters either "-b" or "--batch", all the files are compressed at the same time
+	  by HuffmanBatch, under the memory budget.
+      \return bool batch
+	*/
+	bool is_batch(void);
+
+	//! Ask the interface if the stages have to be timed
+    /*!
+	  If the user gave as parameters "-t", "--timer", "-v" or "--verbose", the time of every stage
+	  of every file is measured and printed at the end of the file, with the total of the run.
+      \return bool timer
+	*/
+	bool is_timer(void);
+	//! Ask the interface if the times have to be printed as JSON
+    /*!
+	  If the user gave as parameter "--json", the times are printed as a JSON document instead of tables.
+      \return bool json
+	*/
+	bool is_json(void);
+	//! Ask the interface if the spans of the threads have to be traced
+    /*!
+	  If the user gave as parameter "--trace", the spans of the pipelines and of the parallel tasks of every
+	  thread are written at the end of the run in a Chrome trace, see HuffmanTrace.
+      \return bool trace
+	*/
+	bool is_trace(void);
+	//! Ask the interface if the hardware counters have to be read
+    /*!
+	  If the user gave as parameter "--counters", the hardware counters of the CPU are read around the stages
+	  of every file and printed at the end of the file, see HuffmanCounters.
+      \return bool counters
+	*/
+	bool is_counters(void);
+
+	//! Ask the interface the value of a numeric parameter
+    /*!
+	  Numeric parameters are given as --name=value, e.g. --tokens=16.
+      \param name The parameter name, e.g. "--tokens".
+      \param default_value The value returned if the parameter is not given.
+      \return std::uint64_t value
+	*/
+	std::uint64_t get_value(std::string name, std::uint64_t default_value);
+
+	//! Ask the interface how many blocks can be in flight in the compression pipeline
+    /*!
+	  The user can set it with "--tokens=N", otherwise HUF_PIPELINE_TOKENS is used.
+      \return unsigned tokens
+	*/
+	unsigned get_tokens(void);
+
+	//! Ask the interface the maximum code length
+    /*!
+	  The user can set it with "--max-code-len=N", otherwise HUF_MAX_CODE_LEN is used.
+	  The value is clamped between HUF_MAX_CODE_LEN_MIN and HUF_MAX_CODE_LEN_MAX.
+      \return std::uint32_t max code length
+	*/
+	std::uint32_t get_max_code_len(void);
+
+	//! Ask the interface the number of interleaved bitstreams of every block
+    /*!
+	  The user can set it with "--streams=N", the value is rounded down to 1, 2, 4 or 8. The default is 1,
+	  a single bitstream per block.
+      \return std::uint32_t number of bitstreams
+	*/
+	std::uint32_t get_streams(void);
+	//! Ask the interface the memory limit given by the user
+    /*!
+	  The user can set it with "--max-memory=MB", it bounds the buffers of the compression and decompression
+	  (see memory_budget()).
+      \return std::uint64_t limit in bytes, 0 if not given
+	*/
+	std::uint64_t get_max_memory(void);
+
+	//! Ask the interface if stdin/stdout are used
+    /*!
+	  The file "-" means that the input is read from stdin and the output is written on stdout,
+	  nothing else can be written on stdout.
+      \return bool streaming
+	*/
+	bool is_streaming(void);
+
 	std::vector<std::string> get_files();
 };
 
@@ -0,0 +1,81 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HUF_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+#endif
+
+// attributo per compilare una singola funzione con AVX2 senza abilitarlo per tutto il programma
+// (con MSVC gli intrinsic AVX2 si possono usare senza opzioni)
+#if defined(HUF_X86) && !defined(_MSC_VER)
+#define HUF_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define HUF_TARGET_AVX2
+#endif
+
+
+//! Detect AVX2 function.
+/*!
+Asks the CPU (CPUID) if AVX2 is supported and the OS (XGETBV) if it saves the AVX registers.
+\return true if the AVX2 code paths can be used.
+*/
+static bool detect_avx2(){
+#if defined(HUF_X86)
+	unsigned int regs[4];
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuid(r, 0);
+	if(r[0] < 7)
+		return false;
+	__cpuid(r, 1);
+	for(int k=0; k<4; ++k) regs[k] = (unsigned int)r[k];
+#else
+	if(__get_cpuid_max(0, 0) < 7)
+		return false;
+	__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+	// OSXSAVE (ecx bit 27) e AVX (ecx bit 28)
+	if((regs[2] & (1u<<27)) == 0 || (regs[2] & (1u<<28)) == 0)
+		return false;
+
+	// il sistema operativo deve salvare i registri XMM e YMM (XCR0 bit 1 e 2)
+#if defined(_MSC_VER)
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned int xlo, xhi;
+	__asm__ ("xgetbv" : "=a"(xlo), "=d"(xhi) : "c"(0));
+	unsigned long long xcr0 = ((unsigned long long)xhi << 32) | xlo;
+#endif
+	if((xcr0 & 6) != 6)
+		return false;
+
+	// AVX2 (ebx bit 5 della leaf 7)
+#if defined(_MSC_VER)
+	__cpuidex(r, 7, 0);
+	regs[1] = (unsigned int)r[1];
+#else
+	__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	return (regs[1] & (1u<<5)) != 0;
+#else
+	return false;
+#endif
+}
+
+//! Has AVX2 function.
+/*!
+\return true if the AVX2 code paths can be used, the CPU is queried only the first time.
+*/
+static bool cpu_has_avx2(){
+	static const bool avx2 = detect_avx2();
+	return avx2;
+}
+
+#endif /*CPU_FEATURES_H*/
@@ -1,8 +1,45 @@
 #include "huffman.h"
+#include "bitreader.h"
+#include "huffman_decoder.h"
+#include "huffman_histo.h"
+#include "huffman_format.h"
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include "tbb/tbb.h"
+#include "tbb/pipeline.h"
+#include "tbb/tick_count.h"
 
 using namespace std;
+using namespace tbb;
+
+// coppie <lunghezza, simbolo> della mappa dei codici ordinate per lunghezza e simbolo, come vanno scritte
+static void sorted_depthmap(CodeVector& codes_map, DepthMap& depthmap){
+
+	// creo un'altra struttura ordinata per scrivere i simboli in ordine, dal pi corto al pi lungo
+	// la depthmap contiene le coppie <lunghezza, simbolo>
+	for(uint32_t i=0; i<256; ++i){
+		if(codes_map.presence_vector[i]==true){
+			DepthMapElement tmp;
+			tmp.first = codes_map.codes_vector[i].second;
+			tmp.second = i;
+			depthmap.push_back(tmp);
+		}
+	}
+	sort(depthmap.begin(), depthmap.end(), depth_compare);
+}
+
+// legge n coppie <simbolo, lunghezza_codice> e le salva come <lunghezza_codice, simbolo>
+static void read_code_lengths(BitReader& btr, uint32_t n, DepthMap& depthmap){
+	// (le due read vanno fatte in ordine, non dentro la stessa espressione)
+	for(unsigned i=0; i<n; ++i){
+		DepthMapElement tmp;
+		tmp.second = btr.read(8);
+		tmp.first = btr.read(8);
+		depthmap.push_back(tmp);
+	}
+}
 
 void Huffman::init(std::string filename){
 	// setta original filename
@@ -16,10 +53,15 @@ void Huffman::init(std::string filename){
 Funzione che legge il file in input, riempie un vector<uint8_t> con il contenuto del file
 e restituisce il vector<uint8_t> su cui successivamente applicare la compressione
 */
-void Huffman::read_file(string filename){
+bool Huffman::read_file(string filename){
+	StageTimer stage(_timer, HUF_STAGE_READ);
 
 	// Apri file di input
 	ifstream file_in(filename, ifstream::in|ifstream::binary|fstream::ate);
+	// senza file tellg darebbe -1, cioe' un buffer enorme
+	_file_in.clear();
+	if(!file_in)
+		return false;
 	// NON salta i whitespaces
 	file_in.unsetf (ifstream::skipws);
 
@@ -32,27 +74,49 @@ void Huffman::read_file(string filename){
 
 	char* buffer = new char [_file_length];
 	file_in.read(buffer, _file_length);
-	_file_in.assign(buffer, buffer+_file_length);
+	bool ok = !file_in.fail();
+	_file_in.assign(buffer, buffer+file_in.gcount());
 	delete[] buffer;
 	file_in.close();
-
+	stage.set_bytes(_file_in.size());
+	return ok;
 }
 
 void Huffman::read_file(ifstream& file_in, uint64_t beg_pos, uint64_t chunk_dim){
+	StageTimer stage(_timer, HUF_STAGE_READ);
 
 	char* buffer = new char [chunk_dim];
 	file_in.seekg(beg_pos); // posizione iniziale = inizio del chunk attuale
 	file_in.read(buffer, chunk_dim);
-	_file_in.assign(buffer, buffer+chunk_dim);
+	// se il file finisce prima tengo solo i byte letti e resetto lo stato dello stream,
+	// altrimenti le seekg successive fallirebbero
+	_file_in.assign(buffer, buffer+file_in.gcount());
+	file_in.clear();
 	delete[] buffer;
+	stage.set_bytes(_file_in.size());
 	//file_in.close();
 }
 
+bool Huffman::open_input(MappedFile& mapped, string filename, const uint8_t*& in, uint64_t& file_len){
+
+	if(mapped.open(filename)){
+		file_len = mapped.size();
+		in = mapped.data();
+		return true;
+	}
+
+	// file non mappabile: lo leggo tutto in memoria
+	bool ok = read_file(filename);
+	file_len = _file_in.size();
+	in = _file_in.data();
+	return ok;
+}
+
 /*
 Funzione che prende il risultato della comrpessione da un vector<uint8_t> e lo
 scrive in blocco sul file di output
 */
-void Huffman::write_on_file (string filename){
+void Huffman::write_on_file (){
 
 	ofstream outf(_output_filename, fstream::out|fstream::binary);
 	outf.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
@@ -62,39 +126,916 @@ void Huffman::write_on_file (string filename){
 
 
 
-BitWriter Huffman::write_header(CodeVector& codes_map){
+BitWriter Huffman::write_header(CodeVector& codes_map, uint64_t file_len){
 
 	// crea il file di output
 	BitWriter btw(_file_out);
+	_index.clear();
+	_written = 0;
 
-	//scrivo il magic number
-	btw.write(HUF_MAGIC_NUMBER, 32);
-	// scrivo la dimensione del nome del file originale
-	btw.write((uint32_t)_original_filename.size(), 32);
-	// Scrivo il nome del file originale, per recuperarlo in decompressione
-	for(size_t i=0; i<_original_filename.size(); ++i)
-		btw.write(_original_filename[i], 8);
+	// magic number, nome del file originale (per recuperarlo in decompressione), lunghezza del file,
+	// dimensione dei blocchi, poi il numero di simboli e le coppie <simbolo, lunghezza_codice>
+	DepthMap depthmap;
+	sorted_depthmap(codes_map, depthmap);
+	write_file_header(btw, _original_filename.data(), (uint32_t)_original_filename.size(), file_len, (uint32_t)depthmap.size());
+	write_code_pairs(btw, depthmap);
 
-	// scrivo il numero di simboli
-	btw.write((uint32_t)codes_map.num_symbols, 32);
+	return btw;
+}
 
-	// creo un'altra struttura ordinata per scrivere i simboli in ordine, dal pi corto al pi lungo
-	// la depthmap contiene le coppie <lunghezza, simbolo>
+uint64_t Huffman::read_header(ifstream& file_in, DepthMap& depthmap, uint64_t& file_len, uint32_t& block_dim){
+
+	// leggo quanto basta per leggere tutto l'header
+	read_file(file_in, 0, HUF_HEADER_DIM);
+
+	FileHeader h;
+	if(!parse_header(_file_in.data(), _file_in.size(), h)){
+		if(h.magic != HUF_MAGIC_NUMBER && h.magic != HUF_MAGIC_NUMBER_V1)
+			cerr << "Error: unknown format, wrong magic number..." << endl;
+		else
+			cerr << "Error: corrupted header" << endl;
+		file_in.close();
+		exit(1);
+	}
+
+	// nome del file originale, lunghezza del file e dei blocchi
+	_output_filename.assign(_file_in.begin()+h.name_start, _file_in.begin()+h.name_start+h.name_length);
+	file_len = h.file_len;
+	block_dim = h.block_dim;
+
+	// leggo le coppie <simbolo, lunghezza_codice> e le salvo come <lunghezza_codice, simbolo>
+	BitReader btr(_file_in.data()+h.table_start, 2*(uint64_t)h.num_symbols);
+	read_code_lengths(btr, h.num_symbols, depthmap);
+
+	_file_in.clear();
+
+	return h.data_start;
+}
+
+void Huffman::default_output_filename(const string& filename){
+	// un file compresso da stdin non ha il nome originale: tolgo l'estensione
+	if(_output_filename.empty()){
+		size_t dot = filename.rfind('.');
+		_output_filename = (dot != string::npos && dot > 0) ? filename.substr(0, dot) : filename + ".out";
+	}
+}
+
+// lunghezze delle coppie <simbolo, lunghezza_codice> di una tabella: tra 1 e HUF_MAX_CODE_LEN_MAX,
+// e un codice prefisso (disuguaglianza di Kraft). Un header corrotto non arriva al decoder
+static bool valid_code_lengths(const uint8_t* pairs, uint32_t n){
+	uint64_t kraft = 0;
+	for(uint32_t i=0; i<n; ++i){
+		uint32_t len = pairs[2*i+1];
+		if(len == 0 || len > HUF_MAX_CODE_LEN_MAX)
+			return false;
+		kraft += 1ull << (HUF_MAX_CODE_LEN_MAX-len);
+	}
+	return kraft <= (1ull << HUF_MAX_CODE_LEN_MAX);
+}
+
+// tabella dopo l'eventuale nome di un header BCP1: numero di simboli e coppie <simbolo, lunghezza_codice>.
+// Le lunghezze vengono controllate, e' l'unico modo per riconoscere quale dei due layout BCP1 e' stato scritto
+static bool parse_v1_table(const uint8_t* buf, uint64_t size, uint64_t name_start, uint64_t name_length, FileHeader& h){
+	uint64_t count = name_start + name_length;
+	if(size < count+4)
+		return false;
+	BitReader btr(buf+count, 4);
+	h.name_start = name_start;
+	h.name_length = (uint32_t)name_length;
+	h.num_symbols = btr.read(32);
+	h.table_start = count+4;
+	if(h.num_symbols > 256 || size-h.table_start < 2*(uint64_t)h.num_symbols)
+		return false;
+	if(!valid_code_lengths(buf+h.table_start, h.num_symbols))
+		return false;
+	h.data_start = h.table_start + 2*(uint64_t)h.num_symbols;
+	return true;
+}
+
+bool Huffman::parse_header(const uint8_t* buf, uint64_t size, FileHeader& h){
+	h.magic = 0;
+	if(size < 8)
+		return false;
+	BitReader btr(buf, 8);
+	h.magic = btr.read(32);
+	uint64_t name_length = btr.read(32);
+
+	// BCP1: nome e tabella, la lunghezza del file non c'e'. I primi file BCP1 (come Debug/prova.bcp)
+	// non hanno nemmeno il nome: la tabella segue subito il magic number
+	if(h.magic == HUF_MAGIC_NUMBER_V1){
+		h.file_len = HUF_UNKNOWN_LENGTH;
+		h.block_dim = 0;
+		return parse_v1_table(buf, size, 8, name_length, h) || parse_v1_table(buf, size, 4, 0, h);
+	}
+	if(h.magic != HUF_MAGIC_NUMBER)
+		return false;
+
+	// BCP2: nome, lunghezza del file, dimensione dei blocchi e tabella
+	h.name_start = 8;
+	h.name_length = (uint32_t)name_length;
+	if(size-8 < name_length+16)
+		return false;
+	BitReader fields(buf+8+name_length, 16);
+	h.file_len = read_u64(fields);
+	h.block_dim = fields.read(32);
+	h.num_symbols = fields.read(32);
+	// i blocchi vengono tenuti in memoria interi, non possono essere piu' lunghi di quelli scritti
+	if(h.block_dim == 0 || h.block_dim > HUF_BLOCK_DIM)
+		return false;
+	h.table_start = 8+name_length+16;
+	if(h.num_symbols > 256 || size-h.table_start < 2*(uint64_t)h.num_symbols)
+		return false;
+	if(!valid_code_lengths(buf+h.table_start, h.num_symbols))
+		return false;
+	h.data_start = h.table_start + 2*(uint64_t)h.num_symbols;
+	return true;
+}
+
+// lunghezze dei codici della mappa, 0 per i simboli senza codice
+static void codes_map_lengths(const CodeVector& codes_map, uint32_t lengths[256]){
+	for(int i=0; i<256; ++i)
+		lengths[i] = codes_map.presence_vector[i] ? codes_map.codes_vector[i].second : 0;
+}
+
+// costo in bit di un blocco con la sua tabella: header, tabella e almeno un bit per simbolo,
+// mai piu' del blocco copiato
+static double block_cost(const Histo& histo, uint64_t dim){
+	uint64_t num_symbols = 0;
+	for(int i=0; i<256; ++i)
+		if(histo[i] > 0)
+			num_symbols++;
+	double own = (HUF_BLOCK_HEADER_DIM + 2 + 2*num_symbols)*8.0 + max(histo_entropy(histo.data()), (double)dim);
+	double stored = (HUF_BLOCK_HEADER_DIM + dim)*8.0;
+	return min(own, stored);
+}
+
+// fonde i segmenti adiacenti di una finestra finche' una tabella condivisa costa meno di due:
+// ogni volta la coppia che risparmia di piu', i blocchi risultanti vanno in coda a plan
+static void plan_window(vector<BlockPlan>& blocks, vector<BlockPlan>& plan){
+	vector<double> cost(blocks.size());
+	for(size_t i=0; i<blocks.size(); ++i)
+		cost[i] = block_cost(blocks[i].histo, blocks[i].dim);
+
+	// gain[i]: bit risparmiati fondendo i blocchi i e i+1
+	Histo merged(256, 0);
+	auto pair_gain = [&](size_t i) -> double {
+		for(int k=0; k<256; ++k)
+			merged[k] = blocks[i].histo[k] + blocks[i+1].histo[k];
+		return cost[i] + cost[i+1] - block_cost(merged, blocks[i].dim + blocks[i+1].dim);
+	};
+	vector<double> gain(blocks.size(), 0);
+	for(size_t i=0; i+1<blocks.size(); ++i)
+		gain[i] = pair_gain(i);
+
+	while(blocks.size() > 1){
+		size_t best = 0;
+		for(size_t i=1; i+1<blocks.size(); ++i)
+			if(gain[i] > gain[best])
+				best = i;
+		if(gain[best] <= 0)
+			break;
+
+		// il blocco best assorbe best+1, cambiano solo i guadagni delle coppie vicine
+		for(int k=0; k<256; ++k)
+			blocks[best].histo[k] += blocks[best+1].histo[k];
+		blocks[best].dim += blocks[best+1].dim;
+		cost[best] = block_cost(blocks[best].histo, blocks[best].dim);
+		blocks.erase(blocks.begin()+best+1);
+		cost.erase(cost.begin()+best+1);
+		gain.erase(gain.begin()+best+1);
+		if(best+1 < blocks.size())
+			gain[best] = pair_gain(best);
+		if(best > 0)
+			gain[best-1] = pair_gain(best-1);
+	}
+
+	for(size_t i=0; i<blocks.size(); ++i)
+		plan.push_back(std::move(blocks[i]));
+}
+
+void Huffman::plan_blocks(const uint8_t* in, uint64_t offset, uint64_t len, uint64_t file_len, Histo& histo, vector<BlockPlan>& plan){
+
+	// segmenti di HUF_SEGMENT_DIM byte (piu' lunghi sui file grandi), nessuno attraversa una finestra di HUF_BLOCK_DIM
+	uint64_t segment_dim = max<uint64_t>(HUF_SEGMENT_DIM, (file_len + HUF_MAX_SEGMENTS-1)/HUF_MAX_SEGMENTS);
+	segment_dim = min<uint64_t>(segment_dim, HUF_BLOCK_DIM);
+
+	// le finestre vengono analizzate a gruppi di almeno HUF_PLAN_SEGMENTS segmenti: gli istogrammi dei
+	// segmenti di un gruppo vengono liberati appena pianificato, restano solo quelli dei blocchi
+	uint64_t w = 0;
+	while(w < len){
+		uint64_t group_start = w;
+		vector<BlockPlan> segments;
+		vector<size_t> windows;
+		for(; w<len && segments.size()<HUF_PLAN_SEGMENTS; w+=HUF_BLOCK_DIM){
+			uint64_t window_end = min<uint64_t>(len, w+HUF_BLOCK_DIM);
+			windows.push_back(segments.size());
+			for(uint64_t s=w; s<window_end; s+=segment_dim){
+				BlockPlan seg;
+				seg.offset = offset + s;
+				seg.dim = min(segment_dim, window_end-s);
+				segments.push_back(seg);
+			}
+		}
+		windows.push_back(segments.size());
+
+		// l'istogramma di ogni segmento, la somma e' l'istogramma del file
+		segment_histos(in, segments, histo);
+
+		// i blocchi si scelgono una finestra alla volta, quindi non superano mai HUF_BLOCK_DIM
+		TraceSpan span(_trace, "plan blocks", min<uint64_t>(w, len)-group_start);
+		for(size_t i=0; i+1<windows.size(); ++i){
+			vector<BlockPlan> window(make_move_iterator(segments.begin()+windows[i]), make_move_iterator(segments.begin()+windows[i+1]));
+			plan_window(window, plan);
+		}
+	}
+}
+
+void Huffman::encode_block(uint64_t block_budget, const uint8_t* data, uint64_t block_dim, CodeVector& codes_map, vector<uint8_t>& out){
+
+	BitWriter btw(out);
+
+	// header del blocco, la dimensione compressa viene scritta alla fine
+	write_block_header(btw, HUF_BLOCK_HUFFMAN | (_streams > 1 ? HUF_BLOCK_INTERLEAVED : 0), (uint32_t)block_dim, 0);
+
+	write_block_payload(block_budget, data, block_dim, codes_map, btw);
+
+	// il blocco finisce a un byte intero
+	btw.flush();
+	out.resize(btw.tell_index());
+
+	uint32_t payload = (uint32_t)(out.size() - HUF_BLOCK_HEADER_DIM);
+	set_block_size(out.data(), payload);
+
+	// codificato il blocco non e' piu' corto, lo copio
+	if(payload >= block_dim)
+		encode_block_stored(data, block_dim, out);
+}
+
+void Huffman::encode_block_local(uint64_t block_budget, const uint8_t* data, uint64_t block_dim, vector<uint8_t>& out){
+
+	// istogramma e codici del solo blocco
+	Histo histo(256, 0);
+	{
+		StageTimer stage(_timer, HUF_STAGE_HISTOGRAM, block_dim);
+		StageCounters counters(_counters, HUF_STAGE_HISTOGRAM, block_dim);
+		histo_accumulate(data, block_dim, histo.data());
+	}
+
+	// nessuna tabella globale: il blocco ha la sua tabella o viene copiato
+	CodeVector no_codes;
+	encode_block_best(block_budget, data, block_dim, histo, no_codes, out);
+}
+
+void Huffman::encode_block_local(uint64_t block_budget, const uint8_t* data, uint64_t block_dim, CodeVector& codes_map, vector<uint8_t>& out){
+
+	BitWriter btw(out);
+
+	// header del blocco, la dimensione compressa viene scritta alla fine
+	write_block_header(btw, HUF_BLOCK_LOCAL | (_streams > 1 ? HUF_BLOCK_INTERLEAVED : 0), (uint32_t)block_dim, 0);
+
+	// tabella compatta: numero di simboli e coppie <simbolo, lunghezza_codice>
 	DepthMap depthmap;
-	for(uint32_t i=0; i<256; ++i){
-		if(codes_map.presence_vector[i]==true){
-			DepthMapElement tmp;
-			tmp.first = codes_map.codes_vector[i].second;
-			tmp.second = i;
-			depthmap.push_back(tmp);
+	sorted_depthmap(codes_map, depthmap);
+	write_local_table(btw, depthmap);
+
+	write_block_payload(block_budget, data, block_dim, codes_map, btw);
+
+	// il blocco finisce a un byte intero
+	btw.flush();
+	out.resize(btw.tell_index());
+
+	uint32_t payload = (uint32_t)(out.size() - HUF_BLOCK_HEADER_DIM);
+	set_block_size(out.data(), payload);
+
+	// codificato il blocco non e' piu' corto, lo copio
+	if(payload >= block_dim)
+		encode_block_stored(data, block_dim, out);
+}
+
+void Huffman::encode_block_best(uint64_t block_budget, const uint8_t* data, uint64_t block_dim, Histo& histo, CodeVector& codes_map, vector<uint8_t>& out){
+
+	CodeVector block_codes;
+	switch(block_type(block_dim, histo, codes_map, block_codes)){
+		case HUF_BLOCK_STORED: encode_block_stored(data, block_dim, out); break;
+		case HUF_BLOCK_HUFFMAN: encode_block(block_budget, data, block_dim, codes_map, out); break;
+		default: encode_block_local(block_budget, data, block_dim, block_codes, out); break;
+	}
+}
+
+uint8_t Huffman::block_type(uint64_t block_dim, Histo& histo, CodeVector& codes_map, CodeVector& block_codes){
+
+	// lunghezza esatta con i codici del blocco: tabella e bit dei simboli
+	block_codes = create_block_code_map(histo);
+	uint32_t lengths[256];
+	codes_map_lengths(block_codes, lengths);
+	uint64_t local_dim = 2 + 2*(uint64_t)block_codes.num_symbols + payload_dim(histo_cost(histo.data(), lengths));
+
+	// lunghezza esatta con i codici dell'header, solo se hanno un codice per ogni simbolo del blocco
+	uint64_t global_dim = UINT64_MAX;
+	codes_map_lengths(codes_map, lengths);
+	bool covered = true;
+	for(int i=0; i<256; ++i)
+		if(histo[i] > 0 && lengths[i] == 0)
+			covered = false;
+	if(covered)
+		global_dim = payload_dim(histo_cost(histo.data(), lengths));
+
+	// la scelta piu' corta, il blocco copiato se nessuna tabella lo riduce
+	if(min(local_dim, global_dim) >= block_dim)
+		return HUF_BLOCK_STORED;
+	if(global_dim <= local_dim)
+		return HUF_BLOCK_HUFFMAN;
+	return HUF_BLOCK_LOCAL;
+}
+
+bool Huffman::global_table_used(vector<BlockPlan>& plan, CodeVector& codes_map){
+	CodeVector block_codes;
+	for(size_t i=0; i<plan.size(); ++i)
+		if(block_type(plan[i].dim, plan[i].histo, codes_map, block_codes) == HUF_BLOCK_HUFFMAN)
+			return true;
+	return false;
+}
+
+void Huffman::encode_block_stored(const uint8_t* data, uint64_t block_dim, vector<uint8_t>& out){
+	StageTimer stage(_timer, HUF_STAGE_ENCODE, block_dim);
+	TraceSpan span(_trace, "store block", block_dim);
+
+	// header con dimensione compressa uguale a quella originale, poi i byte del blocco
+	out.resize(HUF_BLOCK_HEADER_DIM + block_dim);
+	store_block(out.data(), data, (uint32_t)block_dim);
+}
+
+uint64_t Huffman::payload_dim(uint64_t bits){
+	// con piu' bitstream: numero di bitstream, jump table e al piu' un byte incompleto per bitstream
+	uint32_t n = (_streams < HUF_MAX_STREAMS) ? _streams : HUF_MAX_STREAMS;
+	if(n > 1)
+		return 1 + 4*(uint64_t)(n-1) + bits/8 + n;
+	return (bits+7)/8;
+}
+
+void Huffman::write_block_payload(uint64_t block_budget, const uint8_t* data, uint64_t block_dim, CodeVector& codes_map, BitWriter& btw){
+	if(_streams > 1 && block_dim > 0)
+		write_streams(data, block_dim, codes_map, btw);
+	else
+		write_chunks_compressed(block_budget, data, block_dim, codes_map, btw);
+}
+
+void Huffman::write_streams(const uint8_t* data, uint64_t block_dim, CodeVector& codes_map, BitWriter& btw){
+
+	uint32_t n = (_streams < HUF_MAX_STREAMS) ? _streams : HUF_MAX_STREAMS;
+	uint32_t max_len = codes_map.max_len();
+
+	// un bit writer per bitstream, ciascuno con il suo buffer
+	vector<vector<uint8_t>> streams(n);
+	vector<BitWriter> writers;
+	writers.reserve(n);
+	for(uint32_t s=0; s<n; ++s){
+		writers.push_back(BitWriter(streams[s]));
+		writers[s].reserve(((block_dim/n+1)*max_len)/8 + 1);
+	}
+
+	// una sola passata sull'input, il simbolo i va nel bitstream i % n
+	{
+		StageTimer stage(_timer, HUF_STAGE_ENCODE, block_dim);
+		StageCounters counters(_counters, HUF_STAGE_ENCODE, block_dim);
+		uint64_t i = 0;
+		for(; i+n <= block_dim; i+=n){
+			for(uint32_t s=0; s<n; ++s){
+				const pair<uint32_t,uint32_t>& element = codes_map.codes_vector[data[i+s]];
+				writers[s].write(element.first, element.second);
+			}
+		}
+		for(uint32_t s=0; i<block_dim; ++i, ++s){
+			const pair<uint32_t,uint32_t>& element = codes_map.codes_vector[data[i]];
+			writers[s].write(element.first, element.second);
 		}
 	}
-	sort(depthmap.begin(), depthmap.end(), depth_compare);
+	StageTimer stage(_timer, HUF_STAGE_PACK);
 
-	// scrivo PRIMA IL SIMBOLO POI LA LUNGHEZZA
-	for(size_t i=0; i<depthmap.size(); ++i){
-		btw.write(depthmap[i].second, 8); // simbolo
-		btw.write(depthmap[i].first, 8);  // lunghezza
+	// numero di bitstream e jump table
+	uint64_t total = 0;
+	btw.write(n, 8);
+	for(uint32_t s=0; s<n; ++s){
+		writers[s].flush();
+		total += writers[s].tell_index();
+		if(s+1 < n)
+			btw.write((uint32_t)writers[s].tell_index(), 32);
 	}
-	return btw;
+
+	// i bitstream iniziano a un byte intero: li copio di seguito
+	btw.reserve(total);
+	btw.sync();
+	uint8_t* out = btw.current();
+	for(uint32_t s=0; s<n; ++s){
+		memcpy(out, streams[s].data(), writers[s].tell_index());
+		out += writers[s].tell_index();
+	}
+	btw.advance(total*8);
+	stage.set_bytes(total);
+}
+
+void Huffman::append_block(ostream& output_file, uint64_t block_offset, const vector<uint8_t>& block){
+
+	BlockIndexEntry entry;
+	entry.uncompressed_offset = block_offset;
+	entry.bit_offset = _written*8;
+	entry.size = block.size();
+	_index.push_back(entry);
+
+	StageTimer stage(_timer, HUF_STAGE_WRITE, block.size());
+	output_file.write(reinterpret_cast<const char*>(block.data()), block.size());
+	_written += block.size();
+}
+
+unsigned Huffman::pipeline_tokens(uint64_t token_memory){
+	return budget_tokens(_memory_budget, (_tokens > 0) ? _tokens : 1, token_memory);
+}
+
+void Huffman::write_blocks(ostream& output_file, MappedFile& mapped, const uint8_t* in, uint64_t file_len, vector<BlockPlan>& plan, CodeVector& codes_map, bool parallel_encode){
+
+	// ogni blocco in volo tiene in memoria le pagine dell'input e l'output (due volte con piu' bitstream),
+	// un blocco con la sua tabella puo' avere codici piu' lunghi di quelli globali
+	uint32_t max_len = min(max(_max_code_len, (uint32_t)HUF_MAX_CODE_LEN_MIN), (uint32_t)HUF_MAX_CODE_LEN_MAX);
+	uint64_t out_dim = ((uint64_t)HUF_BLOCK_DIM*max_len)/8 + HUF_BLOCK_HEADER_DIM + 2 + 2*256;
+	uint64_t token_memory = HUF_BLOCK_DIM + ((_streams > 1) ? 2 : 1)*out_dim;
+
+	// al massimo tokens blocchi in volo: l'ultimo stadio e' in ordine, quindi quando viene letto
+	// il blocco k il blocco k-tokens e' gia' stato scritto e il suo buffer si puo' riusare
+	size_t tokens = pipeline_tokens(token_memory);
+	uint64_t block_budget = _memory_budget/tokens;
+	vector<PipelineBlock> ring(tokens);
+	size_t next = 0;
+	uint64_t num_blocks = 0;
+
+	parallel_pipeline(tokens,
+		// lettura: seriale, in ordine
+		make_filter<void, PipelineBlock*>(tbb::filter::serial_in_order, [&](flow_control& fc) -> PipelineBlock* {
+			if(next >= plan.size()){
+				fc.stop();
+				return NULL;
+			}
+			PipelineBlock* b = &ring[num_blocks++ % tokens];
+			b->plan = &plan[next++];
+			b->offset = b->plan->offset;
+			b->dim = b->plan->dim;
+			b->data = in + b->offset;
+
+			// tocco una pagina ogni 4KB: il disco viene letto qui, mentre gli altri blocchi vengono codificati
+			StageTimer stage(_timer, HUF_STAGE_READ, b->dim);
+			TraceSpan span(_trace, "read block", b->dim);
+			mapped.willneed(b->offset, b->dim);
+			uint8_t touch = 0;
+			for(uint64_t i=0; i<b->dim; i+=4096)
+				touch ^= b->data[i];
+			b->touch = touch;
+			return b;
+		}) &
+		// codifica: in parallelo (ParHuffman) o un blocco alla volta (SeqHuffman)
+		make_filter<PipelineBlock*, PipelineBlock*>(parallel_encode ? tbb::filter::parallel : tbb::filter::serial_in_order, [&](PipelineBlock* b) -> PipelineBlock* {
+			TraceSpan span(_trace, "encode block", b->dim);
+			encode_block_best(block_budget, b->data, b->dim, b->plan->histo, codes_map, b->out);
+			// l'istogramma del blocco non serve piu'
+			Histo().swap(b->plan->histo);
+			return b;
+		}) &
+		// scrittura: seriale, in ordine
+		make_filter<PipelineBlock*, void>(tbb::filter::serial_in_order, [&](PipelineBlock* b) {
+			TraceSpan span(_trace, "write block", b->out.size());
+			append_block(output_file, b->offset, b->out);
+			cerr << "\rWrite compressed file: " << ((100*(b->offset+b->dim))/file_len) << "%";
+		})
+	);
+}
+
+uint64_t Huffman::write_blocks_single_pass(istream& input, ostream& output_file, bool parallel_encode){
+
+	// come write_blocks(), ma ogni token ha il suo buffer di input: l'input viene letto una volta
+	// sola, in ordine e senza seek, quindi puo' anche non essere un file
+	uint32_t max_len = min(max(_max_code_len, (uint32_t)HUF_MAX_CODE_LEN_MIN), (uint32_t)HUF_MAX_CODE_LEN_MAX);
+	uint64_t out_dim = ((uint64_t)HUF_BLOCK_DIM*max_len)/8 + HUF_BLOCK_HEADER_DIM + 2 + 2*256;
+	size_t tokens = pipeline_tokens(HUF_BLOCK_DIM + ((_streams > 1) ? 2 : 1)*out_dim);
+	uint64_t block_budget = _memory_budget/tokens;
+	vector<PipelineBlock> ring(tokens);
+	uint64_t next = 0;
+	uint64_t num_blocks = 0;
+
+	parallel_pipeline(tokens,
+		// lettura: seriale, in ordine
+		make_filter<void, PipelineBlock*>(tbb::filter::serial_in_order, [&](flow_control& fc) -> PipelineBlock* {
+			PipelineBlock* b = &ring[num_blocks % tokens];
+			StageTimer stage(_timer, HUF_STAGE_READ);
+			TraceSpan span(_trace, "read block", HUF_BLOCK_DIM);
+			b->in.resize(HUF_BLOCK_DIM);
+			input.read(reinterpret_cast<char*>(b->in.data()), HUF_BLOCK_DIM);
+			b->dim = (uint64_t)input.gcount();
+			stage.set_bytes(b->dim);
+			if(b->dim == 0){
+				fc.stop();
+				return NULL;
+			}
+			num_blocks++;
+			b->offset = next;
+			b->data = b->in.data();
+			next += b->dim;
+			return b;
+		}) &
+		// codifica con la tabella del blocco: in parallelo (ParHuffman) o un blocco alla volta (SeqHuffman)
+		make_filter<PipelineBlock*, PipelineBlock*>(parallel_encode ? tbb::filter::parallel : tbb::filter::serial_in_order, [&](PipelineBlock* b) -> PipelineBlock* {
+			TraceSpan span(_trace, "encode block", b->dim);
+			encode_block_local(block_budget, b->data, b->dim, b->out);
+			return b;
+		}) &
+		// scrittura: seriale, in ordine
+		make_filter<PipelineBlock*, void>(tbb::filter::serial_in_order, [&](PipelineBlock* b) {
+			TraceSpan span(_trace, "write block", b->out.size());
+			append_block(output_file, b->offset, b->out);
+			cerr << "\rWrite compressed file: " << (b->offset+b->dim)/1000000 << " MB";
+		})
+	);
+
+	return next;
+}
+
+bool Huffman::compress_single_pass(string filename, bool parallel_encode){
+
+	init(filename);
+
+	// l'input viene solo letto in sequenza, non serve conoscerne la lunghezza
+	ifstream file_in(filename, ifstream::in|ifstream::binary);
+	if(!file_in){
+		cerr << "Error: cannot read " << filename << endl;
+		return false;
+	}
+	file_in.unsetf (ifstream::skipws);
+
+	ofstream output_file(_output_filename, fstream::out|fstream::binary);
+	cerr << "Output filename: " << _output_filename << endl;
+
+	bool ok = compress_stream(file_in, output_file, parallel_encode);
+
+	output_file.close();
+	file_in.close();
+	if(ok && output_file.fail()){
+		cerr << "Error: cannot write " << _output_filename << endl;
+		ok = false;
+	}
+	return ok;
+}
+
+bool Huffman::compress_stream(istream& input, ostream& output, bool parallel_encode){
+	// Utility
+	tick_count tt1, tt2;
+	tt1 = tick_count::now();
+
+	// nessuna tabella globale e lunghezza sconosciuta: la lunghezza finale e' nel footer
+	CodeVector no_codes;
+	BitWriter btw = write_header(no_codes, HUF_UNKNOWN_LENGTH);
+
+	btw.sync();
+	write_output(output, btw);
+	uint64_t file_len = write_blocks_single_pass(input, output, parallel_encode);
+	write_footer(btw, file_len);
+	btw.flush();
+	write_output(output, btw);
+	output.flush();
+	cerr << endl;
+
+	// la fine dell'input alza failbit, solo badbit e' un errore di lettura
+	bool ok = !input.bad() && !output.fail();
+	if(input.bad())
+		cerr << "Error: cannot read the input" << endl;
+	else if(output.fail())
+		cerr << "Error: cannot write the output" << endl;
+
+	tt2 = tick_count::now();
+	if(_timer)
+		_timer->add(HUF_STAGE_TOTAL, (tt2-tt1).seconds(), file_len);
+	cerr << "Total time for compression: " << (tt2-tt1).seconds() << " sec" << endl << endl;
+
+	return ok;
+}
+
+bool Huffman::decompress_stream(istream& input, ostream& output, bool parallel_decode){
+	// Utility
+	tick_count tt1, tt2;
+	tt1 = tick_count::now();
+
+	DepthMap depthmap;
+	uint64_t file_len;
+	uint32_t block_dim;
+	if(!read_stream_header(input, depthmap, file_len, block_dim)){
+		cerr << "Error: unknown format or corrupted header" << endl;
+		return false;
+	}
+	// un file BCP1 e' un unico bitstream senza blocchi, si decomprime solo da file
+	if(block_dim == 0){
+		cerr << "Error: BCP1 files cannot be decompressed from a stream" << endl;
+		return false;
+	}
+
+	HuffmanDecoder decoder(depthmap);
+	uint64_t decoded = decode_stream(input, output, decoder, block_dim, file_len, parallel_decode);
+	output.flush();
+	cerr << endl;
+
+	if(file_len == HUF_UNKNOWN_LENGTH)
+		cerr << "Error: truncated file, " << decoded << " bytes decoded, block index not found" << endl;
+	else if(decoded != file_len)
+		cerr << "Error: corrupted file, " << decoded << " bytes decoded out of " << file_len << endl;
+
+	tt2 = tick_count::now();
+	if(_timer)
+		_timer->add(HUF_STAGE_TOTAL, (tt2-tt1).seconds(), decoded);
+	cerr << "Total time for decompression: " << (tt2-tt1).seconds() << " sec" << endl << endl;
+
+	return decoded == file_len;
+}
+
+bool Huffman::read_stream_header(istream& input, DepthMap& depthmap, uint64_t& file_len, uint32_t& block_dim){
+
+	// magic number e lunghezza del nome del file
+	vector<uint8_t> buf(8);
+	if(!input.read(reinterpret_cast<char*>(buf.data()), 8))
+		return false;
+	BitReader btr(buf);
+	uint32_t magic_number = btr.read(32);
+	if(magic_number != HUF_MAGIC_NUMBER && magic_number != HUF_MAGIC_NUMBER_V1)
+		return false;
+	// un file BCP1 si decomprime solo da file, del suo header basta il magic number
+	if(magic_number == HUF_MAGIC_NUMBER_V1){
+		file_len = HUF_UNKNOWN_LENGTH;
+		block_dim = 0;
+		return true;
+	}
+	uint32_t fname_length = btr.read(32);
+	if(fname_length > HUF_HEADER_DIM)
+		return false;
+
+	// nome del file, lunghezza del file, dimensione dei blocchi e numero di simboli
+	buf.resize(8 + fname_length + 16);
+	if(!input.read(reinterpret_cast<char*>(buf.data()+8), fname_length + 16))
+		return false;
+	BitReader fields(buf.data()+buf.size()-4, 4);
+	uint32_t tot_symbols = fields.read(32);
+	if(tot_symbols > 256)
+		return false;
+
+	// coppie <simbolo, lunghezza_codice>, poi l'header si legge come quello di un file
+	buf.resize(buf.size() + 2*tot_symbols);
+	if(tot_symbols > 0 && !input.read(reinterpret_cast<char*>(buf.data()+buf.size()-2*tot_symbols), 2*tot_symbols))
+		return false;
+	FileHeader h;
+	if(!parse_header(buf.data(), buf.size(), h))
+		return false;
+	file_len = h.file_len;
+	block_dim = h.block_dim;
+	BitReader pairs(buf.data()+h.table_start, 2*(uint64_t)h.num_symbols);
+	read_code_lengths(pairs, h.num_symbols, depthmap);
+
+	return true;
+}
+
+uint64_t Huffman::decode_stream(istream& input, ostream& output, const HuffmanDecoder& decoder, uint32_t block_dim, uint64_t& file_len, bool parallel_decode){
+
+	// come write_blocks_single_pass(): al massimo tokens blocchi in memoria, l'ultimo stadio e' in ordine,
+	// ciascuno con il blocco compresso e quello decodificato
+	size_t tokens = pipeline_tokens(2*(uint64_t)block_dim + HUF_HEADER_DIM);
+	vector<PipelineBlock> ring(tokens);
+	uint64_t next = 0;
+	uint64_t num_blocks = 0;
+	uint64_t decoded = 0;
+	uint64_t index_len = HUF_UNKNOWN_LENGTH;
+	tbb::atomic<bool> failed;
+	failed = false;
+
+	parallel_pipeline(tokens,
+		// lettura: seriale, in ordine, un blocco alla volta seguendo gli header dei blocchi
+		make_filter<void, PipelineBlock*>(tbb::filter::serial_in_order, [&](flow_control& fc) -> PipelineBlock* {
+			PipelineBlock* b = &ring[num_blocks % tokens];
+			StageTimer stage(_timer, HUF_STAGE_READ);
+			TraceSpan span(_trace, "read block");
+			uint8_t raw[HUF_BLOCK_HEADER_DIM];
+			if(failed || !input.read(reinterpret_cast<char*>(raw), HUF_BLOCK_HEADER_DIM)){
+				failed = true;
+				fc.stop();
+				return NULL;
+			}
+			b->header = parse_block_header(raw);
+
+			// un blocco non puo' essere piu' lungo dei codici da 32 bit dei suoi simboli piu' le tabelle
+			uint64_t max_size = (b->header.type == HUF_BLOCK_END) ? (uint64_t)HUF_INDEX_TRAILER_DIM + HUF_INDEX_ENTRY_DIM*(num_blocks+1)
+				: 4*(uint64_t)b->header.dim + HUF_HEADER_DIM;
+			if(b->header.size > max_size || b->header.dim > block_dim){
+				failed = true;
+				fc.stop();
+				return NULL;
+			}
+			b->in.resize(b->header.size);
+			if(b->header.size > 0 && !input.read(reinterpret_cast<char*>(b->in.data()), b->header.size)){
+				failed = true;
+				fc.stop();
+				return NULL;
+			}
+
+			// il blocco di chiusura contiene l'indice con la lunghezza del file
+			if(b->header.type == HUF_BLOCK_END){
+				if(!parse_index(b->in.data(), b->in.size(), index_len))
+					failed = true;
+				fc.stop();
+				return NULL;
+			}
+
+			num_blocks++;
+			b->offset = next;
+			b->dim = b->header.dim;
+			next += b->dim;
+			stage.set_bytes(HUF_BLOCK_HEADER_DIM + b->header.size);
+			return b;
+		}) &
+		// decodifica: in parallelo (ParHuffman) o un blocco alla volta (SeqHuffman)
+		make_filter<PipelineBlock*, PipelineBlock*>(parallel_decode ? tbb::filter::parallel : tbb::filter::serial_in_order, [&](PipelineBlock* b) -> PipelineBlock* {
+			StageTimer stage(_timer, HUF_STAGE_DECODE, b->dim);
+			StageCounters counters(_counters, HUF_STAGE_DECODE, b->dim);
+			TraceSpan span(_trace, "decode block", b->dim);
+			b->out.resize(b->dim);
+			if(!decode_block(b->in.data(), b->header, decoder, b->out.data()))
+				b->out.clear();
+			return b;
+		}) &
+		// scrittura: seriale, in ordine, mi fermo al primo blocco corrotto
+		make_filter<PipelineBlock*, void>(tbb::filter::serial_in_order, [&](PipelineBlock* b) {
+			if(failed)
+				return;
+			if(b->out.size() != b->dim || decoded+b->dim > file_len){
+				cerr << endl << "Error: corrupted block at offset " << b->offset << endl;
+				failed = true;
+				return;
+			}
+			StageTimer stage(_timer, HUF_STAGE_WRITE, b->dim);
+			TraceSpan span(_trace, "write block", b->dim);
+			output.write(reinterpret_cast<const char*>(b->out.data()), b->dim);
+			decoded += b->dim;
+			cerr << "\rDecompression: " << decoded/1000000 << " MB";
+		})
+	);
+
+	// se l'header non la aveva, la lunghezza del file originale e' quella dell'indice
+	if(file_len == HUF_UNKNOWN_LENGTH)
+		file_len = index_len;
+	return decoded;
+}
+
+void Huffman::write_footer(BitWriter& btw, uint64_t file_len){
+
+	btw.align();
+	// blocco di chiusura: il suo contenuto e' l'indice
+	write_index(btw, _index, file_len);
+}
+
+void Huffman::write_output(ostream& output_file, BitWriter& btw){
+	StageTimer stage(_timer, HUF_STAGE_WRITE, btw.tell_index());
+	if(btw.tell_index() != 0)
+		output_file.write(reinterpret_cast<char*>(_file_out.data()), btw.tell_index());
+	_written += btw.tell_index();
+	btw.reset_index();
+}
+
+bool Huffman::read_index(ifstream& file_in, uint64_t compressed_len, uint64_t& file_len){
+
+	_index.clear();
+	if(compressed_len < HUF_INDEX_TRAILER_DIM)
+		return false;
+
+	// la chiusura dell'indice e' in fondo al file, mi dice quanti blocchi ci sono
+	read_file(file_in, compressed_len-HUF_INDEX_TRAILER_DIM, HUF_INDEX_TRAILER_DIM);
+	uint64_t len, num_blocks;
+	if(_file_in.size() != HUF_INDEX_TRAILER_DIM || !read_index_trailer(_file_in.data(), len, num_blocks))
+		return false;
+	if(num_blocks > (compressed_len-HUF_INDEX_TRAILER_DIM)/HUF_INDEX_ENTRY_DIM)
+		return false;
+
+	uint64_t index_dim = num_blocks*HUF_INDEX_ENTRY_DIM + HUF_INDEX_TRAILER_DIM;
+	read_file(file_in, compressed_len-index_dim, index_dim);
+	bool ok = parse_index(_file_in.data(), _file_in.size(), file_len);
+	_file_in.clear();
+
+	return ok;
+}
+
+bool Huffman::parse_index(const uint8_t* buf, uint64_t size, uint64_t& file_len){
+
+	_index.clear();
+	if(size < HUF_INDEX_TRAILER_DIM || (size-HUF_INDEX_TRAILER_DIM)%HUF_INDEX_ENTRY_DIM != 0)
+		return false;
+
+	uint64_t len, num_blocks;
+	if(!read_index_trailer(buf+size-HUF_INDEX_TRAILER_DIM, len, num_blocks) || num_blocks != (size-HUF_INDEX_TRAILER_DIM)/HUF_INDEX_ENTRY_DIM)
+		return false;
+
+	BitReader btr(buf, size);
+	_index.resize(num_blocks);
+	for(uint64_t i=0; i<num_blocks; ++i){
+		_index[i].uncompressed_offset = read_u64(btr);
+		_index[i].bit_offset = read_u64(btr);
+		_index[i].size = read_u64(btr);
+	}
+	file_len = len;
+
+	return true;
+}
+
+bool Huffman::check_index(uint64_t data_start, uint64_t compressed_len, uint64_t file_len, uint32_t block_dim){
+
+	uint64_t next_byte = data_start;
+	for(size_t i=0; i<_index.size(); ++i){
+		const BlockIndexEntry& e = _index[i];
+		// porzione del file originale: inizia dove finisce la precedente, al massimo block_dim byte
+		uint64_t out_end = (i+1 < _index.size()) ? _index[i+1].uncompressed_offset : file_len;
+		if((i == 0 && e.uncompressed_offset != 0) || out_end <= e.uncompressed_offset || out_end-e.uncompressed_offset > block_dim)
+			return false;
+		// blocco compresso: a un byte intero, dopo il precedente e dentro il file
+		uint64_t start = e.bit_offset/8;
+		if(e.bit_offset%8 != 0 || start < next_byte || start > compressed_len || e.size < HUF_BLOCK_HEADER_DIM || e.size > compressed_len-start)
+			return false;
+		next_byte = start + e.size;
+	}
+	return !_index.empty() || file_len == 0;
+}
+
+BlockHeader Huffman::parse_block_header(const uint8_t* buf){
+	BitReader btr(buf, HUF_BLOCK_HEADER_DIM);
+	BlockHeader bh;
+	bh.type = (uint8_t)btr.read(8);
+	bh.dim = btr.read(32);
+	bh.size = btr.read(32);
+	return bh;
+}
+
+bool Huffman::decode_block(const uint8_t* payload, const BlockHeader& bh, const HuffmanDecoder& decoder, uint8_t* out){
+	DecodeScratch scratch;
+	return decode_block(payload, bh, decoder, out, scratch);
+}
+
+bool Huffman::decode_block(const uint8_t* payload, const BlockHeader& bh, const HuffmanDecoder& decoder, uint8_t* out, DecodeScratch& scratch){
+
+	// blocco copiato: i byte originali, senza codici
+	if(bh.type == HUF_BLOCK_STORED){
+		if(bh.size != bh.dim)
+			return false;
+		if(bh.dim > 0)
+			memcpy(out, payload, bh.dim);
+		return true;
+	}
+
+	BitReader btr(payload, bh.size);
+	uint8_t type = bh.type & ~HUF_BLOCK_INTERLEAVED;
+	if(type != HUF_BLOCK_HUFFMAN && type != HUF_BLOCK_LOCAL)
+		return false;
+
+	// tabella del blocco, subito dopo l'header del blocco
+	if(type == HUF_BLOCK_LOCAL){
+		uint32_t num_symbols = btr.read(16);
+		if(num_symbols == 0 || num_symbols > 256 || (uint64_t)bh.size < 2+2*(uint64_t)num_symbols)
+			return false;
+		scratch.depthmap.clear();
+		read_code_lengths(btr, num_symbols, scratch.depthmap);
+		for(size_t i=0; i<scratch.depthmap.size(); ++i)
+			if(scratch.depthmap[i].first == 0 || scratch.depthmap[i].first > HUF_MAX_CODE_LEN_MAX)
+				return false;
+		scratch.local.assign(scratch.depthmap, scratch.codes);
+	}
+
+	// altrimenti tabella globale, letta dall'header del file
+	const HuffmanDecoder& dec = (type == HUF_BLOCK_LOCAL) ? scratch.local : decoder;
+	if(dec.empty())
+		return false;
+
+	if(bh.type & HUF_BLOCK_INTERLEAVED){
+		uint64_t start = btr.tell_bit()/8;
+		return decode_streams(payload+start, bh.size-start, dec, out, bh.dim);
+	}
+	return dec.decode_run(btr, (uint64_t)bh.size*8, out, bh.dim) == bh.dim;
+}
+
+bool Huffman::decode_streams(const uint8_t* buf, uint64_t size, const HuffmanDecoder& decoder, uint8_t* out, uint64_t dim){
+
+	if(size < 1)
+		return false;
+	uint32_t n = buf[0];
+	if(n < 2 || n > HUF_MAX_STREAMS || size < 1+4*(uint64_t)(n-1))
+		return false;
+
+	// jump table: l'ultimo bitstream arriva fino alla fine del blocco
+	BitReader btr(buf+1, 4*(n-1));
+	uint64_t start = 1+4*(uint64_t)(n-1);
+	BitReader streams[HUF_MAX_STREAMS];
+	for(uint32_t s=0; s<n; ++s){
+		uint64_t len = (s+1 < n) ? btr.read(32) : size-start;
+		if(len > size-start)
+			return false;
+		streams[s] = BitReader(buf+start, len);
+		start += len;
+	}
+
+	return decoder.decode_interleaved(streams, n, out, dim) == dim;
 }
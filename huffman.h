@@ -9,6 +9,13 @@
 #include <fstream>
 #include <map>
 #include "bitwriter.h"
+#include "mapped_file.h"
+#include "huffman_decoder.h"
+#include "huffman_histo.h"
+#include "memory_budget.h"
+#include "huffman_timer.h"
+#include "huffman_trace.h"
+#include "huffman_counters.h"
 
 //!  CodeVector is a struct used to store information about huffman coding.
 /*!
@@ -33,9 +40,62 @@ struct CodeVector{
 			codes_vector.push_back(std::pair<uint32_t,uint32_t>(NULL,NULL));
 			presence_vector.push_back(false);
 		}*/
-		fill(codes_vector.begin(), codes_vector.end(), std::pair<uint32_t,uint32_t>(NULL,NULL));
-		fill(presence_vector.begin(), presence_vector.end(), false);
+		codes_vector.assign(256, std::pair<uint32_t,uint32_t>(0,0));
+		presence_vector.assign(256, false);
 	}
+
+	//! Max length function
+	/*!
+	\return The length of the longest code, used to size the output buffers.
+	*/
+	std::uint32_t max_len() const {
+		std::uint32_t len = 0;
+		for(int i=0; i<256; ++i)
+			if(presence_vector[i] && codes_vector[i].second > len)
+				len = codes_vector[i].second;
+		return len;
+	}
+};
+
+
+//!  BlockPlan is a block chosen by the block-split optimizer of compress_chunked().
+/*!
+BlockPlan holds the position of a block in the original file and its histogram, from which the encoder
+picks the table of the block without counting the bytes again. The segments analysed by the optimizer are
+BlockPlan too.
+*/
+struct BlockPlan{
+	//! Position of the block in the original file.
+	std::uint64_t offset;
+	//! Number of bytes of the block.
+	std::uint64_t dim;
+	//! The histogram of the block.
+	Histo histo;
+};
+
+
+//!  PipelineBlock is a block travelling through the compression pipeline.
+/*!
+PipelineBlock holds the position of a block in the input and its encoded bytes, the output
+buffers are reused by the next blocks.
+*/
+struct PipelineBlock{
+	//! Position of the block in the original file.
+	std::uint64_t offset;
+	//! Number of bytes of the block.
+	std::uint64_t dim;
+	//! The bytes of the block.
+	const std::uint8_t* data;
+	//! A byte read from every page, so that the read stage is not optimized away.
+	std::uint8_t touch;
+	//! The input buffer, used when the input is read from a stream.
+	std::vector<std::uint8_t> in;
+	//! The encoded block (the decoded block when a compressed stream is decoded).
+	std::vector<std::uint8_t> out;
+	//! The block header, used when a compressed stream is decoded.
+	BlockHeader header;
+	//! The plan of the block, used by compress_chunked().
+	BlockPlan* plan;
 };
 
 
@@ -60,6 +120,30 @@ public:
 	std::string _original_filename;
 	//! the name the file will have after the operation (compression or decompression)
 	std::string _output_filename;
+	//! The block index of a BCP2 file, filled while writing the blocks or read from the footer
+	std::vector<BlockIndexEntry> _index;
+	//! The number of bytes of the compressed file already written on the hard drive
+	std::uint64_t _written;
+	//! The maximum number of blocks in flight in the compression pipeline
+	unsigned _tokens;
+	//! The maximum code length used by create_code_map
+	std::uint32_t _max_code_len;
+	//! The number of interleaved bitstreams of every block (1, 2, 4 or 8), 1 writes a single bitstream
+	std::uint32_t _streams;
+	//! The memory the buffers can use (see memory_budget()), it sizes the macrochunks, the microchunks and the pipelines
+	std::uint64_t _memory_budget;
+	//! The timer of the stages of the current file, NULL if the stages are not timed (see StageTimer)
+	HuffmanTimer* _timer;
+	//! The trace of the spans of the threads, NULL if tracing is off (see TraceSpan)
+	HuffmanTrace* _trace;
+	//! The hardware counters of the stages of the current file, NULL if they are not read (see StageCounters)
+	HuffmanCounters* _counters;
+
+	//! Constructor
+	/*!
+	An empty constructor, it initializes the inner variables.
+	*/
+	Huffman() : _file_length(0), _written(0), _tokens(HUF_PIPELINE_TOKENS), _max_code_len(HUF_MAX_CODE_LEN), _streams(1), _memory_budget(memory_budget(0)), _timer(NULL), _trace(NULL), _counters(NULL) {}
 
 	//! Initialization
 	/*!
@@ -72,47 +156,494 @@ public:
 	/*!
 	This function reads from the given file and write the whole file content into the _file_in vector.
 	\param filename_in The input filename.
+	\return false if the file cannot be opened.
 	*/
-	void read_file(std::string filename_in);
+	bool read_file(std::string filename_in);
 
 	//! Read from file
 	/*!
 	This function is used to read only a single chunk of the input file given the chunk's length and the
 	beginning position. the content is still used to fill the _file_in vector.
+	If the file ends before chunk_dim bytes are read, _file_in only contains the bytes actually read.
 	\param file_in The input file represented as an ifstream.
 	\param beg_pos The stream's position from which the function will start to read.
 	\param chunk_dim The desired chunk's length, how many bytes the function will read.
 	*/
 	void read_file(std::ifstream& file_in, std::uint64_t beg_pos, std::uint64_t chunk_dim);
 
+	//! Open input function
+	/*!
+	This function maps the input file in memory, so that the compression reads it without copying it.
+	If the file cannot be mapped it falls back to reading the whole file into the _file_in vector.
+	\param mapped The mapping, it must outlive the use of the file content.
+	\param filename The input filename.
+	\param in The output first byte of the file content.
+	\param file_len The output file length.
+	\return false if the file cannot be opened.
+	*/
+	bool open_input(MappedFile& mapped, std::string filename, const std::uint8_t*& in, std::uint64_t& file_len);
+
 
 	//! Write header function
     /*!
 	  This function writes the header in a compressed file. We used a custom header structured as follows:
-		- 4 bytes: a magic number to identify the fomrat: BCP1 (hex: 42 43 50 01) 
+		- 4 bytes: a magic number to identify the fomrat: BCP2 (hex: 42 43 50 02) 
 		- 4 bytes: length of the original filename (m characters)
 		- The m characters (1 byte each) of the original filename
-		- 4 bytes: total number of symbols in the header (n symbols)
+		- 8 bytes: length of the original file, i.e. the number of symbols encoded in the file
+		  (HUF_UNKNOWN_LENGTH in single-pass mode, the length is then read from the footer)
+		- 4 bytes: the maximum uncompressed length of the blocks (every block header holds its own)
+		- 4 bytes: total number of symbols in the header (n symbols, 0 in single-pass mode)
 		- n pairs, each one relative to a symbol:
 			-- 1 byte: the symbol itself
 			-- 1 byte: the length of its canonical code
+	  The header is followed by the blocks (see write_block()) and by the footer (see write_footer()).
+	  BCP1 files have neither the length of the original file nor the blocks length: magic number, filename
+	  (missing in the first BCP1 files) and pairs, followed by a single bitstream.
       \param codes_map The codes map object.
+	  \param file_len The length of the original file.
 	  \return Returns the bit writer object used to write the header, it will be used to write all the rest of the file.
     */
-	BitWriter write_header(CodeVector& codes_map);
+	BitWriter write_header(CodeVector& codes_map, std::uint64_t file_len);
+
+	//! Read header function
+    /*!
+	  This function reads the header of a compressed file (see write_header() for the layout), checks
+	  the magic number and sets _output_filename to the original filename. Both BCP2 and BCP1 are accepted.
+	  The compressed file is closed and the program exits if the magic number is wrong.
+      \param file_in The compressed file represented as an ifstream.
+	  \param depthmap The output depthmap, it will contain the <length, symbol> pairs sorted as in the header.
+	  \param file_len The output length of the original file, HUF_UNKNOWN_LENGTH if the header does not have it.
+	  \param block_dim The output length of the blocks, 0 for a BCP1 file (a single bitstream).
+	  \return The offset of the first byte of compressed data, right after the header.
+    */
+	std::uint64_t read_header(std::ifstream& file_in, DepthMap& depthmap, std::uint64_t& file_len, std::uint32_t& block_dim);
+
+	//! Default output filename function
+    /*!
+	  This function sets _output_filename, if the header did not give one (a file compressed from stdin),
+	  to the compressed file's name without its extension, or with ".out" appended if it has none.
+      \param filename The compressed file's name.
+    */
+	void default_output_filename(const std::string& filename);
+
+	//! Encode block function
+    /*!
+	  This function encodes block_dim bytes of the original file as a block in a private buffer, it can be
+	  called concurrently on different blocks.
+	  A block starts on a byte boundary with a header structured as follows:
+		- 1 byte: the block type (HUF_BLOCK_HUFFMAN)
+		- 4 bytes: the number of original bytes encoded in the block
+		- 4 bytes: the number of compressed bytes following the header
+	  The encoded bits follow, padded to a whole byte, so every block can be decoded on its own.
+	  If the encoded block turns out not shorter than the original bytes it is replaced by a HUF_BLOCK_STORED block.
+      \param block_budget The memory available to encode the block, the share of the budget of one token.
+	  \param data The bytes to encode.
+	  \param block_dim The number of bytes to encode, at most HUF_BLOCK_DIM.
+	  \param codes_map The codes map object.
+	  \param out The output buffer, it is resized to the block length.
+    */
+	void encode_block(std::uint64_t block_budget, const std::uint8_t* data, std::uint64_t block_dim, CodeVector& codes_map, std::vector<std::uint8_t>& out);
+
+	//! Encode local block function
+    /*!
+	  This function encodes a block with its own codes, built from the histogram of the block, as a
+	  HUF_BLOCK_LOCAL block: the block header is followed by a compact table
+		- 2 bytes: the number of symbols of the block (n symbols)
+		- n pairs (1 byte symbol, 1 byte code length), as in the file header
+	  and by the encoded bits. It can be called concurrently on different blocks.
+	  The histogram of the block is counted and the block is written by encode_block_best(), without the
+	  table of the file header: as a HUF_BLOCK_LOCAL block or, if it does not compress, as a HUF_BLOCK_STORED block.
+      \param block_budget The memory available to encode the block, the share of the budget of one token.
+	  \param data The bytes to encode.
+	  \param block_dim The number of bytes to encode, at most HUF_BLOCK_DIM.
+	  \param out The output buffer, it is resized to the block length.
+    */
+	void encode_block_local(std::uint64_t block_budget, const std::uint8_t* data, std::uint64_t block_dim, std::vector<std::uint8_t>& out);
+
+	//! Encode local block function
+    /*!
+	  As encode_block_local() above, with the codes of the block already built. If the encoded block turns out
+	  not shorter than the original bytes it is replaced by a HUF_BLOCK_STORED block.
+      \param block_budget The memory available to encode the block, the share of the budget of one token.
+	  \param data The bytes to encode.
+	  \param block_dim The number of bytes to encode, at most HUF_BLOCK_DIM.
+	  \param block_codes The codes of the block.
+	  \param out The output buffer, it is resized to the block length.
+    */
+	void encode_block_local(std::uint64_t block_budget, const std::uint8_t* data, std::uint64_t block_dim, CodeVector& block_codes, std::vector<std::uint8_t>& out);
+
+	//! Encode best block function
+    /*!
+	  This function writes a block with the table that makes it shortest, computed exactly from its histogram
+	  before encoding: the codes of the file header (a HUF_BLOCK_HUFFMAN block, no table to write), the codes
+	  of the block (a HUF_BLOCK_LOCAL block, its table costs 2 bytes plus 2 bytes per symbol) or none
+	  (a HUF_BLOCK_STORED block, when neither is shorter than the original bytes).
+	  It can be called concurrently on different blocks.
+      \param block_budget The memory available to encode the block, the share of the budget of one token.
+	  \param data The bytes to encode.
+	  \param block_dim The number of bytes to encode, at most HUF_BLOCK_DIM.
+	  \param histo The histogram of the block.
+	  \param codes_map The codes of the file header, empty if the header has no table.
+	  \param out The output buffer, it is resized to the block length.
+    */
+	void encode_block_best(std::uint64_t block_budget, const std::uint8_t* data, std::uint64_t block_dim, Histo& histo, CodeVector& codes_map, std::vector<std::uint8_t>& out);
+
+	//! Block type function
+    /*!
+	  This function picks the type of a block as encode_block_best() does, without encoding it.
+      \param block_dim The number of bytes of the block.
+	  \param histo The histogram of the block.
+	  \param codes_map The codes of the file header, empty if the header has no table.
+	  \param block_codes The output codes of the block, used by a HUF_BLOCK_LOCAL block.
+	  eturn HUF_BLOCK_HUFFMAN, HUF_BLOCK_LOCAL or HUF_BLOCK_STORED.
+    */
+	std::uint8_t block_type(std::uint64_t block_dim, Histo& histo, CodeVector& codes_map, CodeVector& block_codes);
+
+	//! Global table used function
+    /*!
+	  This function tells whether some block of the plan is encoded with the codes of the file header:
+	  when none is (every block stored, for example) the header is written without the table.
+      \param plan The blocks of the file, with their histograms.
+	  \param codes_map The codes of the file header.
+	  eturn true if at least one block is a HUF_BLOCK_HUFFMAN block.
+    */
+	bool global_table_used(std::vector<BlockPlan>& plan, CodeVector& codes_map);
+
+	//! Encode stored block function
+    /*!
+	  This function copies a block that does not compress as a HUF_BLOCK_STORED block: the block header,
+	  with the compressed size equal to the original one, is followed by the original bytes.
+	  \param data The bytes of the block.
+	  \param block_dim The number of bytes, at most HUF_BLOCK_DIM.
+	  \param out The output buffer, it is resized to the block length.
+    */
+	void encode_block_stored(const std::uint8_t* data, std::uint64_t block_dim, std::vector<std::uint8_t>& out);
+
+	//! Payload dim function
+    /*!
+	  \param bits The number of encoded bits of a block.
+	  \return The bytes taken by the encoded bits in the block: padded to a whole byte, or with _streams bitstreams
+	  the jump table and a padding byte for every bitstream (an upper bound).
+    */
+	std::uint64_t payload_dim(std::uint64_t bits);
+
+	//! Write block payload function
+    /*!
+	  This function writes the encoded bits of a block: a single bitstream with write_chunks_compressed(),
+	  or _streams interleaved bitstreams with write_streams().
+      \param block_budget The memory available to encode the block, the share of the budget of one token.
+	  \param data The bytes to encode.
+	  \param block_dim The number of bytes to encode.
+	  \param codes_map The codes map object.
+	  \param btw The bit writer of the block, on a byte boundary.
+    */
+	void write_block_payload(std::uint64_t block_budget, const std::uint8_t* data, std::uint64_t block_dim, CodeVector& codes_map, BitWriter& btw);
+
+	//! Write streams function
+    /*!
+	  This function spreads the symbols of a block round-robin over _streams bitstreams: symbol i goes to
+	  bitstream i % _streams. The decoder can then decode one symbol from every bitstream at the same time,
+	  instead of following a single chain of bit positions. The bitstreams are written as
+		- 1 byte: the number of bitstreams (n)
+		- (n-1) x 4 bytes: the length in bytes of the first n-1 bitstreams (jump table)
+		- the n bitstreams, each one padded to a whole byte
+      \param data The bytes to encode.
+	  \param block_dim The number of bytes to encode.
+	  \param codes_map The codes map object.
+	  \param btw The bit writer of the block, on a byte boundary.
+    */
+	void write_streams(const std::uint8_t* data, std::uint64_t block_dim, CodeVector& codes_map, BitWriter& btw);
+
+	//! Append block function
+    /*!
+	  This function writes an encoded block on the output file and adds it to the index.
+	  The blocks must be appended in order.
+      \param output_file The output file.
+	  \param block_offset The position of the block in the original file.
+	  \param block The encoded block.
+    */
+	void append_block(std::ostream& output_file, std::uint64_t block_offset, const std::vector<std::uint8_t>& block);
+
+	//! Pipeline tokens function
+    /*!
+	  This function gives the number of tokens of a pipeline: _tokens, lowered until the buffers of the
+	  blocks in flight fit in _memory_budget.
+      \param token_memory The memory used by one block in flight.
+	  \return The number of tokens, at least 1.
+    */
+	unsigned pipeline_tokens(std::uint64_t token_memory);
+
+	//! Plan blocks function
+    /*!
+	  The block-split optimizer: this function chooses where the blocks of a chunk of the input end, so that
+	  a part of the file with different statistics (a binary inside a log, the members of a tar) gets a block
+	  and a table of its own. The chunk is cut into segments of HUF_SEGMENT_DIM bytes (longer on files of more
+	  than HUF_MAX_SEGMENTS segments), their histograms are counted by segment_histos(), then inside every
+	  window of HUF_BLOCK_DIM bytes the two adjacent blocks whose merge saves the most bits are merged, as long
+	  as one shared table costs less than two: the cost of a block is its header, its table and the entropy
+	  of its bytes, never more than the block stored.
+	  The histograms of the segments are the whole histogram pass of compress_chunked(), the only extra work
+	  is the merge, a few operations on 256 counters per segment. They are counted for groups of windows of
+	  about HUF_PLAN_SEGMENTS segments and freed once the group is planned, only the histograms of the blocks are kept.
+      \param in The input file content.
+	  \param offset The position of the chunk in the input.
+	  \param len The chunk length.
+	  \param file_len The input file length, it sets the length of the segments.
+	  \param histo The histogram of the file, the counts of the chunk are added to it.
+	  \param plan The blocks of the file, the blocks of the chunk are appended in order.
+    */
+	void plan_blocks(const std::uint8_t* in, std::uint64_t offset, std::uint64_t len, std::uint64_t file_len, Histo& histo, std::vector<BlockPlan>& plan);
+
+	//! Write blocks function
+    /*!
+	  This function compresses the whole input with a tbb::parallel_pipeline of three stages: the blocks
+	  are read in order, encoded (in parallel if requested) and written in order, so reading and writing
+	  overlap with the encoding. At most _tokens blocks are in flight, fewer if their buffers do not fit in _memory_budget.
+	  The blocks are the ones chosen by plan_blocks(), every one is written by encode_block_best().
+	  The header must already be on the output file, the footer is left to the caller.
+      \param output_file The output file.
+	  \param mapped The mapping of the input, used to prefetch the blocks.
+	  \param in The input file content.
+	  \param file_len The input file length.
+	  \param plan The blocks, with their histograms.
+	  \param codes_map The codes map object.
+	  \param parallel_encode true to encode more blocks at the same time.
+    */
+	void write_blocks(std::ostream& output_file, MappedFile& mapped, const std::uint8_t* in, std::uint64_t file_len, std::vector<BlockPlan>& plan, CodeVector& codes_map, bool parallel_encode);
+
+	//! Write blocks single pass function
+    /*!
+	  This function compresses the input in a single pass, with the same pipeline of write_blocks(): every block
+	  is read from the stream into the buffer of its token and encoded with its own codes (see encode_block_local()).
+	  The stream is read in order and never rewound, so it does not need to be seekable.
+      \param input The input stream.
+	  \param output_file The output file.
+	  \param parallel_encode true to encode more blocks at the same time.
+	  \return The number of bytes read from the input.
+    */
+	std::uint64_t write_blocks_single_pass(std::istream& input, std::ostream& output_file, bool parallel_encode);
+
+	//! Single pass compress function
+    /*!
+	  This function compresses the given file reading it only once: there is no histogram pass, every
+	  block carries its own table and the header has no global table.
+      \param filename The current file's name.
+	  \param parallel_encode true to encode more blocks at the same time.
+	  \return false if the file cannot be read or the compressed file cannot be written.
+    */
+	bool compress_single_pass(std::string filename, bool parallel_encode);
+
+	//! Stream compress function
+    /*!
+	  This function compresses a stream into a stream in a single pass (see compress_single_pass()), the input
+	  is read in order and the output is written in order, neither of them is ever rewound: they can be pipes
+	  (stdin and stdout). The header keeps _original_filename, empty for stdin.
+      \param input The input stream.
+	  \param output The output stream.
+	  \param parallel_encode true to encode more blocks at the same time.
+	  \return false if reading the input or writing the output fails.
+    */
+	bool compress_stream(std::istream& input, std::ostream& output, bool parallel_encode);
+
+	//! Stream decompress function
+    /*!
+	  This function decompresses a BCP2 stream into a stream, reading the blocks one after the other
+	  without seeking: the block index at the end of the file is not needed. At most _tokens blocks are
+	  in memory at the same time.
+      \param input The compressed stream.
+	  \param output The output stream.
+	  \param parallel_decode true to decode more blocks at the same time.
+	  \return false if the header is not valid or the stream is truncated or corrupted.
+    */
+	bool decompress_stream(std::istream& input, std::ostream& output, bool parallel_decode);
+
+	//! Read stream header function
+    /*!
+	  This function reads the header of a compressed stream, as read_header() does, reading exactly the
+	  bytes of the header.
+      \param input The compressed stream.
+	  \param depthmap The output <length, symbol> pairs, an empty depthmap if there is no global table.
+	  \param file_len The output length of the original file (HUF_UNKNOWN_LENGTH if unknown).
+	  \param block_dim The output length of the blocks, 0 for a BCP1 file.
+	  \return false if the stream is not a compressed file.
+    */
+	bool read_stream_header(std::istream& input, DepthMap& depthmap, std::uint64_t& file_len, std::uint32_t& block_dim);
+
+	//! Decode stream function
+    /*!
+	  This function decodes the blocks of a compressed stream with a tbb::parallel_pipeline: the blocks are
+	  read in order, decoded (in parallel if requested) and written in order. It stops at the HUF_BLOCK_END
+	  block, whose index gives the length of the original file if the header did not have it.
+      \param input The compressed stream, after the header.
+	  \param output The output stream.
+	  \param decoder The decoder built from the header.
+	  \param block_dim The length of the blocks read from the header.
+	  \param file_len The length of the original file, updated from the index if it is HUF_UNKNOWN_LENGTH.
+	  \param parallel_decode true to decode more blocks at the same time.
+	  \return The number of decoded bytes.
+    */
+	std::uint64_t decode_stream(std::istream& input, std::ostream& output, const HuffmanDecoder& decoder, std::uint32_t block_dim, std::uint64_t& file_len, bool parallel_decode);
+
+	//! Write footer function
+    /*!
+	  This function closes the blocks with a HUF_BLOCK_END block containing the index:
+		- one entry for each block, 8 bytes each field (see BlockIndexEntry):
+			-- uncompressed offset
+			-- compressed offset in bits
+			-- compressed size in bytes
+		- 8 bytes: the length of the original file
+		- 8 bytes: the number of blocks
+		- 4 bytes: a magic number to identify the index: BCPX (hex: 42 43 50 58)
+	  The index ends the file, so it can be read starting from the end of the file.
+      \param btw The bit writer returned by write_header().
+	  \param file_len The length of the original file.
+    */
+	void write_footer(BitWriter& btw, std::uint64_t file_len);
+
+	//! Write output function
+    /*!
+	  This function writes on the output file the bytes completed by the bit writer and empties the buffer.
+      \param output_file The output file.
+	  \param btw The bit writer.
+    */
+	void write_output(std::ostream& output_file, BitWriter& btw);
+
+	//! Read index function
+    /*!
+	  This function reads the block index from the footer of a BCP2 file into _index.
+      \param file_in The compressed file represented as an ifstream.
+	  \param compressed_len The length of the compressed file.
+	  \param file_len The output length of the original file.
+	  \return false if the footer is missing or corrupted.
+    */
+	bool read_index(std::ifstream& file_in, std::uint64_t compressed_len, std::uint64_t& file_len);
+
+	//! Parse index function
+    /*!
+	  This function parses the content of the HUF_BLOCK_END block (the index and its trailer) into _index.
+      \param buf The content of the block.
+	  \param size The length of the content.
+	  \param file_len The output length of the original file.
+	  \return false if the index is corrupted.
+    */
+	bool parse_index(const std::uint8_t* buf, std::uint64_t size, std::uint64_t& file_len);
+
+	//! Check index function
+    /*!
+	  This function checks _index before it is used to read and decode the blocks: the blocks must follow each
+	  other after the header and inside the compressed file, and cover the original file in order with at most
+	  block_dim bytes each.
+      \param data_start The offset of the first block, right after the header.
+	  \param compressed_len The length of the compressed file.
+	  \param file_len The length of the original file read from the index.
+	  \param block_dim The length of the blocks read from the header.
+	  \return false if the index is corrupted.
+    */
+	bool check_index(std::uint64_t data_start, std::uint64_t compressed_len, std::uint64_t file_len, std::uint32_t block_dim);
+
+	//! Parse block header function
+    /*!
+	  \param buf The HUF_BLOCK_HEADER_DIM bytes of a block header.
+	  \return The block header.
+    */
+	static BlockHeader parse_block_header(const std::uint8_t* buf);
+
+	//! Parse header function
+    /*!
+	  This function parses the header of a compressed file (see write_header() for the layout). The code
+	  lengths of the table must be between 1 and HUF_MAX_CODE_LEN_MAX and form a prefix code, so a corrupted
+	  header never reaches the decoder; for BCP1 the check also tells the two layouts apart.
+	  \param buf The beginning of the compressed file.
+	  \param size The number of bytes of buf.
+	  \param h The output header, h.magic is set even if the header is not valid.
+	  \return false if the magic number is unknown, the table is not valid or the header is longer than buf.
+    */
+	static bool parse_header(const std::uint8_t* buf, std::uint64_t size, FileHeader& h);
+
+	//! Decode block function
+    /*!
+	  This function decodes a whole block, with the codes of the file header or with the table of the block,
+	  from a single bitstream or from interleaved bitstreams (HUF_BLOCK_INTERLEAVED); the bytes of a
+	  HUF_BLOCK_STORED block are copied.
+	  It can be called concurrently on different blocks.
+	  \param payload The bytes following the block header.
+	  \param bh The block header, bh.size bytes must be readable from payload.
+	  \param decoder The decoder built from the file header (empty if the header has no table).
+	  \param out The output buffer, bh.dim bytes long.
+	  \return false if the block type is unknown or the block is corrupted.
+    */
+	static bool decode_block(const std::uint8_t* payload, const BlockHeader& bh, const HuffmanDecoder& decoder, std::uint8_t* out);
+
+	//! Decode block function
+    /*!
+	  As decode_block() above, the table of a HUF_BLOCK_LOCAL block is read into scratch, which
+	  can be reused for the next blocks.
+	  \param payload The bytes following the block header.
+	  \param bh The block header, bh.size bytes must be readable from payload.
+	  \param decoder The decoder built from the file header (empty if the header has no table).
+	  \param out The output buffer, bh.dim bytes long.
+	  \param scratch The memory for the table of the block.
+	  \return false if the block type is unknown or the block is corrupted.
+    */
+	static bool decode_block(const std::uint8_t* payload, const BlockHeader& bh, const HuffmanDecoder& decoder, std::uint8_t* out, DecodeScratch& scratch);
+
+	//! Decode streams function
+    /*!
+	  This function decodes the interleaved bitstreams of a block, see write_streams().
+	  \param buf The number of bitstreams, followed by the jump table and the bitstreams.
+	  \param size The number of bytes from buf to the end of the block.
+	  \param decoder The decoder of the block.
+	  \param out The output buffer.
+	  \param dim The number of symbols to decode.
+	  \return false if the bitstreams are corrupted.
+    */
+	static bool decode_streams(const std::uint8_t* buf, std::uint64_t size, const HuffmanDecoder& decoder, std::uint8_t* out, std::uint64_t dim);
 
 
 
 	//! Write to file
 	/*!
-	This function transfer the whole content of the _file_out vector to a file on the hard drive.
-	\param filename The output filename.
+	This function transfer the whole content of the _file_out vector to _output_filename on the hard drive.
 	*/
-	void write_on_file(std::string filename);
+	void write_on_file();
 
 
 	// Virtual functions
 
+	//! Create block code map function
+	/*!
+	This function assigns the canonical codes to the symbols of a block given its histogram, it is used
+	by the single-pass mode and it can be called concurrently on different blocks.
+	This function is implemented in different ways in the subclasses (parallel or sequential).
+	\param histo The histogram of the block.
+	\return The codes map of the block.
+	*/
+	virtual CodeVector create_block_code_map(Histo& histo) = 0;
+
+	//! Segment histograms function
+	/*!
+	This function counts the histogram of every segment of plan_blocks() and adds them all to the histogram of the file.
+	This function is implemented in different ways in the subclasses (parallel or sequential).
+	\param in The input file content.
+	\param segments The segments, their histograms are filled.
+	\param histo The histogram of the file.
+	*/
+	virtual void segment_histos(const std::uint8_t* in, std::vector<BlockPlan>& segments, Histo& histo) = 0;
+
+	//! Write compressed chunks function
+    /*!
+	  This function write a compressed chunk of the original file into the output vector.
+	  NOTE: this function does not write anything on the hard drive.
+	  This function is implemented in different ways in the subclasses (parallel or sequential).
+      \param block_budget The memory available to encode the block, the share of the budget of one token.
+	  \param data The current file chunk to compress.
+	  \param macrochunk_dim A uint64_t containing the length of the current file chunk to compress.
+	  \param codes_map The codes map computed from the histogram.
+	  \param btw A reference to the bit writer object used to write to the output vector.
+    */
+	virtual void write_chunks_compressed(std::uint64_t block_budget, const std::uint8_t* data, std::uint64_t macrochunk_dim, CodeVector codes_map, BitWriter& btw) = 0;
+
 	//! Chunked decompression
 	/*!
 	This function fill the _file_out vector with the decompressed version of the _file_in vector.
@@ -120,8 +651,9 @@ public:
 	one chunk at a time, in order to prevent memory issues during the operations.
 	This function is implemented in different ways in the subclasses (parallel or sequential).
 	\param filename The input filename.
+	\return false if the file is truncated or corrupted.
 	*/
-	virtual void decompress_chunked(std::string filename) = 0;
+	virtual bool decompress_chunked(std::string filename) = 0;
 
 	//! Chunked compression
 	/*!
@@ -130,8 +662,9 @@ public:
 	one chunk at a time, in order to prevent memory issues during the operations.
 	This function is implemented in different ways in the subclasses (parallel or sequential).
 	\param filename The input filename.
+	\return false if the file cannot be read or the compressed file cannot be written.
 	*/
-	virtual void compress_chunked(std::string filename) = 0;
+	virtual bool compress_chunked(std::string filename) = 0;
 };
 
 #endif /*HUFFMAN_H*/
\ No newline at end of file
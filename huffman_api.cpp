@@ -0,0 +1,378 @@
+#include "huffman_api.h"
+#include "huffman.h"
+#include "bitreader.h"
+#include "huffman_histo.h"
+#include "huffman_format.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+namespace huf {
+
+// scrive i bit direttamente nel buffer del chiamante, MSB first come BitWriter: se lo spazio finisce
+// smette di scrivere e lo segnala con overflow(), il buffer non viene mai superato
+class SpanBitWriter {
+	uint8_t* _p;
+	uint8_t* _end;
+	uint64_t _buf;
+	uint32_t _count;
+	bool _overflow;
+
+	void store(uint8_t b){
+		if(_p < _end)
+			*_p++ = b;
+		else
+			_overflow = true;
+	}
+
+public:
+	SpanBitWriter(uint8_t* p, size_t size) : _p(p), _end(p+size), _buf(0), _count(0), _overflow(false) {}
+
+	void write(uint32_t u, uint32_t n){
+		_buf = (_buf<<n) | (u & (uint32_t)((1ull<<n)-1));
+		_count += n;
+		if(_count >= 32){
+			_count -= 32;
+			uint32_t w = (uint32_t)(_buf >> _count);
+			if(_end-_p >= 4){
+				_p[0] = (uint8_t)(w>>24);
+				_p[1] = (uint8_t)(w>>16);
+				_p[2] = (uint8_t)(w>>8);
+				_p[3] = (uint8_t)w;
+				_p += 4;
+			} else
+				_overflow = true;
+		}
+	}
+
+	// svuota l'accumulatore, l'ultimo byte viene completato con degli zeri
+	void flush(){
+		while(_count >= 8){
+			_count -= 8;
+			store((uint8_t)(_buf >> _count));
+		}
+		if(_count > 0)
+			store((uint8_t)(_buf << (8-_count)));
+		_count = 0;
+	}
+
+	// byte liberi dopo current(), dopo un flush()
+	uint64_t room() const {
+		return (uint64_t)(_end-_p);
+	}
+
+	// salta n byte scritti direttamente a partire da current(), dopo un flush()
+	void advance(uint64_t n){
+		_p += n;
+	}
+
+	uint8_t* current() const {
+		return _p;
+	}
+
+	bool overflow() const {
+		return _overflow;
+	}
+};
+
+static uint32_t clamp_code_len(uint32_t max_code_len){
+	return min(max(max_code_len, (uint32_t)HUF_MAX_CODE_LEN_MIN), (uint32_t)HUF_MAX_CODE_LEN_MAX);
+}
+
+// header di un file BCP1/BCP2 letto da un buffer, con Huffman::parse_header()
+static HufStatus read_buffer_header(Span<const uint8_t> in, FileHeader& h){
+	const uint8_t* p = in.data();
+	uint64_t n = in.size();
+	h.magic = 0;
+	if(p == NULL || !Huffman::parse_header(p, n, h))
+		return (h.magic == HUF_MAGIC_NUMBER || h.magic == HUF_MAGIC_NUMBER_V1) ? HUF_ERROR_CORRUPTED : HUF_ERROR_FORMAT;
+
+	// file scritto in una sola passata: la lunghezza e' nella chiusura dell'indice, in fondo al buffer
+	if(h.magic == HUF_MAGIC_NUMBER && h.file_len == HUF_UNKNOWN_LENGTH){
+		if(n-h.data_start < HUF_INDEX_TRAILER_DIM)
+			return HUF_ERROR_CORRUPTED;
+		uint64_t num_blocks;
+		if(!read_index_trailer(p+n-HUF_INDEX_TRAILER_DIM, h.file_len, num_blocks) || h.file_len == HUF_UNKNOWN_LENGTH)
+			return HUF_ERROR_CORRUPTED;
+	}
+	return HUF_OK;
+}
+
+// tabella globale: coppie <simbolo, lunghezza_codice> salvate come <lunghezza_codice, simbolo>
+static bool read_global_table(const uint8_t* p, const FileHeader& h, DepthMap& depthmap){
+	depthmap.clear();
+	for(uint32_t i=0; i<h.num_symbols; ++i){
+		uint32_t len = p[h.table_start+2*i+1];
+		if(len == 0 || len > HUF_MAX_CODE_LEN_MAX)
+			return false;
+		depthmap.push_back(DepthMapElement(len, p[h.table_start+2*i]));
+	}
+	return true;
+}
+
+// BCP1: la lunghezza non e' nell'header, conto i codici interi del bitstream fino alla fine del buffer
+static uint64_t count_v1_symbols(const HuffmanDecoder& decoder, const uint8_t* data, uint64_t size){
+	uint8_t chunk[4096];
+	BitReader btr(data, size);
+	uint64_t n = 0;
+	uint64_t got;
+	do{
+		got = decoder.decode_run(btr, size*8, chunk, sizeof(chunk));
+		n += got;
+	} while(got == sizeof(chunk));
+	return n;
+}
+
+// comprime in out: un blocco HUF_BLOCK_LOCAL ogni HUF_BLOCK_DIM byte, HUF_BLOCK_STORED se codificato
+// non sarebbe piu' corto. Con out grande almeno compress_bound() lo spazio non finisce mai
+static HufStatus encode(HuffmanContext& ctx, const uint8_t* in, uint64_t len, Span<const char> name, Span<uint8_t> out, size_t& written){
+
+	SpanBitWriter btw(out.data(), out.size());
+
+	// header senza tabella globale
+	write_file_header(btw, name.data(), (uint32_t)name.size(), len, 0);
+
+	ctx.index.clear();
+	for(uint64_t offset=0; offset<len && !btw.overflow(); offset+=HUF_BLOCK_DIM){
+		const uint8_t* data = in+offset;
+		uint64_t block_dim = min((uint64_t)HUF_BLOCK_DIM, len-offset);
+
+		// istogramma e codici del blocco, tutto nella memoria del contesto
+		uint64_t histo[256] = {0};
+		histo_accumulate(data, block_dim, histo);
+		uint32_t lengths[256];
+		create_huffman_tree(histo, ctx.tree);
+		code_lengths(ctx.tree, lengths);
+		limit_code_lengths(lengths, histo, clamp_code_len(ctx.max_code_len));
+		bucket_depthmap(lengths, ctx.scratch.depthmap);
+		ctx.scratch.codes.clear();
+		canonical_codes(ctx.scratch.depthmap, ctx.scratch.codes);
+
+		uint32_t codes[256];
+		for(size_t i=0; i<ctx.scratch.codes.size(); ++i)
+			codes[ctx.scratch.codes[i].symbol] = ctx.scratch.codes[i].code;
+
+		// header del blocco, la dimensione compressa viene scritta alla fine
+		// (prima scarico i byte rimasti nell'accumulatore, current() deve essere l'inizio del blocco)
+		btw.flush();
+		uint8_t* block = btw.current();
+
+		// lunghezza esatta del blocco codificato: se non e' piu' corto dell'originale copio i byte
+		if(2 + 2*(uint64_t)ctx.scratch.depthmap.size() + (histo_cost(histo, lengths)+7)/8 >= block_dim){
+			if(btw.room() < HUF_BLOCK_HEADER_DIM + block_dim)
+				return HUF_ERROR_DST_TOO_SMALL;
+			btw.advance(store_block(block, data, (uint32_t)block_dim));
+		}
+		else {
+			write_block_header(btw, HUF_BLOCK_LOCAL, (uint32_t)block_dim, 0);
+			write_local_table(btw, ctx.scratch.depthmap);
+			for(uint64_t i=0; i<block_dim; ++i)
+				btw.write(codes[data[i]], lengths[data[i]]);
+			btw.flush();
+			if(btw.overflow())
+				break;
+			set_block_size(block, (uint32_t)(btw.current() - block - HUF_BLOCK_HEADER_DIM));
+		}
+
+		BlockIndexEntry entry;
+		entry.uncompressed_offset = offset;
+		entry.bit_offset = (uint64_t)(block-out.data())*8;
+		entry.size = (uint64_t)(btw.current()-block);
+		ctx.index.push_back(entry);
+	}
+
+	// blocco di chiusura con l'indice, come Huffman::write_footer()
+	write_index(btw, ctx.index, len);
+	btw.flush();
+	if(btw.overflow())
+		return HUF_ERROR_DST_TOO_SMALL;
+
+	written = (size_t)(btw.current()-out.data());
+	return HUF_OK;
+}
+
+size_t compress_bound(size_t n){
+	uint64_t blocks = ((uint64_t)n + HUF_BLOCK_DIM-1)/HUF_BLOCK_DIM;
+
+	// un blocco che non si riduce viene copiato, quindi nessun blocco e' piu' lungo dei suoi byte
+	// originali piu' l'header, qualunque sia la lunghezza massima dei codici:
+	// header del file, i blocchi, infine il blocco di chiusura con l'indice
+	uint64_t bound = 24;
+	bound += blocks*HUF_BLOCK_HEADER_DIM + (uint64_t)n;
+	bound += HUF_BLOCK_HEADER_DIM + blocks*HUF_INDEX_ENTRY_DIM + HUF_INDEX_TRAILER_DIM;
+	return (size_t)bound;
+}
+
+HufStatus compress(HuffmanContext& ctx, Span<const uint8_t> in, Span<uint8_t> out, size_t& written, Span<const char> name){
+
+	written = 0;
+	if((in.data() == NULL && in.size() > 0) || (name.data() == NULL && name.size() > 0) || name.size() > 0xFFFFFFFFu)
+		return HUF_ERROR_PARAMETER;
+	if(out.data() == NULL && out.size() > 0)
+		return HUF_ERROR_PARAMETER;
+
+	// si scrive direttamente in out, se e' piu' piccolo di compress_bound() la compressione
+	// si ferma appena lo spazio finisce
+	return encode(ctx, in.data(), in.size(), name, out, written);
+}
+
+HufStatus decompress(HuffmanContext& ctx, Span<const uint8_t> in, Span<uint8_t> out, size_t& written){
+
+	written = 0;
+	FileHeader h;
+	HufStatus status = read_buffer_header(in, h);
+	if(status != HUF_OK)
+		return status;
+
+	const uint8_t* p = in.data();
+	if(!read_global_table(p, h, ctx.scratch.depthmap))
+		return HUF_ERROR_CORRUPTED;
+	ctx.global.assign(ctx.scratch.depthmap, ctx.scratch.codes);
+
+	// BCP1: un solo bitstream fino alla fine del buffer, tutti i suoi codici interi devono stare in out
+	if(h.magic == HUF_MAGIC_NUMBER_V1){
+		if(ctx.global.empty())
+			return HUF_OK;
+		if(out.data() == NULL && out.size() > 0)
+			return HUF_ERROR_PARAMETER;
+		uint64_t bits = (in.size()-h.data_start)*8;
+		BitReader btr(p+h.data_start, in.size()-h.data_start);
+		uint64_t n = ctx.global.decode_run(btr, bits, out.data(), out.size());
+		uint8_t extra;
+		if(n == out.size() && ctx.global.decode_run(btr, bits, &extra, 1) != 0)
+			return HUF_ERROR_DST_TOO_SMALL;
+		written = (size_t)n;
+		return HUF_OK;
+	}
+
+	if(h.file_len > out.size())
+		return HUF_ERROR_DST_TOO_SMALL;
+	if(h.file_len > 0 && out.data() == NULL)
+		return HUF_ERROR_PARAMETER;
+
+	// BCP2: i blocchi uno dopo l'altro fino al blocco di chiusura
+	uint64_t pos = h.data_start;
+	uint64_t decoded = 0;
+	while(true){
+		if(in.size()-pos < HUF_BLOCK_HEADER_DIM)
+			return HUF_ERROR_CORRUPTED;
+		BlockHeader bh = Huffman::parse_block_header(p+pos);
+		pos += HUF_BLOCK_HEADER_DIM;
+		if(bh.size > in.size()-pos)
+			return HUF_ERROR_CORRUPTED;
+		if(bh.type == HUF_BLOCK_END)
+			break;
+		if(bh.dim > h.file_len-decoded)
+			return HUF_ERROR_CORRUPTED;
+		if(!Huffman::decode_block(p+pos, bh, ctx.global, out.data()+decoded, ctx.scratch))
+			return HUF_ERROR_CORRUPTED;
+		decoded += bh.dim;
+		pos += bh.size;
+	}
+	if(decoded != h.file_len)
+		return HUF_ERROR_CORRUPTED;
+
+	written = (size_t)decoded;
+	return HUF_OK;
+}
+
+HufStatus decompressed_size(Span<const uint8_t> in, uint64_t& size){
+	FileHeader h;
+	HufStatus status = read_buffer_header(in, h);
+	if(status != HUF_OK)
+		return status;
+
+	// BCP1: la lunghezza si conosce solo contando i codici del bitstream
+	if(h.magic == HUF_MAGIC_NUMBER_V1){
+		DepthMap depthmap;
+		if(!read_global_table(in.data(), h, depthmap))
+			return HUF_ERROR_CORRUPTED;
+		size = 0;
+		if(!depthmap.empty())
+			size = count_v1_symbols(HuffmanDecoder(depthmap), in.data()+h.data_start, in.size()-h.data_start);
+		return HUF_OK;
+	}
+	size = h.file_len;
+	return HUF_OK;
+}
+
+}
+
+
+// interfaccia C: il contesto opaco contiene quello C++, nessuna eccezione deve uscire da queste funzioni
+struct HufContext{
+	huf::HuffmanContext ctx;
+};
+
+extern "C" {
+
+HufContext* huf_create_context(void){
+	return new (nothrow) HufContext();
+}
+
+void huf_free_context(HufContext* ctx){
+	delete ctx;
+}
+
+HufStatus huf_set_max_code_len(HufContext* ctx, unsigned int max_code_len){
+	if(ctx == NULL || max_code_len < HUF_MAX_CODE_LEN_MIN || max_code_len > HUF_MAX_CODE_LEN_MAX)
+		return HUF_ERROR_PARAMETER;
+	ctx->ctx.max_code_len = max_code_len;
+	return HUF_OK;
+}
+
+size_t huf_compress_bound(size_t src_size){
+	return huf::compress_bound(src_size);
+}
+
+HufStatus huf_compress(HufContext* ctx, const void* src, size_t src_size, void* dst, size_t dst_capacity, size_t* dst_size){
+	if(ctx == NULL || dst_size == NULL)
+		return HUF_ERROR_PARAMETER;
+	try {
+		return huf::compress(ctx->ctx, huf::Span<const uint8_t>(static_cast<const uint8_t*>(src), src_size),
+			huf::Span<uint8_t>(static_cast<uint8_t*>(dst), dst_capacity), *dst_size);
+	} catch(const bad_alloc&) {
+		*dst_size = 0;
+		return HUF_ERROR_MEMORY;
+	}
+}
+
+HufStatus huf_decompress(HufContext* ctx, const void* src, size_t src_size, void* dst, size_t dst_capacity, size_t* dst_size){
+	if(ctx == NULL || dst_size == NULL)
+		return HUF_ERROR_PARAMETER;
+	try {
+		return huf::decompress(ctx->ctx, huf::Span<const uint8_t>(static_cast<const uint8_t*>(src), src_size),
+			huf::Span<uint8_t>(static_cast<uint8_t*>(dst), dst_capacity), *dst_size);
+	} catch(const bad_alloc&) {
+		*dst_size = 0;
+		return HUF_ERROR_MEMORY;
+	}
+}
+
+HufStatus huf_decompressed_size(const void* src, size_t src_size, uint64_t* size){
+	if(size == NULL)
+		return HUF_ERROR_PARAMETER;
+	// un buffer BCP1 va decodificato per contarne i simboli, il decoder alloca le sue tabelle
+	try {
+		return huf::decompressed_size(huf::Span<const uint8_t>(static_cast<const uint8_t*>(src), src_size), *size);
+	} catch(const bad_alloc&) {
+		*size = 0;
+		return HUF_ERROR_MEMORY;
+	}
+}
+
+const char* huf_status_string(HufStatus status){
+	switch(status){
+		case HUF_OK: return "ok";
+		case HUF_ERROR_DST_TOO_SMALL: return "output buffer too small";
+		case HUF_ERROR_FORMAT: return "unknown format";
+		case HUF_ERROR_CORRUPTED: return "corrupted input";
+		case HUF_ERROR_PARAMETER: return "invalid parameter";
+		case HUF_ERROR_MEMORY: return "out of memory";
+	}
+	return "unknown status";
+}
+
+}
@@ -0,0 +1,145 @@
+#ifndef HUFFMAN_API_H
+#define HUFFMAN_API_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "huffman_utils.h"
+#include "huffman_tree.h"
+#include "huffman_decoder.h"
+#include "huffman_c.h"
+
+//! In-memory compressor.
+/*!
+The functions of this namespace compress and decompress buffers owned by the caller: no file is opened,
+no Huffman object is created and no global state is used, all the memory they need is in a HuffmanContext.
+They are reentrant, different threads can run them at the same time, each one with its own context.
+The compressed buffers are BCP2 files: every HUF_BLOCK_DIM bytes of input become a HUF_BLOCK_LOCAL block
+with its own table (a HUF_BLOCK_STORED copy if it does not compress), followed by the HUF_BLOCK_END index, so the command line program can decompress them
+and decompress() accepts the files it writes.
+*/
+namespace huf {
+
+//! Span class
+/*!
+A view of a buffer owned by the caller: a pointer and a length, nothing is copied or freed.
+*/
+template<typename T>
+class Span {
+	//! The first element.
+	T* _data;
+	//! The number of elements.
+	std::size_t _size;
+
+public:
+	//! Constructor
+	/*!
+	An empty span.
+	*/
+	Span() : _data(NULL), _size(0) {}
+
+	//! Constructor
+	/*!
+	\param data The first element.
+	\param size The number of elements.
+	*/
+	Span(T* data, std::size_t size) : _data(data), _size(size) {}
+
+	//! Constructor
+	/*!
+	A view of the whole content of a vector, valid until the vector is resized.
+	\param v The vector.
+	*/
+	template<typename U>
+	Span(std::vector<U>& v) : _data(v.data()), _size(v.size()) {}
+
+	//! Constructor
+	/*!
+	A read-only view of the whole content of a vector.
+	\param v The vector.
+	*/
+	template<typename U>
+	Span(const std::vector<U>& v) : _data(v.data()), _size(v.size()) {}
+
+	//! \return The first element.
+	T* data() const { return _data; }
+	//! \return The number of elements.
+	std::size_t size() const { return _size; }
+	//! \return true if the span has no elements.
+	bool empty() const { return _size == 0; }
+};
+
+
+//! HuffmanContext class
+/*!
+The scratch memory of compress() and decompress(). The vectors keep their memory between calls, so
+once a context has been used the following calls do not allocate (unless the input needs bigger tables).
+A context must not be used by two threads at the same time.
+*/
+class HuffmanContext {
+public:
+	//! The maximum code length used by compress(), clamped to HUF_MAX_CODE_LEN_MIN..HUF_MAX_CODE_LEN_MAX.
+	std::uint32_t max_code_len;
+	//! The huffman tree of the block being compressed.
+	HuffmanTree tree;
+	//! The index of the blocks written by compress().
+	std::vector<BlockIndexEntry> index;
+	//! The decoder of the table in the header of the file.
+	HuffmanDecoder global;
+	//! The memory for the tables of the blocks.
+	DecodeScratch scratch;
+
+	//! Constructor
+	/*!
+	A context with the default maximum code length.
+	*/
+	HuffmanContext() : max_code_len(HUF_MAX_CODE_LEN) {}
+};
+
+
+//! Compress bound function
+/*!
+The bound does not depend on the maximum code length: a block that does not compress is stored.
+\param n The size of the input.
+\return The size of the compressed data in the worst case, without the original filename.
+*/
+std::size_t compress_bound(std::size_t n);
+
+//! Compress function
+/*!
+Compresses a buffer. The data is encoded directly into out without allocating memory: with
+out.size() >= compress_bound(in.size()) + name.size() it always fits, otherwise the compression stops
+as soon as out is full.
+\param ctx The context.
+\param in The data to compress.
+\param out The output buffer.
+\param written The output size of the compressed data.
+\param name The original filename stored in the header, as the command line program does (none by default).
+\return HUF_OK, HUF_ERROR_DST_TOO_SMALL or HUF_ERROR_PARAMETER.
+*/
+HufStatus compress(HuffmanContext& ctx, Span<const std::uint8_t> in, Span<std::uint8_t> out, std::size_t& written, Span<const char> name = Span<const char>());
+
+//! Decompress function
+/*!
+Decompresses a BCP1 or BCP2 buffer, the output must be at least decompressed_size() bytes.
+\param ctx The context.
+\param in The compressed data.
+\param out The output buffer.
+\param written The output size of the decompressed data.
+\return HUF_OK, HUF_ERROR_DST_TOO_SMALL, HUF_ERROR_FORMAT or HUF_ERROR_CORRUPTED.
+*/
+HufStatus decompress(HuffmanContext& ctx, Span<const std::uint8_t> in, Span<std::uint8_t> out, std::size_t& written);
+
+//! Decompressed size function
+/*!
+Reads the size of the original data from the header, or from the index of a file compressed in a single pass.
+A BCP1 header has no size: the whole codes of its bitstream are counted, which costs a decoding of the buffer.
+\param in The compressed data.
+\param size The output size of the original data.
+\return HUF_OK, HUF_ERROR_FORMAT or HUF_ERROR_CORRUPTED.
+*/
+HufStatus decompressed_size(Span<const std::uint8_t> in, std::uint64_t& size);
+
+}
+
+#endif /*HUFFMAN_API_H*/
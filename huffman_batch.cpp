@@ -0,0 +1,173 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include "huffman_batch.h"
+#include "mapped_file.h"
+#include "seq_huffman.h"
+#include "par_huffman.h"
+#include "tbb/tick_count.h"
+
+using namespace std;
+using namespace tbb;
+
+// i file piu' corti prima, a parita' di lunghezza l'ordine della riga di comando
+static bool batch_file_compare(const BatchFile& first, const BatchFile& second){
+	return (first.size < second.size);
+}
+
+// stesso nome di output di Huffman::init()
+static string batch_output_filename(const string& filename){
+	string output_filename = filename;
+	if(output_filename.size() >= 4)
+		output_filename.replace(output_filename.size()-4, 4, ".bcp");
+	else
+		output_filename += ".bcp";
+	return output_filename;
+}
+
+HuffmanBatch::HuffmanBatch() : _memory_budget(memory_budget(0)), _max_code_len(HUF_MAX_CODE_LEN), _parallel(false), _trace(NULL), _next(0), _in_use(0), _running(0) {
+	_max_jobs = (unsigned)task_scheduler_init::default_num_threads();
+	_failed = 0;
+	_compressed = 0;
+}
+
+uint64_t HuffmanBatch::compress(const vector<string>& filenames){
+
+	tick_count t1 = tick_count::now();
+
+	// lunghezza di ogni file e memoria che serve per comprimerlo: l'input mappato e il buffer di output
+	_files.clear();
+	uint64_t total = 0;
+	for(size_t i=0; i<filenames.size(); ++i){
+		ifstream file_in(filenames[i], ifstream::in|ifstream::binary|fstream::ate);
+		BatchFile file;
+		file.name = filenames[i];
+		file.size = file_in.good() ? (uint64_t)file_in.tellg() : 0;
+		file.memory = file.size + huf::compress_bound((size_t)file.size) + file.name.size();
+		_files.push_back(file);
+		total += file.size;
+	}
+	stable_sort(_files.begin(), _files.end(), batch_file_compare);
+
+	_next = 0;
+	_in_use = 0;
+	_running = 0;
+	_failed = 0;
+	_compressed = 0;
+	if(_max_jobs == 0)
+		_max_jobs = 1;
+
+	cerr << "Batch compression of " << _files.size() << " files, " << _max_jobs << " at a time, memory budget "
+		<< _memory_budget/1000000 << " MB" << endl;
+
+	dispatch();
+	_group.wait();
+
+	tick_count t2 = tick_count::now();
+	double seconds = (t2-t1).seconds();
+	cerr << "Compressed " << _files.size()-_failed << " files: " << total/1000000 << " MB -> " << _compressed/1000000 << " MB in "
+		<< seconds << " sec (" << ((seconds > 0) ? (total/1000000)/seconds : 0) << " MB/s)" << endl;
+	if(_failed > 0)
+		cerr << "Error: " << _failed << " files could not be compressed" << endl;
+
+	return _failed;
+}
+
+void HuffmanBatch::dispatch(){
+	spin_mutex::scoped_lock lock(_mutex);
+
+	// parto sempre se non c'e' niente in volo: un file piu' grande del budget viene compresso da solo
+	while(_next < _files.size() && _running < _max_jobs &&
+		(_running == 0 || _in_use + _files[_next].memory <= _memory_budget)){
+		const BatchFile& file = _files[_next++];
+		_in_use += min(file.memory, _memory_budget);
+		_running++;
+		_group.run([this, &file]{ run(file); });
+
+		// finche' un file oltre il budget e' in volo non ne parte nessun altro
+		if(file.memory >= _memory_budget)
+			break;
+	}
+}
+
+void HuffmanBatch::run(const BatchFile& file){
+
+	bool ok = false;
+	try {
+		TraceSpan span(_trace, "batch file", file.size);
+		if(file.memory < _memory_budget){
+			ok = compress_file(_workers.local(), file);
+		} else if(_parallel){
+			// troppo grande per tenerlo tutto in memoria: il motore a chunk lo legge un pezzo alla volta
+			ParHuffman par_huff;
+			par_huff._max_code_len = _max_code_len;
+			par_huff._memory_budget = _memory_budget;
+			par_huff._trace = _trace;
+			ok = par_huff.compress_chunked(file.name);
+		} else {
+			SeqHuffman seq_huff;
+			seq_huff._max_code_len = _max_code_len;
+			seq_huff._memory_budget = _memory_budget;
+			seq_huff._trace = _trace;
+			ok = seq_huff.compress_chunked(file.name);
+		}
+		if(ok && file.memory >= _memory_budget){
+			ifstream output_file(batch_output_filename(file.name), ifstream::in|ifstream::binary|fstream::ate);
+			streamoff compressed_len = output_file ? (streamoff)output_file.tellg() : -1;
+			if(compressed_len >= 0)
+				_compressed += (uint64_t)compressed_len;
+			else
+				ok = false;
+		}
+	} catch(const bad_alloc&) {
+		cerr << "Error: out of memory compressing " << file.name << endl;
+	}
+	if(!ok)
+		_failed++;
+
+	{
+		spin_mutex::scoped_lock lock(_mutex);
+		_in_use -= min(file.memory, _memory_budget);
+		_running--;
+	}
+	dispatch();
+}
+
+bool HuffmanBatch::compress_file(BatchWorker& worker, const BatchFile& file){
+
+	MappedFile mapped;
+	if(!mapped.open(file.name) || mapped.size() != file.size){
+		cerr << "Error: cannot read " << file.name << endl;
+		return false;
+	}
+
+	// il buffer di output e' quello contato in file.memory
+	worker.ctx.max_code_len = _max_code_len;
+	worker.out.resize(huf::compress_bound((size_t)file.size) + file.name.size());
+
+	size_t written;
+	HufStatus status = huf::compress(worker.ctx, huf::Span<const uint8_t>(mapped.data(), (size_t)mapped.size()), worker.out, written,
+		huf::Span<const char>(file.name.data(), file.name.size()));
+	mapped.close();
+
+	bool ok = (status == HUF_OK);
+	if(!ok)
+		cerr << "Error: cannot compress " << file.name << ", " << huf_status_string(status) << endl;
+	else {
+		string output_filename = batch_output_filename(file.name);
+		ofstream output_file(output_filename, fstream::out|fstream::binary);
+		output_file.write(reinterpret_cast<const char*>(worker.out.data()), written);
+		output_file.close();
+		if(!output_file){
+			cerr << "Error: cannot write " << output_filename << endl;
+			ok = false;
+		}
+	}
+
+	// la memoria del file torna al budget quando finisce: il buffer non deve restare al thread
+	vector<uint8_t>().swap(worker.out);
+
+	if(ok)
+		_compressed += written;
+	return ok;
+}
@@ -0,0 +1,125 @@
+#ifndef HUFFMAN_BATCH_H
+#define HUFFMAN_BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tbb/tbb.h"
+#include "huffman_api.h"
+#include "memory_budget.h"
+#include "huffman_trace.h"
+
+//! BatchWorker struct
+/*!
+The memory of a thread of the batch: the context of the in-memory compressor and the output buffer.
+The context is reused by all the files compressed by the thread. The output buffer is counted in the
+budget only while its file is in flight (BatchFile::memory), so it is freed when the file is written.
+*/
+struct BatchWorker{
+	//! The context used by huf::compress().
+	huf::HuffmanContext ctx;
+	//! The compressed file, written on the hard drive when the file is done.
+	std::vector<std::uint8_t> out;
+};
+
+
+//! BatchFile struct
+/*!
+A file of the batch with the memory it needs to be compressed.
+*/
+struct BatchFile{
+	//! The input filename.
+	std::string name;
+	//! The length of the file.
+	std::uint64_t size;
+	//! The memory reserved from the budget while the file is compressed: the mapped input and the output buffer.
+	std::uint64_t memory;
+};
+
+
+//! HuffmanBatch class, compression of many files at the same time.
+/*!
+This class compresses a list of files as tasks of a single tbb::task_group, so many small files share
+the cores instead of running one after the other, each one too small to use them all.
+  - The files are sorted by length and started from the smallest, to lower the mean latency.
+  - A file is started only if the memory it needs fits in the budget with the files already running,
+    and at most _max_jobs files run at the same time. A file that alone needs more than the whole budget
+    is compressed alone by the chunked engine (SeqHuffman or ParHuffman), which reads it a chunk at a time.
+  - Nothing waits for memory: every finished file starts the next ones, so the threads of the scheduler
+    are never blocked.
+  - Every thread compresses with its own BatchWorker, reused across files.
+The compressed files are the same BCP2 files written with -s: one table per block.
+*/
+class HuffmanBatch {
+
+public:
+	//! The memory that the files in flight can use, in bytes.
+	std::uint64_t _memory_budget;
+	//! The maximum number of files compressed at the same time, by default the number of threads of the scheduler.
+	unsigned _max_jobs;
+	//! The maximum code length.
+	std::uint32_t _max_code_len;
+	//! true if the files bigger than the budget are compressed by ParHuffman.
+	bool _parallel;
+	//! The trace of the files, NULL if tracing is off.
+	HuffmanTrace* _trace;
+
+	//! The files sorted by length, the next one to start is _files[_next].
+	std::vector<BatchFile> _files;
+	//! The index of the next file to start.
+	std::size_t _next;
+	//! The memory reserved by the files in flight.
+	std::uint64_t _in_use;
+	//! The number of files in flight.
+	unsigned _running;
+	//! Protects _next, _in_use and _running.
+	tbb::spin_mutex _mutex;
+	//! The tasks of the files.
+	tbb::task_group _group;
+	//! The memory of every thread.
+	tbb::enumerable_thread_specific<BatchWorker> _workers;
+	//! The number of files that could not be compressed.
+	tbb::atomic<std::uint64_t> _failed;
+	//! The total length of the compressed files.
+	tbb::atomic<std::uint64_t> _compressed;
+
+	//! Constructor
+	/*!
+	An empty constructor, it initializes the inner variables. The budget is the one of memory_budget() until it is set.
+	*/
+	HuffmanBatch();
+
+	//! Compress function
+	/*!
+	Compresses all the files, every file is written next to the original with the .bcp extension
+	as compress_chunked() does. It returns when all the files are done.
+	\param filenames The input filenames.
+	\return The number of files that could not be compressed.
+	*/
+	std::uint64_t compress(const std::vector<std::string>& filenames);
+
+	//! Dispatch function
+	/*!
+	Starts the next files while they fit in the budget, or the next file anyway if nothing is running.
+	Called once at the beginning and then by every finished file.
+	*/
+	void dispatch();
+
+	//! Run function
+	/*!
+	The task of a file: compresses it, gives its memory back to the budget and starts the next files.
+	\param file The file to compress.
+	*/
+	void run(const BatchFile& file);
+
+	//! Compress file function
+	/*!
+	Compresses a whole file in memory with the buffers of the thread and writes the result.
+	\param worker The memory of the thread.
+	\param file The file to compress.
+	\return false if the file cannot be read or compressed, or the output cannot be written.
+	*/
+	bool compress_file(BatchWorker& worker, const BatchFile& file);
+};
+
+#endif /*HUFFMAN_BATCH_H*/
@@ -0,0 +1,77 @@
+#ifndef HUFFMAN_C_H
+#define HUFFMAN_C_H
+
+/*
+C interface of the in-memory compressor (see huffman_api.h).
+The compressed buffers are BCP2 files, the same format written by the command line program.
+Every function can be called from any thread, a context must be used by one thread at a time.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+// HUF_DLL_EXPORTS quando si compila la dll, HUF_DLL quando la si usa
+#if defined(_WIN32) && defined(HUF_DLL_EXPORTS)
+#define HUF_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(HUF_DLL)
+#define HUF_API __declspec(dllimport)
+#else
+#define HUF_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Status codes returned by the library functions.
+typedef enum HufStatus {
+	//! Success.
+	HUF_OK = 0,
+	//! The output buffer is too small.
+	HUF_ERROR_DST_TOO_SMALL = 1,
+	//! The input is not a BCP1/BCP2 buffer.
+	HUF_ERROR_FORMAT = 2,
+	//! The input is truncated or corrupted.
+	HUF_ERROR_CORRUPTED = 3,
+	//! A parameter is not valid (null pointer, out of range value).
+	HUF_ERROR_PARAMETER = 4,
+	//! Out of memory.
+	HUF_ERROR_MEMORY = 5
+} HufStatus;
+
+//! Opaque compression/decompression context, holds all the scratch memory.
+typedef struct HufContext HufContext;
+
+//! Creates a context, NULL if out of memory.
+HUF_API HufContext* huf_create_context(void);
+
+//! Frees a context created by huf_create_context(), NULL is ignored.
+HUF_API void huf_free_context(HufContext* ctx);
+
+//! Sets the maximum code length used by huf_compress() (8-32, default 11).
+HUF_API HufStatus huf_set_max_code_len(HufContext* ctx, unsigned int max_code_len);
+
+//! Size of an output buffer big enough to compress src_size bytes, with any maximum code length.
+HUF_API size_t huf_compress_bound(size_t src_size);
+
+//! Compresses src into dst, *dst_size is set to the compressed size.
+/*!
+The data is encoded directly into dst: with dst_capacity >= huf_compress_bound(src_size) it always fits,
+otherwise HUF_ERROR_DST_TOO_SMALL is returned as soon as dst is full.
+*/
+HUF_API HufStatus huf_compress(HufContext* ctx, const void* src, size_t src_size, void* dst, size_t dst_capacity, size_t* dst_size);
+
+//! Decompresses src into dst, *dst_size is set to the decompressed size.
+HUF_API HufStatus huf_decompress(HufContext* ctx, const void* src, size_t src_size, void* dst, size_t dst_capacity, size_t* dst_size);
+
+//! Reads the decompressed size of a compressed buffer into *size.
+HUF_API HufStatus huf_decompressed_size(const void* src, size_t src_size, uint64_t* size);
+
+//! Describes a status code.
+HUF_API const char* huf_status_string(HufStatus status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*HUFFMAN_C_H*/
@@ -0,0 +1,378 @@
+#ifndef HUFFMAN_COUNTERS_H
+#define HUFFMAN_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include "tbb/tbb.h"
+#include "tbb/enumerable_thread_specific.h"
+#include "huffman_timer.h"
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+//! Hardware counters read by HuffmanCounters.
+enum HufCounter {
+	//! Core cycles.
+	HUF_COUNTER_CYCLES,
+	//! Instructions retired.
+	HUF_COUNTER_INSTRUCTIONS,
+	//! Mispredicted branches.
+	HUF_COUNTER_BRANCH_MISSES,
+	//! Reads that miss the L1 data cache.
+	HUF_COUNTER_L1D_MISSES,
+	//! Reads that miss the last level cache, i.e. go to memory.
+	HUF_COUNTER_LLC_MISSES,
+	//! The number of counters.
+	HUF_COUNTERS
+};
+
+
+//! CounterGroup struct
+/*!
+The counters of a thread: a perf_event group, read all together with one read().
+The counters that the CPU (or the hypervisor) does not have are left out of the group.
+*/
+struct CounterGroup{
+	//! The file descriptor of every counter, -1 if it is not open.
+	int fd[HUF_COUNTERS];
+	//! The position of every counter in the values read from the group, -1 if it is not open.
+	int slot[HUF_COUNTERS];
+	//! The number of counters open.
+	int open;
+	//! true after the first try to open the counters of the thread.
+	bool tried;
+
+	CounterGroup() : open(0), tried(false) {
+		for(int c=0; c<HUF_COUNTERS; ++c){
+			fd[c] = -1;
+			slot[c] = -1;
+		}
+	}
+};
+
+
+//! HuffmanCounters class
+/*!
+  This class reads the hardware counters of the CPU (cycles, instructions, branch misses, L1D and LLC misses)
+  around the stages of the engines, to see if a stage is bound by branches, by the caches or by memory.
+  The counters are opened with perf_event_open, a group for every thread, counting only the user space
+  of the thread: the stages are measured where a single thread runs them, inside the tasks of the parallel
+  stages, through StageCounters with a pointer to a HuffmanCounters, NULL when the counters are off.
+  In a container or on a kernel with a strict perf_event_paranoid the counters cannot be opened: available()
+  is false, error() tells why and the engines run without counters. On Windows they are never available.
+*/
+class HuffmanCounters {
+
+public:
+	//! The counters of every stage.
+	tbb::atomic<std::uint64_t> _values[HUF_STAGES][HUF_COUNTERS];
+	//! The bytes processed by every stage while counting.
+	tbb::atomic<std::uint64_t> _bytes[HUF_STAGES];
+	//! How many times every stage has been counted.
+	tbb::atomic<std::uint64_t> _calls[HUF_STAGES];
+	//! The counter groups of the threads.
+	tbb::enumerable_thread_specific<CounterGroup> _groups;
+	//! true for the counters that could be opened by the thread that built the object.
+	bool _available[HUF_COUNTERS];
+	//! Why the counters are not available.
+	std::string _error;
+
+	//! Constructor
+	/*!
+	All the counters start from 0. It opens the counters of the calling thread to find out which ones are available.
+	*/
+	HuffmanCounters(){
+		reset();
+		CounterGroup& group = _groups.local();
+		open_group(group, &_error);
+		for(int c=0; c<HUF_COUNTERS; ++c)
+			_available[c] = (group.fd[c] >= 0);
+	}
+
+	//! Destructor
+	/*!
+	Closes the counters of all the threads.
+	*/
+	~HuffmanCounters(){
+#if defined(__linux__)
+		for(tbb::enumerable_thread_specific<CounterGroup>::iterator it = _groups.begin(); it != _groups.end(); ++it)
+			for(int c=0; c<HUF_COUNTERS; ++c)
+				if(it->fd[c] >= 0)
+					close(it->fd[c]);
+#endif
+	}
+
+	//! Reset function
+	/*!
+	Sets all the counters to 0.
+	*/
+	void reset(){
+		for(int s=0; s<HUF_STAGES; ++s){
+			for(int c=0; c<HUF_COUNTERS; ++c)
+				_values[s][c] = 0;
+			_bytes[s] = 0;
+			_calls[s] = 0;
+		}
+	}
+
+	//! \return true if at least one counter can be read.
+	bool available() const {
+		for(int c=0; c<HUF_COUNTERS; ++c)
+			if(_available[c])
+				return true;
+		return false;
+	}
+
+	//! \return Why the counters are not available, empty if they are.
+	const std::string& error() const {
+		return _error;
+	}
+
+	//! Read function
+	/*!
+	Reads the counters of the calling thread, opening them the first time.
+	\param values The values of the counters, 0 for the ones that are not open.
+	\return false if no counter of the thread is open.
+	*/
+	bool read(std::uint64_t values[HUF_COUNTERS]){
+		CounterGroup& group = _groups.local();
+		if(!group.tried)
+			open_group(group, NULL);
+		for(int c=0; c<HUF_COUNTERS; ++c)
+			values[c] = 0;
+		if(group.open == 0)
+			return false;
+#if defined(__linux__)
+		// con PERF_FORMAT_GROUP: il numero di contatori e poi i valori, nell'ordine di apertura
+		std::uint64_t buffer[1+HUF_COUNTERS];
+		int leader = -1;
+		for(int c=0; c<HUF_COUNTERS && leader<0; ++c)
+			if(group.slot[c] == 0)
+				leader = group.fd[c];
+		if(::read(leader, buffer, sizeof(buffer)) < (ssize_t)((1+group.open)*sizeof(std::uint64_t)))
+			return false;
+		for(int c=0; c<HUF_COUNTERS; ++c)
+			if(group.slot[c] >= 0)
+				values[c] = buffer[1+group.slot[c]];
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	//! Add function
+	/*!
+	\param stage The stage.
+	\param begin The counters at the start of the stage.
+	\param end The counters at the end of the stage.
+	\param bytes The bytes processed.
+	*/
+	void add(HufStage stage, const std::uint64_t begin[HUF_COUNTERS], const std::uint64_t end[HUF_COUNTERS], std::uint64_t bytes){
+		for(int c=0; c<HUF_COUNTERS; ++c)
+			_values[stage][c] += end[c]-begin[c];
+		_bytes[stage] += bytes;
+		_calls[stage]++;
+	}
+
+	//! Merge function
+	/*!
+	Adds the counters of another object, e.g. a file to the whole run.
+	\param other The other counters.
+	*/
+	void merge(const HuffmanCounters& other){
+		for(int s=0; s<HUF_STAGES; ++s){
+			for(int c=0; c<HUF_COUNTERS; ++c)
+				_values[s][c] += other._values[s][c];
+			_bytes[s] += other._bytes[s];
+			_calls[s] += other._calls[s];
+		}
+	}
+
+	//! \return The instructions per cycle of a stage, 0 if cycles or instructions are not counted.
+	double ipc(HufStage stage) const {
+		return (_values[stage][HUF_COUNTER_CYCLES] > 0) ?
+			_values[stage][HUF_COUNTER_INSTRUCTIONS]/(double)_values[stage][HUF_COUNTER_CYCLES] : 0;
+	}
+
+	//! \return A counter of a stage for every byte processed.
+	double per_byte(HufStage stage, HufCounter counter) const {
+		return (_bytes[stage] > 0) ? _values[stage][counter]/(double)_bytes[stage] : 0;
+	}
+
+	//! \return The name of a counter.
+	static const char* counter_name(HufCounter counter){
+		static const char* names[HUF_COUNTERS] = {"cycles", "instructions", "branch-misses", "L1D-misses", "LLC-misses"};
+		return names[counter];
+	}
+
+	//! Print table function
+	/*!
+	Prints a row for every stage that has been counted: IPC, cycles and misses for every byte.
+	The counters that are not available, and the values per byte of a stage without bytes (the tree), are printed as "-".
+	\param out The output stream.
+	\param title The title of the table, e.g. the filename.
+	*/
+	void print_table(std::ostream& out, const std::string& title) const {
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::endl << title << std::endl
+			<< std::left << std::setw(12) << "stage" << std::right << std::setw(8) << "IPC" << std::setw(12) << "cycles/B"
+			<< std::setw(16) << "br-misses/KB" << std::setw(16) << "L1D-misses/KB" << std::setw(16) << "LLC-misses/KB" << std::endl;
+		for(int s=0; s<HUF_STAGES; ++s){
+			HufStage stage = (HufStage)s;
+			if(_calls[s] == 0)
+				continue;
+			out << std::left << std::setw(12) << HuffmanTimer::stage_name(stage) << std::right << std::fixed << std::setprecision(2);
+			if(_available[HUF_COUNTER_CYCLES] && _available[HUF_COUNTER_INSTRUCTIONS])
+				out << std::setw(8) << ipc(stage);
+			else
+				out << std::setw(8) << "-";
+			print_cell(out, 12, stage, HUF_COUNTER_CYCLES, 1);
+			print_cell(out, 16, stage, HUF_COUNTER_BRANCH_MISSES, 1024);
+			print_cell(out, 16, stage, HUF_COUNTER_L1D_MISSES, 1024);
+			print_cell(out, 16, stage, HUF_COUNTER_LLC_MISSES, 1024);
+			out << std::endl;
+		}
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+	//! Print JSON function
+	/*!
+	Prints the stages that have been counted as a JSON object, the counters that are not available are left out.
+	\param out The output stream.
+	*/
+	void print_json(std::ostream& out) const {
+		out << "{";
+		bool first = true;
+		for(int s=0; s<HUF_STAGES; ++s){
+			HufStage stage = (HufStage)s;
+			if(_calls[s] == 0)
+				continue;
+			out << (first ? "" : ", ") << "\"" << HuffmanTimer::stage_name(stage) << "\": {\"bytes\": " << _bytes[s];
+			for(int c=0; c<HUF_COUNTERS; ++c)
+				if(_available[c])
+					out << ", \"" << counter_name((HufCounter)c) << "\": " << _values[s][c];
+			if(_available[HUF_COUNTER_CYCLES] && _available[HUF_COUNTER_INSTRUCTIONS])
+				out << ", \"ipc\": " << ipc(stage);
+			out << "}";
+			first = false;
+		}
+		out << "}";
+	}
+
+private:
+	// una cella della tabella: il contatore per scale byte, "-" se il contatore non c'e' o la fase non ha byte
+	void print_cell(std::ostream& out, int width, HufStage stage, HufCounter counter, double scale) const {
+		if(_available[counter] && _bytes[stage] > 0)
+			out << std::setw(width) << scale*per_byte(stage, counter);
+		else
+			out << std::setw(width) << "-";
+	}
+
+	//! Open group function
+	/*!
+	Opens the counters of the calling thread as a group, the first counter opened is the leader.
+	\param group The counters of the thread.
+	\param error Where the first failure is written, NULL if it does not matter.
+	*/
+	void open_group(CounterGroup& group, std::string* error){
+		group.tried = true;
+#if defined(__linux__)
+		static const std::uint32_t types[HUF_COUNTERS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+			PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE};
+		static const std::uint64_t configs[HUF_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+		int leader = -1;
+		for(int c=0; c<HUF_COUNTERS; ++c){
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[c];
+			attr.config = configs[c];
+			attr.read_format = PERF_FORMAT_GROUP;
+			// solo lo spazio utente: basta con perf_event_paranoid fino a 2
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			// pid 0, cpu -1: il thread chiamante su qualunque cpu
+			int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+			if(fd < 0){
+				if(error && error->empty())
+					*error = std::string(counter_name((HufCounter)c)) + ": " + std::strerror(errno) +
+						((errno == EACCES || errno == EPERM) ? " (see /proc/sys/kernel/perf_event_paranoid)" : "");
+				continue;
+			}
+			if(leader < 0)
+				leader = fd;
+			group.fd[c] = fd;
+			group.slot[c] = group.open++;
+		}
+#else
+		if(error && error->empty())
+			*error = "perf_event_open is only available on Linux";
+#endif
+	}
+};
+
+
+//! StageCounters class
+/*!
+  A scoped reading of the hardware counters: what the calling thread counted from the constructor to the
+  destructor is added to a stage of a HuffmanCounters. With NULL counters it does nothing, like StageTimer.
+  Only the calling thread is counted, so it goes inside the tasks, not around a parallel_for.
+*/
+class StageCounters {
+	//! The counters, NULL if they are off.
+	HuffmanCounters* _counters;
+	//! The stage.
+	HufStage _stage;
+	//! The bytes processed.
+	std::uint64_t _bytes;
+	//! The counters at the start.
+	std::uint64_t _begin[HUF_COUNTERS];
+	//! false if the counters of the thread could not be read.
+	bool _valid;
+
+	// non si copia
+	StageCounters(const StageCounters&);
+	StageCounters& operator=(const StageCounters&);
+
+public:
+	//! Constructor
+	/*!
+	\param counters The counters, NULL if they are off.
+	\param stage The stage.
+	\param bytes The bytes processed, they can also be set later with set_bytes().
+	*/
+	StageCounters(HuffmanCounters* counters, HufStage stage, std::uint64_t bytes = 0) : _counters(counters), _stage(stage), _bytes(bytes), _valid(false) {
+		if(_counters)
+			_valid = _counters->read(_begin);
+	}
+
+	//! Destructor
+	/*!
+	Adds the counters to the stage.
+	*/
+	~StageCounters(){
+		std::uint64_t end[HUF_COUNTERS];
+		if(_valid && _counters->read(end))
+			_counters->add(_stage, _begin, end, _bytes);
+	}
+
+	//! Set bytes function
+	/*!
+	\param bytes The bytes processed, when they are known only at the end of the stage.
+	*/
+	void set_bytes(std::uint64_t bytes){
+		_bytes = bytes;
+	}
+};
+
+#endif /*HUFFMAN_COUNTERS_H*/
@@ -0,0 +1,395 @@
+#ifndef HUFFMAN_DECODER_H
+#define HUFFMAN_DECODER_H
+
+#include "huffman_utils.h"
+#include "bitreader.h"
+#include "cpu_features.h"
+#include "huffman_decoder_avx2.h"
+#include <cstdint>
+#include <vector>
+
+// bit usati per indicizzare la tabella principale: con codici lunghi al massimo 11 bit
+// ogni simbolo viene decodificato con un solo accesso alla tabella
+#define HUF_DECODE_ROOT_BITS	11
+// bit usati al massimo per indicizzare una tabella secondaria
+#define HUF_DECODE_SUB_BITS		8
+
+
+//! DecodeEntry struct
+/*!
+An entry of the decoding table. It is either a leaf, which holds the decoded symbol and how many bits
+of the code are consumed at its level, or a link to a secondary table indexed by the following bits.
+*/
+struct DecodeEntry{
+	//! The symbol (leaf) or the offset of the secondary table (link).
+	std::uint16_t value;
+	//! Bits consumed at this level by a leaf, 0 for links and invalid codes.
+	std::uint8_t len;
+	//! Width of the secondary table for a link, 0 for leaves.
+	std::uint8_t sub_bits;
+};
+
+
+//! HuffmanDecoder class, table-driven canonical huffman decoder.
+/*!
+This class decodes a canonical huffman bitstream using a multi-level lookup table built from the
+code lengths stored in the header. The primary table is indexed by the next HUF_DECODE_ROOT_BITS bits,
+codes longer than that are resolved by secondary tables indexed by the following bits, so each symbol
+costs one or two table loads instead of a bit-by-bit search.
+*/
+class HuffmanDecoder {
+
+	//! The decoding table: the primary table followed by all the secondary tables.
+	std::vector<DecodeEntry> _table;
+	//! Width of the primary table.
+	std::uint32_t _root_bits;
+	//! Shortest code length.
+	std::uint32_t _min_len;
+	//! Longest code length.
+	std::uint32_t _max_len;
+
+	//! Build level function
+	/*!
+	Fills the table at the given offset with the codes sharing the same consumed-bits prefix,
+	creating the secondary tables for the codes that do not fit in this level.
+	\param offset The offset of the table in _table.
+	\param bits The width of the table.
+	\param consumed How many bits of the codes were consumed by the previous levels.
+	\param codes The codes to insert, sorted by length.
+	*/
+	void build_level(std::uint32_t offset, std::uint32_t bits, std::uint32_t consumed, const std::vector<Triplet>& codes){
+		std::vector<std::vector<Triplet>> groups;
+		std::vector<std::uint32_t> group_index;
+
+		for(std::size_t i=0; i<codes.size(); ++i){
+			std::uint32_t rem = codes[i].code_len - consumed;
+			if(rem <= bits){
+				// la foglia occupa tutte le entry che iniziano con il resto del codice
+				std::uint32_t idx = (codes[i].code & ((1u<<rem)-1)) << (bits-rem);
+				DecodeEntry e;
+				e.value = codes[i].symbol;
+				e.len = (std::uint8_t)rem;
+				e.sub_bits = 0;
+				for(std::uint32_t j=0; j<(1u<<(bits-rem)); ++j)
+					_table[offset+idx+j] = e;
+			} else {
+				// il codice prosegue in una tabella secondaria, raggruppo per prefisso
+				std::uint32_t idx = (codes[i].code >> (rem-bits)) & ((1u<<bits)-1);
+				if(group_index.empty() || group_index.back() != idx){
+					group_index.push_back(idx);
+					groups.push_back(std::vector<Triplet>());
+				}
+				groups.back().push_back(codes[i]);
+			}
+		}
+
+		// i codici canonici con lo stesso prefisso sono contigui, quindi lo sono anche i gruppi
+		for(std::size_t g=0; g<groups.size(); ++g){
+			std::uint32_t sub_bits = groups[g].back().code_len - consumed - bits;
+			if(sub_bits > HUF_DECODE_SUB_BITS)
+				sub_bits = HUF_DECODE_SUB_BITS;
+			std::uint32_t sub_offset = (std::uint32_t)_table.size();
+			DecodeEntry invalid = {0, 0, 0};
+			_table.resize(_table.size() + (1u<<sub_bits), invalid);
+
+			_table[offset+group_index[g]].value = (std::uint16_t)sub_offset;
+			_table[offset+group_index[g]].len = 0;
+			_table[offset+group_index[g]].sub_bits = (std::uint8_t)sub_bits;
+			build_level(sub_offset, sub_bits, consumed+bits, groups[g]);
+		}
+	}
+
+	//! Lookup function
+	/*!
+	Finds the table entry of the next code in the bit reader, without consuming it.
+	\param btr The bit reader.
+	\param used The output number of bits of the code, 0 if the code is not valid.
+	\return The entry of the code.
+	*/
+	DecodeEntry lookup(const BitReader& btr, std::uint32_t& used) const {
+		std::uint32_t bits = _root_bits;
+		used = 0;
+		DecodeEntry e = _table[btr.peek(bits)];
+		while(e.sub_bits != 0){
+			used += bits;
+			bits = e.sub_bits;
+			e = _table[e.value + (btr.peek(used+bits) & ((1u<<bits)-1))];
+		}
+		used = (e.len == 0) ? 0 : used + e.len;
+		return e;
+	}
+
+public:
+
+	//! Constructor
+	/*!
+	An empty decoder, which decodes nothing until assign() is called.
+	*/
+	HuffmanDecoder() : _root_bits(0), _min_len(1), _max_len(0) {}
+
+	//! Constructor
+	/*!
+	Builds the decoding table from the depthmap read from the header.
+	An empty depthmap (a header without codes) gives an empty decoder, which decodes nothing.
+	\param depthmap The <length, symbol> pairs, sorted by length and symbol.
+	*/
+	HuffmanDecoder(DepthMap& depthmap) : _root_bits(0), _min_len(1), _max_len(0) {
+		std::vector<Triplet> codes;
+		assign(depthmap, codes);
+	}
+
+	//! Assign function
+	/*!
+	Rebuilds the decoding table from a new depthmap. The table and the codes vector keep their memory,
+	so a decoder reused for many tables allocates only while they grow (and for the secondary tables).
+	A depthmap with a length of 0 or above HUF_MAX_CODE_LEN_MAX, or whose lengths are not a prefix code,
+	gives an empty decoder.
+	\param depthmap The <length, symbol> pairs, sorted by length and symbol.
+	\param codes A scratch vector for the canonical codes.
+	*/
+	void assign(DepthMap& depthmap, std::vector<Triplet>& codes){
+		_table.clear();
+		_root_bits = 0;
+		_min_len = 1;
+		_max_len = 0;
+		if(depthmap.empty())
+			return;
+
+		// lunghezze fuori dai limiti del formato o che non formano un codice prefisso
+		// (disuguaglianza di Kraft, tabella corrotta): il decoder resta vuoto
+		std::uint64_t kraft = 0;
+		for(size_t i=0; i<depthmap.size(); ++i){
+			if(depthmap[i].first == 0 || depthmap[i].first > HUF_MAX_CODE_LEN_MAX)
+				return;
+			kraft += 1ull << (HUF_MAX_CODE_LEN_MAX-depthmap[i].first);
+		}
+		if(kraft > (1ull << HUF_MAX_CODE_LEN_MAX))
+			return;
+
+		codes.clear();
+		canonical_codes(depthmap, codes);
+
+		_min_len = codes.front().code_len;
+		_max_len = codes.back().code_len;
+		_root_bits = (_max_len < HUF_DECODE_ROOT_BITS) ? _max_len : HUF_DECODE_ROOT_BITS;
+
+		// le entry non coperte da nessun codice restano invalide (header corrotto)
+		DecodeEntry invalid = {0, 0, 0};
+		_table.assign(1u<<_root_bits, invalid);
+		build_level(0, _root_bits, 0, codes);
+	}
+
+	//! Empty function
+	/*!
+	\return true if the decoder has no codes.
+	*/
+	bool empty() const {
+		return _table.empty();
+	}
+
+	//! Min length function
+	/*!
+	\return The shortest code length, useful to bound the number of symbols in a bitstream.
+	*/
+	std::uint32_t min_len() const {
+		return _min_len;
+	}
+
+	//! Decode function
+	/*!
+	Decodes one symbol from the bit reader, bits are read MSB first as BitWriter writes them.
+	\param btr The bit reader, positioned on the code to decode.
+	\param sym The decoded symbol.
+	\return false if the input ends before a whole code is read, nothing is consumed in that case.
+	*/
+	bool decode(BitReader& btr, std::uint8_t& sym) const {
+		btr.refill();
+		std::uint32_t used;
+		DecodeEntry e = lookup(btr, used);
+		if(used == 0 || used > btr.available())
+			return false;
+		btr.consume(used);
+		sym = (std::uint8_t)e.value;
+		return true;
+	}
+
+	//! Decode run function
+	/*!
+	Decodes symbols until the stop position is reached, the input ends or max_symbols are decoded.
+	\param btr The bit reader, positioned on the first code. It is moved after the last decoded code.
+	\param stop_bit No code starting at or after this position is decoded.
+	\param out The output buffer.
+	\param max_symbols The maximum number of symbols to decode, the size of out.
+	\return The number of decoded symbols.
+	*/
+	std::uint64_t decode_run(BitReader& btr, std::uint64_t stop_bit, std::uint8_t* out, std::uint64_t max_symbols) const {
+		if(_table.empty())
+			return 0;
+		// copia locale del bit reader: le scritture su out non possono modificarla, resta nei registri
+		BitReader br = btr;
+		std::uint64_t n = 0;
+		while(n < max_symbols && br.tell_bit() < stop_bit){
+			br.refill();
+			// alla fine dell'input decodifico un simbolo alla volta controllando i bit rimasti
+			if(br.available() < _max_len){
+				if(!decode(br, out[n]))
+					break;
+				n++;
+				continue;
+			}
+
+			// dopo un refill ci sono al massimo 63 codici nel buffer: se mancano almeno 64 simboli e
+			// 64 bit allo stop controllo solo i bit disponibili
+			bool bulk = (max_symbols-n >= 64) && (br.tell_bit()+64 <= stop_bit);
+			while(br.available() >= _max_len && (bulk || (n < max_symbols && br.tell_bit() < stop_bit))){
+				std::uint32_t used;
+				DecodeEntry e = lookup(br, used);
+				if(used == 0){
+					btr = br;
+					return n;
+				}
+				out[n++] = (std::uint8_t)e.value;
+				br.consume(used);
+			}
+		}
+		btr = br;
+		return n;
+	}
+
+	//! Decode interleaved function
+	/*!
+	Decodes num_symbols symbols spread round-robin over n bitstreams: symbol i is read from streams[i % n].
+	The main loop refills every bitstream and then decodes the same number of symbols from each one,
+	the decodings of different bitstreams do not depend on each other so they overlap in the pipeline.
+	With 8 bitstreams the AVX2 kernel is used when the CPU supports it, chosen at run time.
+	\param streams The bit readers of the bitstreams, positioned on the first code. They are moved after the last decoded code.
+	\param n The number of bitstreams, between 2 and HUF_MAX_STREAMS.
+	\param out The output buffer.
+	\param num_symbols The number of symbols to decode.
+	\return The number of decoded symbols, less than num_symbols if a bitstream is corrupted.
+	*/
+	std::uint64_t decode_interleaved(BitReader* streams, std::uint32_t n, std::uint8_t* out, std::uint64_t num_symbols) const {
+		switch(n){
+			case 2: return decode_interleaved_n<2>(streams, out, num_symbols);
+			case 4: return decode_interleaved_n<4>(streams, out, num_symbols);
+			case 8: {
+				std::uint64_t i = decode_interleaved8_simd(streams, out, num_symbols);
+				return i + decode_interleaved_n<8>(streams, out+i, num_symbols-i);
+			}
+			default: return decode_interleaved_n<0>(streams, out, num_symbols, n);
+		}
+	}
+
+private:
+
+	//! SIMD interleaved decode function
+	/*!
+	Runs the AVX2 kernel on 8 bitstreams if the CPU supports it and every code is resolved by the
+	primary table, the scalar code decodes what is left.
+	The bitstreams must be in the same buffer, as in a block.
+	\param streams The bit readers of the 8 bitstreams, moved after the decoded codes.
+	\param out The output buffer.
+	\param num_symbols The number of symbols to decode.
+	\return The number of decoded symbols, a multiple of 8 (0 if the kernel cannot be used).
+	*/
+	std::uint64_t decode_interleaved8_simd(BitReader* streams, std::uint8_t* out, std::uint64_t num_symbols) const {
+#if defined(HUF_X86)
+		if(!cpu_has_avx2() || _table.size() != (1u<<_root_bits) || num_symbols < 8)
+			return 0;
+
+		// posizioni in bit rispetto all'inizio del primo bitstream, devono stare in 32 bit
+		const std::uint8_t* base = streams[0].data();
+		std::uint32_t pos[8];
+		std::uint32_t end[8];
+		for(int s=0; s<8; ++s){
+			if(streams[s].data() < base || (std::uint64_t)(streams[s].data()-base) + streams[s].size() >= (1u<<28))
+				return 0;
+			std::uint64_t start = (std::uint64_t)(streams[s].data()-base)*8;
+			pos[s] = (std::uint32_t)(start + streams[s].tell_bit());
+			end[s] = (std::uint32_t)(start + streams[s].size()*8);
+		}
+
+		std::uint64_t i = decode_interleaved8_avx2(_table.data(), _root_bits, _max_len, base, pos, end, out, num_symbols);
+		if(i == 0)
+			return 0;
+		for(int s=0; s<8; ++s)
+			streams[s].seek_bit(pos[s] - (std::uint64_t)(streams[s].data()-base)*8);
+		return i;
+#else
+		return 0;
+#endif
+	}
+
+	//! Decode interleaved function, for a given number of bitstreams
+	/*!
+	The number of bitstreams is a template parameter so that the inner loops are unrolled and the
+	bit readers stay in registers. N = 0 is the generic version, the number of bitstreams is n.
+	*/
+	template<std::uint32_t N>
+	std::uint64_t decode_interleaved_n(BitReader* streams, std::uint8_t* out, std::uint64_t num_symbols, std::uint32_t n = N) const {
+		if(_table.empty() || n < 2 || n > HUF_MAX_STREAMS)
+			return 0;
+		const std::uint32_t ns = (N > 0) ? N : n;
+
+		// copie locali dei bit reader, come in decode_run
+		BitReader br[HUF_MAX_STREAMS];
+		for(std::uint32_t s=0; s<ns; ++s)
+			br[s] = streams[s];
+
+		// dopo un refill ci sono almeno 56 bit: bastano per 56/_max_len codici di ogni bitstream
+		// (almeno uno, _max_len non supera HUF_MAX_CODE_LEN_MAX)
+		const std::uint32_t per_refill = 56/_max_len;
+		const std::uint64_t round = (std::uint64_t)ns*per_refill;
+		std::uint64_t i = 0;
+		while(per_refill > 0 && num_symbols-i >= round){
+			bool enough = true;
+			for(std::uint32_t s=0; s<ns; ++s){
+				br[s].refill();
+				enough &= (br[s].available() >= per_refill*_max_len);
+			}
+			// alla fine di un bitstream passo al ciclo che controlla ogni codice
+			if(!enough)
+				break;
+
+			for(std::uint32_t k=0; k<per_refill; ++k){
+				for(std::uint32_t s=0; s<ns; ++s){
+					std::uint32_t used;
+					DecodeEntry e = lookup(br[s], used);
+					if(used == 0){
+						for(std::uint32_t t=0; t<ns; ++t)
+							streams[t] = br[t];
+						return i;
+					}
+					out[i+s] = (std::uint8_t)e.value;
+					br[s].consume(used);
+				}
+				i += ns;
+			}
+		}
+
+		// ultimi simboli: uno alla volta, ciascuno dal suo bitstream
+		for(; i<num_symbols; ++i)
+			if(!decode(br[i%ns], out[i]))
+				break;
+
+		for(std::uint32_t s=0; s<ns; ++s)
+			streams[s] = br[s];
+		return i;
+	}
+};
+
+//! DecodeScratch struct
+/*!
+The memory used to read the table of a HUF_BLOCK_LOCAL block and to build its decoder.
+Passing the same DecodeScratch to Huffman::decode_block() for many blocks avoids allocating it every time.
+*/
+struct DecodeScratch{
+	//! The <length, symbol> pairs of the table.
+	DepthMap depthmap;
+	//! The canonical codes of the table.
+	std::vector<Triplet> codes;
+	//! The decoder of the table.
+	HuffmanDecoder local;
+};
+
+#endif /*HUFFMAN_DECODER_H*/
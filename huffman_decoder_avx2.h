@@ -0,0 +1,91 @@
+#ifndef HUFFMAN_DECODER_AVX2_H
+#define HUFFMAN_DECODER_AVX2_H
+
+#include <cstdint>
+#include "cpu_features.h"
+
+#if defined(HUF_X86)
+
+//! AVX2 interleaved decode function.
+/*!
+The AVX2 kernel of HuffmanDecoder::decode_interleaved() for 8 bitstreams, the 8 bitstreams are decoded
+at the same time, one per 32-bit lane:
+	- the next 32 bits of every bitstream are loaded with a gather and byte-swapped (the bitstream is MSB first),
+	- a variable shift drops the bits already consumed by every lane,
+	- the top root_bits bits index the decoding table with a second gather,
+	- the code lengths advance the bit cursors and the 8 symbols are stored with a single 8-byte store.
+The table must have no secondary tables (every code fits in root_bits bits). It must be called only
+when cpu_has_avx2() is true.
+The kernel stops when a bitstream has less than 32 bits left, when less than 8 symbols are left
+or on an invalid code, the caller decodes the rest.
+\param table The decoding table, 32-bit entries {value 16, len 8, sub_bits 8}.
+\param root_bits The width of the table.
+\param max_len The longest code length.
+\param base The buffer containing the bitstreams.
+\param pos The bit position of every bitstream from base, updated.
+\param end The end of every bitstream in bits from base.
+\param out The output buffer, symbol 8*k+s comes from bitstream s.
+\param num_symbols The number of symbols to decode at most.
+\return The number of decoded symbols, a multiple of 8.
+*/
+HUF_TARGET_AVX2
+static std::uint64_t decode_interleaved8_avx2(const void* table, std::uint32_t root_bits, std::uint32_t max_len, const std::uint8_t* base, std::uint32_t* pos, const std::uint32_t* end, std::uint8_t* out, std::uint64_t num_symbols){
+	// i 4 byte di ogni lane vengono invertiti: il bitstream e' big endian
+	const __m256i bswap = _mm256_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12,
+		3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12);
+	// il byte basso di ogni lane (il simbolo) nei primi 4 byte di ogni meta'
+	const __m256i pack = _mm256_setr_epi8(0,4,8,12, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1,
+		0,4,8,12, -1,-1,-1,-1, -1,-1,-1,-1, -1,-1,-1,-1);
+	const __m256i join = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+	const __m256i seven = _mm256_set1_epi32(7);
+	const __m256i byte_mask = _mm256_set1_epi32(0xff);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m128i root_shift = _mm_cvtsi32_si128((int)(32-root_bits));
+	const int* words = reinterpret_cast<const int*>(base);
+	const int* entries = reinterpret_cast<const int*>(table);
+
+	__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+	std::uint64_t i = 0;
+	bool stop = false;
+	while(!stop && num_symbols-i >= 8){
+		// giri senza controlli sui limiti: ogni codice consuma al massimo max_len bit, ogni load legge 32 bit
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pos), p);
+		std::uint64_t rounds = (num_symbols-i)/8;
+		for(int s=0; s<8; ++s){
+			if(pos[s]+32 > end[s]){
+				rounds = 0;
+				break;
+			}
+			std::uint64_t r = (end[s]-pos[s]-32)/max_len + 1;
+			if(r < rounds)
+				rounds = r;
+		}
+		if(rounds == 0)
+			break;
+
+		for(std::uint64_t k=0; k<rounds; ++k){
+			__m256i w = _mm256_i32gather_epi32(words, _mm256_srli_epi32(p, 3), 1);
+			w = _mm256_shuffle_epi8(w, bswap);
+			w = _mm256_sllv_epi32(w, _mm256_and_si256(p, seven));
+			__m256i e = _mm256_i32gather_epi32(entries, _mm256_srl_epi32(w, root_shift), 4);
+			__m256i len = _mm256_and_si256(_mm256_srli_epi32(e, 16), byte_mask);
+
+			// codice non valido: il chiamante lo trova decodificando un simbolo alla volta
+			if(!_mm256_testz_si256(_mm256_cmpeq_epi32(len, zero), _mm256_cmpeq_epi32(zero, zero))){
+				stop = true;
+				break;
+			}
+			p = _mm256_add_epi32(p, len);
+
+			__m256i sym = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(e, pack), join);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out+i), _mm256_castsi256_si128(sym));
+			i += 8;
+		}
+	}
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(pos), p);
+	return i;
+}
+
+#endif /*HUF_X86*/
+
+#endif /*HUFFMAN_DECODER_AVX2_H*/
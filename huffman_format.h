@@ -0,0 +1,170 @@
+#ifndef HUFFMAN_FORMAT_H
+#define HUFFMAN_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "bitreader.h"
+#include "huffman_utils.h"
+
+// campi del formato BCP2 scritti e letti sia da Huffman sia dall'API su buffer (huffman_api.cpp).
+// Le funzioni di scrittura sono template sul bit writer: BitWriter scrive in un vector, quello
+// dell'API direttamente nel buffer del chiamante. Basta che abbia write(u, n), entrambi scrivono MSB first.
+
+
+//! Write u64 function.
+/*!
+Writes a 64-bit integer, high half first.
+\param btw The bit writer.
+\param u The integer.
+*/
+template<typename Writer>
+static void write_u64(Writer& btw, std::uint64_t u){
+	btw.write((std::uint32_t)(u>>32), 32);
+	btw.write((std::uint32_t)u, 32);
+}
+
+//! Read u64 function.
+/*!
+Reads a 64-bit integer written by write_u64().
+\param btr The bit reader.
+\return The integer.
+*/
+static inline std::uint64_t read_u64(BitReader& btr){
+	std::uint64_t u = btr.read(32);
+	return (u<<32) | btr.read(32);
+}
+
+//! Write file header function.
+/*!
+Writes the header of a BCP2 file up to the number of symbols of the global table, the pairs
+follow (see write_code_pairs()).
+\param btw The bit writer.
+\param name The original filename, it can be empty.
+\param name_length The length of the original filename.
+\param file_len The length of the original file, HUF_UNKNOWN_LENGTH if it is written only in the index.
+\param num_symbols The number of pairs of the global table, 0 if the blocks have their own tables.
+*/
+template<typename Writer>
+static void write_file_header(Writer& btw, const char* name, std::uint32_t name_length, std::uint64_t file_len, std::uint32_t num_symbols){
+	btw.write(HUF_MAGIC_NUMBER, 32);
+	btw.write(name_length, 32);
+	for(std::uint32_t i=0; i<name_length; ++i)
+		btw.write((std::uint8_t)name[i], 8);
+	write_u64(btw, file_len);
+	btw.write(HUF_BLOCK_DIM, 32);
+	btw.write(num_symbols, 32);
+}
+
+//! Write code pairs function.
+/*!
+Writes the <symbol, length> pairs of a table, in the order of the depthmap.
+\param btw The bit writer.
+\param depthmap The <length, symbol> pairs, sorted with depth_compare().
+*/
+template<typename Writer>
+static void write_code_pairs(Writer& btw, const DepthMap& depthmap){
+	// PRIMA IL SIMBOLO POI LA LUNGHEZZA
+	for(std::size_t i=0; i<depthmap.size(); ++i){
+		btw.write(depthmap[i].second, 8);
+		btw.write(depthmap[i].first, 8);
+	}
+}
+
+//! Write local table function.
+/*!
+Writes the compact table at the beginning of a HUF_BLOCK_LOCAL block: the number of symbols on
+16 bits and the <symbol, length> pairs.
+\param btw The bit writer.
+\param depthmap The <length, symbol> pairs, sorted with depth_compare().
+*/
+template<typename Writer>
+static void write_local_table(Writer& btw, const DepthMap& depthmap){
+	btw.write((std::uint32_t)depthmap.size(), 16);
+	write_code_pairs(btw, depthmap);
+}
+
+//! Write block header function.
+/*!
+Writes the header of a block, on a byte boundary.
+\param btw The bit writer.
+\param type The block type (HUF_BLOCK_*), with the HUF_BLOCK_INTERLEAVED flag if needed.
+\param dim The number of original bytes encoded in the block.
+\param size The number of compressed bytes following the header, 0 if it is set later with set_block_size().
+*/
+template<typename Writer>
+static void write_block_header(Writer& btw, std::uint8_t type, std::uint32_t dim, std::uint32_t size){
+	btw.write(type, 8);
+	btw.write(dim, 32);
+	btw.write(size, 32);
+}
+
+//! Set block size function.
+/*!
+Sets the compressed size in a block header already written, once the block is complete.
+\param block The first byte of the block header.
+\param size The number of compressed bytes following the header.
+*/
+static inline void set_block_size(std::uint8_t* block, std::uint32_t size){
+	block[5] = (std::uint8_t)(size>>24);
+	block[6] = (std::uint8_t)(size>>16);
+	block[7] = (std::uint8_t)(size>>8);
+	block[8] = (std::uint8_t)size;
+}
+
+//! Store block function.
+/*!
+Writes a HUF_BLOCK_STORED block: the header, with the same original and compressed size, and the bytes.
+\param out The output, with room for HUF_BLOCK_HEADER_DIM + dim bytes.
+\param data The original bytes.
+\param dim The number of bytes.
+\return The length of the block, header included.
+*/
+static inline std::uint64_t store_block(std::uint8_t* out, const std::uint8_t* data, std::uint32_t dim){
+	out[0] = HUF_BLOCK_STORED;
+	for(int k=0; k<4; ++k){
+		out[1+k] = (std::uint8_t)(dim>>(24-8*k));
+		out[5+k] = (std::uint8_t)(dim>>(24-8*k));
+	}
+	if(dim > 0)
+		memcpy(out+HUF_BLOCK_HEADER_DIM, data, dim);
+	return HUF_BLOCK_HEADER_DIM + (std::uint64_t)dim;
+}
+
+//! Write index function.
+/*!
+Writes the HUF_BLOCK_END block, on a byte boundary: the index entries followed by the trailer
+(length of the original file, number of blocks and HUF_INDEX_MAGIC).
+\param btw The bit writer.
+\param index The block index.
+\param file_len The length of the original file.
+*/
+template<typename Writer>
+static void write_index(Writer& btw, const std::vector<BlockIndexEntry>& index, std::uint64_t file_len){
+	write_block_header(btw, HUF_BLOCK_END, 0, (std::uint32_t)(index.size()*HUF_INDEX_ENTRY_DIM + HUF_INDEX_TRAILER_DIM));
+	for(std::size_t i=0; i<index.size(); ++i){
+		write_u64(btw, index[i].uncompressed_offset);
+		write_u64(btw, index[i].bit_offset);
+		write_u64(btw, index[i].size);
+	}
+	write_u64(btw, file_len);
+	write_u64(btw, index.size());
+	btw.write(HUF_INDEX_MAGIC, 32);
+}
+
+//! Read index trailer function.
+/*!
+Reads the trailer that closes the index.
+\param trailer The HUF_INDEX_TRAILER_DIM bytes of the trailer.
+\param file_len The output length of the original file.
+\param num_blocks The output number of index entries.
+\return false if the trailer does not end with HUF_INDEX_MAGIC.
+*/
+static inline bool read_index_trailer(const std::uint8_t* trailer, std::uint64_t& file_len, std::uint64_t& num_blocks){
+	BitReader btr(trailer, HUF_INDEX_TRAILER_DIM);
+	file_len = read_u64(btr);
+	num_blocks = read_u64(btr);
+	return btr.read(32) == HUF_INDEX_MAGIC;
+}
+
+#endif /*HUFFMAN_FORMAT_H*/
@@ -0,0 +1,98 @@
+#ifndef HUFFMAN_HISTO_H
+#define HUFFMAN_HISTO_H
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+// numero di sotto-istogrammi interlacciati: byte consecutivi uguali incrementano contatori
+// diversi, cosi' non si aspetta la scrittura del contatore precedente per leggere il successivo
+#define HUF_HISTO_TABLES	8
+
+
+//! Histogram type: 256 bins of 64-bit counters, safe on files of any size.
+typedef std::vector<std::uint64_t> Histo;
+
+
+//! Add word function.
+/*!
+Adds the 8 bytes of a 64-bit word to the interleaved sub-histograms, one byte per sub-histogram.
+Byte order does not matter, every byte is counted once.
+\param counts The sub-histograms.
+\param w The word.
+*/
+static inline void histo_add_word(std::uint64_t counts[HUF_HISTO_TABLES][256], std::uint64_t w){
+	counts[0][w & 0xff]++;
+	counts[1][(w>>8) & 0xff]++;
+	counts[2][(w>>16) & 0xff]++;
+	counts[3][(w>>24) & 0xff]++;
+	counts[4][(w>>32) & 0xff]++;
+	counts[5][(w>>40) & 0xff]++;
+	counts[6][(w>>48) & 0xff]++;
+	counts[7][w>>56]++;
+}
+
+//! Histogram accumulate function.
+/*!
+The histogram engine shared by the sequential and parallel classes. It counts the bytes of a buffer
+into private, non-atomic 64-bit counters spread over HUF_HISTO_TABLES interleaved sub-histograms,
+which are summed into the output histogram at the end. The buffer is read 8 bytes at a time.
+\param data The buffer.
+\param len The buffer length.
+\param histo The output histogram (256 bins), the counts are added to its current values.
+*/
+static void histo_accumulate(const std::uint8_t* data, std::uint64_t len, std::uint64_t* histo){
+	std::uint64_t counts[HUF_HISTO_TABLES][256];
+	memset(counts, 0, sizeof(counts));
+
+	std::uint64_t i = 0;
+	for(; i+8 <= len; i+=8){
+		std::uint64_t w;
+		memcpy(&w, data+i, 8);
+		histo_add_word(counts, w);
+	}
+	for(; i<len; ++i)
+		counts[0][data[i]]++;
+
+	for(int b=0; b<256; ++b){
+		std::uint64_t sum = 0;
+		for(int t=0; t<HUF_HISTO_TABLES; ++t)
+			sum += counts[t][b];
+		histo[b] += sum;
+	}
+}
+
+//! Histogram entropy function.
+/*!
+The Shannon entropy of the counted symbols, a lower bound of the bits of any code built for them.
+\param histo The histogram (256 bins).
+\return The number of bits.
+*/
+static double histo_entropy(const std::uint64_t* histo){
+	std::uint64_t total = 0;
+	double sum = 0;
+	for(int b=0; b<256; ++b){
+		if(histo[b] == 0)
+			continue;
+		total += histo[b];
+		sum += histo[b]*std::log2((double)histo[b]);
+	}
+	return (total > 0) ? total*std::log2((double)total) - sum : 0;
+}
+
+//! Histogram cost function.
+/*!
+The exact length of the encoded bits of the counted symbols, given the code length of every symbol.
+\param histo The histogram (256 bins).
+\param lengths The code length of every symbol, 0 for the symbols without a code.
+\return The number of bits.
+*/
+static std::uint64_t histo_cost(const std::uint64_t* histo, const std::uint32_t* lengths){
+	std::uint64_t bits = 0;
+	for(int b=0; b<256; ++b)
+		bits += histo[b]*lengths[b];
+	return bits;
+}
+
+#endif /*HUFFMAN_HISTO_H*/
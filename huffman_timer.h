@@ -0,0 +1,221 @@
+#ifndef HUFFMAN_TIMER_H
+#define HUFFMAN_TIMER_H
+
+#include <cstdint>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include "tbb/tbb.h"
+#include "tbb/tick_count.h"
+#include "huffman_utils.h"
+
+//! Stages of the compression and decompression measured by HuffmanTimer.
+enum HufStage {
+	//! Reading the input: the pages of the mapped file, the stream or the compressed chunks.
+	HUF_STAGE_READ,
+	//! Counting the symbols, of the whole file or of a block.
+	HUF_STAGE_HISTOGRAM,
+	//! Huffman tree, code lengths and canonical codes.
+	HUF_STAGE_TREE,
+	//! Turning the symbols into codes.
+	HUF_STAGE_ENCODE,
+	//! Joining the bitstreams encoded apart: the segments of ParHuffman and the interleaved streams.
+	HUF_STAGE_PACK,
+	//! Turning the codes back into symbols.
+	HUF_STAGE_DECODE,
+	//! Writing the output.
+	HUF_STAGE_WRITE,
+	//! The whole operation, from the first read to the last write.
+	HUF_STAGE_TOTAL,
+	//! The number of stages.
+	HUF_STAGES
+};
+
+
+//! HuffmanTimer class
+/*!
+  This class collects the time spent in every stage and the bytes it processed, a file at a time or
+  summing the files of a run with merge(). The counters are atomic: the stages run inside the pipelines
+  and the parallel_for of the engines, so the same stage can be timed by many threads at the same time
+  and its seconds are the sum of the time of every thread (the MB/s are the throughput of one thread).
+  The engines time a stage through StageTimer with a pointer to a HuffmanTimer, NULL when the timer is off.
+*/
+class HuffmanTimer {
+
+public:
+	//! The time of every stage, in nanoseconds.
+	tbb::atomic<std::uint64_t> _nanoseconds[HUF_STAGES];
+	//! The bytes processed by every stage.
+	tbb::atomic<std::uint64_t> _bytes[HUF_STAGES];
+	//! How many times every stage has been timed.
+	tbb::atomic<std::uint64_t> _calls[HUF_STAGES];
+
+	//! Constructor
+	/*!
+	An empty constructor, all the counters start from 0.
+	*/
+	HuffmanTimer(){
+		reset();
+	}
+
+	//! Reset function
+	/*!
+	Sets all the counters to 0.
+	*/
+	void reset(){
+		for(int s=0; s<HUF_STAGES; ++s){
+			_nanoseconds[s] = 0;
+			_bytes[s] = 0;
+			_calls[s] = 0;
+		}
+	}
+
+	//! Add function
+	/*!
+	\param stage The stage.
+	\param seconds The time spent.
+	\param bytes The bytes processed.
+	*/
+	void add(HufStage stage, double seconds, std::uint64_t bytes){
+		_nanoseconds[stage] += (std::uint64_t)(seconds*1e9);
+		_bytes[stage] += bytes;
+		_calls[stage]++;
+	}
+
+	//! Merge function
+	/*!
+	Adds the counters of another timer, e.g. a file to the whole run.
+	\param other The other timer.
+	*/
+	void merge(const HuffmanTimer& other){
+		for(int s=0; s<HUF_STAGES; ++s){
+			_nanoseconds[s] += other._nanoseconds[s];
+			_bytes[s] += other._bytes[s];
+			_calls[s] += other._calls[s];
+		}
+	}
+
+	//! \return The seconds spent in a stage.
+	double seconds(HufStage stage) const {
+		return _nanoseconds[stage]/1e9;
+	}
+
+	//! \return The MB/s of a stage, 0 if it processed no bytes.
+	double throughput(HufStage stage) const {
+		return (_nanoseconds[stage] > 0) ? (_bytes[stage]/(double)HUF_ONE_MB)/seconds(stage) : 0;
+	}
+
+	//! \return The name of a stage.
+	static const char* stage_name(HufStage stage){
+		static const char* names[HUF_STAGES] = {"read", "histogram", "tree", "encode", "pack", "decode", "write", "total"};
+		return names[stage];
+	}
+
+	//! Print table function
+	/*!
+	Prints a row for every stage that has been timed.
+	\param out The output stream.
+	\param title The title of the table, e.g. the filename.
+	*/
+	void print_table(std::ostream& out, const std::string& title) const {
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::endl << title << std::endl
+			<< std::left << std::setw(12) << "stage" << std::right << std::setw(12) << "seconds" << std::setw(10) << "calls"
+			<< std::setw(12) << "MB" << std::setw(12) << "MB/s" << std::endl;
+		for(int s=0; s<HUF_STAGES; ++s){
+			HufStage stage = (HufStage)s;
+			if(_calls[s] == 0)
+				continue;
+			out << std::left << std::setw(12) << stage_name(stage) << std::right << std::fixed
+				<< std::setprecision(4) << std::setw(12) << seconds(stage) << std::setw(10) << _calls[s]
+				<< std::setprecision(1) << std::setw(12) << _bytes[s]/(double)HUF_ONE_MB;
+			if(_bytes[s] > 0)
+				out << std::setw(12) << throughput(stage) << std::endl;
+			else
+				out << std::setw(12) << "-" << std::endl;
+		}
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+	//! Print JSON function
+	/*!
+	Prints the stages that have been timed as a JSON object.
+	\param out The output stream.
+	\param name The value of the "name" field, e.g. the filename.
+	*/
+	void print_json(std::ostream& out, const std::string& name) const {
+		out << "{\"name\": \"";
+		for(size_t i=0; i<name.size(); ++i){
+			if(name[i] == '"' || name[i] == '\\')
+				out << '\\';
+			out << name[i];
+		}
+		out << "\", \"stages\": {";
+		bool first = true;
+		for(int s=0; s<HUF_STAGES; ++s){
+			HufStage stage = (HufStage)s;
+			if(_calls[s] == 0)
+				continue;
+			out << (first ? "" : ", ") << "\"" << stage_name(stage) << "\": {\"seconds\": " << seconds(stage)
+				<< ", \"calls\": " << _calls[s] << ", \"bytes\": " << _bytes[s] << ", \"mbs\": " << throughput(stage) << "}";
+			first = false;
+		}
+		out << "}}";
+	}
+};
+
+
+//! StageTimer class
+/*!
+  A scoped timer: the time from the constructor to the destructor is added to a stage of a HuffmanTimer.
+  With a NULL timer it does nothing, not even reading the clock, so the engines keep it in their code
+  and pay a test on a pointer when the timer is off. It is used around a block or a chunk, never inside
+  the loops on the symbols.
+*/
+class StageTimer {
+	//! The timer, NULL if it is off.
+	HuffmanTimer* _timer;
+	//! The stage.
+	HufStage _stage;
+	//! The bytes processed.
+	std::uint64_t _bytes;
+	//! The start time.
+	tbb::tick_count _start;
+
+	// non si copia
+	StageTimer(const StageTimer&);
+	StageTimer& operator=(const StageTimer&);
+
+public:
+	//! Constructor
+	/*!
+	\param timer The timer, NULL if it is off.
+	\param stage The stage.
+	\param bytes The bytes processed, they can also be set later with set_bytes().
+	*/
+	StageTimer(HuffmanTimer* timer, HufStage stage, std::uint64_t bytes = 0) : _timer(timer), _stage(stage), _bytes(bytes) {
+		if(_timer)
+			_start = tbb::tick_count::now();
+	}
+
+	//! Destructor
+	/*!
+	Adds the time to the stage.
+	*/
+	~StageTimer(){
+		if(_timer)
+			_timer->add(_stage, (tbb::tick_count::now()-_start).seconds(), _bytes);
+	}
+
+	//! Set bytes function
+	/*!
+	\param bytes The bytes processed, when they are known only at the end of the stage.
+	*/
+	void set_bytes(std::uint64_t bytes){
+		_bytes = bytes;
+	}
+};
+
+#endif /*HUFFMAN_TIMER_H*/
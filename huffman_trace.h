@@ -0,0 +1,173 @@
+#ifndef HUFFMAN_TRACE_H
+#define HUFFMAN_TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "tbb/tbb.h"
+#include "tbb/enumerable_thread_specific.h"
+#include "tbb/tick_count.h"
+
+// eventi tenuti da ogni thread: 64K eventi da 32 byte, 2 MB per thread; i piu' vecchi vengono sovrascritti
+#define HUF_TRACE_EVENTS_PER_THREAD	65536
+// file scritto con --trace
+#define HUF_TRACE_FILENAME	"huffman_trace.json"
+
+//! TraceEvent struct
+/*!
+A span recorded by a thread: a stage of a pipeline or the range of a task.
+*/
+struct TraceEvent{
+	//! The name of the span, a string literal.
+	const char* name;
+	//! The start, in microseconds from the creation of the trace.
+	double begin;
+	//! The length in microseconds.
+	double duration;
+	//! The bytes processed, 0 if they do not make sense.
+	std::uint64_t bytes;
+};
+
+
+//! TraceBuffer struct
+/*!
+The ring of events of a thread. Only its thread writes it, so no lock and no atomic is needed;
+it is read by HuffmanTrace::write() when the tasks are over.
+*/
+struct TraceBuffer{
+	//! The events, allocated at the first span of the thread.
+	std::vector<TraceEvent> events;
+	//! The number of events recorded, the next one goes to events[count % HUF_TRACE_EVENTS_PER_THREAD].
+	std::uint64_t count;
+	//! The thread id written in the trace.
+	unsigned tid;
+
+	TraceBuffer() : count(0), tid(0) {}
+};
+
+
+//! HuffmanTrace class
+/*!
+  This class records the spans of every thread and writes them as a Chrome trace (the JSON format of
+  chrome://tracing and Perfetto), to see on a timeline how the pipelines and the parallel_for of the
+  engines use the threads of the scheduler.
+  Every thread writes in its own ring buffer, found through tbb::enumerable_thread_specific: recording a
+  span costs two reads of the clock and a store, there is no lock and no shared counter in the way.
+  The engines record spans through TraceSpan with a pointer to a HuffmanTrace, NULL when tracing is off.
+*/
+class HuffmanTrace {
+
+public:
+	//! The ring buffers of the threads.
+	tbb::enumerable_thread_specific<TraceBuffer> _buffers;
+	//! The time 0 of the trace.
+	tbb::tick_count _origin;
+	//! The next thread id.
+	tbb::atomic<unsigned> _next_tid;
+
+	//! Constructor
+	/*!
+	An empty trace, the time starts now.
+	*/
+	HuffmanTrace() : _origin(tbb::tick_count::now()) {
+		_next_tid = 0;
+	}
+
+	//! Record function
+	/*!
+	Adds a span to the ring of the calling thread.
+	\param name The name of the span, a string literal (only the pointer is kept).
+	\param begin The start of the span.
+	\param end The end of the span.
+	\param bytes The bytes processed.
+	*/
+	void record(const char* name, tbb::tick_count begin, tbb::tick_count end, std::uint64_t bytes){
+		bool exists;
+		TraceBuffer& buffer = _buffers.local(exists);
+		if(!exists){
+			buffer.tid = _next_tid++;
+			buffer.events.resize(HUF_TRACE_EVENTS_PER_THREAD);
+		}
+		TraceEvent& e = buffer.events[buffer.count % HUF_TRACE_EVENTS_PER_THREAD];
+		e.name = name;
+		e.begin = (begin-_origin).seconds()*1e6;
+		e.duration = (end-begin).seconds()*1e6;
+		e.bytes = bytes;
+		buffer.count++;
+	}
+
+	//! Write function
+	/*!
+	Writes the spans of all the threads as a Chrome trace, to be called when no task is recording.
+	\param filename The output filename.
+	\return false if the file cannot be written.
+	*/
+	bool write(const std::string& filename){
+		std::ofstream out(filename, std::fstream::out|std::fstream::binary);
+		std::uint64_t dropped = 0;
+		bool first = true;
+		out << "{\"traceEvents\": [";
+		for(tbb::enumerable_thread_specific<TraceBuffer>::iterator it = _buffers.begin(); it != _buffers.end(); ++it){
+			out << (first ? "" : ",") << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << it->tid
+				<< ", \"args\": {\"name\": \"thread " << it->tid << "\"}}";
+			first = false;
+
+			// con il ring pieno gli eventi piu' vecchi sono stati sovrascritti
+			std::uint64_t n = (it->count < HUF_TRACE_EVENTS_PER_THREAD) ? it->count : HUF_TRACE_EVENTS_PER_THREAD;
+			dropped += it->count - n;
+			for(std::uint64_t k=it->count-n; k<it->count; ++k){
+				const TraceEvent& e = it->events[k % HUF_TRACE_EVENTS_PER_THREAD];
+				out << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"huffman\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << it->tid
+					<< ", \"ts\": " << e.begin << ", \"dur\": " << e.duration << ", \"args\": {\"bytes\": " << e.bytes << "}}";
+			}
+		}
+		out << "\n], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+		out.close();
+		return !out.fail();
+	}
+};
+
+
+//! TraceSpan class
+/*!
+  A scoped span: the time from the constructor to the destructor is recorded in a HuffmanTrace.
+  With a NULL trace it does nothing, not even reading the clock, like StageTimer.
+*/
+class TraceSpan {
+	//! The trace, NULL if tracing is off.
+	HuffmanTrace* _trace;
+	//! The name of the span.
+	const char* _name;
+	//! The bytes processed.
+	std::uint64_t _bytes;
+	//! The start time.
+	tbb::tick_count _start;
+
+	// non si copia
+	TraceSpan(const TraceSpan&);
+	TraceSpan& operator=(const TraceSpan&);
+
+public:
+	//! Constructor
+	/*!
+	\param trace The trace, NULL if tracing is off.
+	\param name The name of the span, a string literal.
+	\param bytes The bytes processed.
+	*/
+	TraceSpan(HuffmanTrace* trace, const char* name, std::uint64_t bytes = 0) : _trace(trace), _name(name), _bytes(bytes) {
+		if(_trace)
+			_start = tbb::tick_count::now();
+	}
+
+	//! Destructor
+	/*!
+	Records the span.
+	*/
+	~TraceSpan(){
+		if(_trace)
+			_trace->record(_name, _start, tbb::tick_count::now(), _bytes);
+	}
+};
+
+#endif /*HUFFMAN_TRACE_H*/
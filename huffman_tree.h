@@ -0,0 +1,141 @@
+#ifndef HUFFMAN_TREE_H
+#define HUFFMAN_TREE_H
+
+#include <cstdint>
+#include <algorithm>
+#include "huffman_utils.h"
+
+// nodi di un albero di huffman su 256 simboli: 256 foglie e 255 nodi interni
+#define HUF_TREE_MAX_NODES	511
+
+
+//! HuffTreeNode struct
+/*!
+A node of the huffman tree. The children are indices in the arena of the tree, not pointers.
+*/
+struct HuffTreeNode{
+	//! The total occurrences of the symbols below the node (intended as its probability).
+	std::uint64_t occ;
+	//! The symbol represented by a leaf, -1 for internal nodes.
+	std::int32_t symb;
+	//! The index of the left child, -1 for leaves.
+	std::int32_t left;
+	//! The index of the right child, -1 for leaves.
+	std::int32_t right;
+};
+
+
+//! HuffmanTree struct
+/*!
+The huffman tree stored in a flat arena of nodes: the leaves come first, sorted by occurrences,
+then the internal nodes in the order they are created, the root is the last node.
+The arena has a fixed size, building a tree does not allocate memory so it can be done for every
+block, and nothing has to be freed.
+*/
+struct HuffmanTree{
+	//! The arena.
+	HuffTreeNode nodes[HUF_TREE_MAX_NODES];
+	//! The number of leaves (symbols found in the histogram).
+	std::uint32_t num_leaves;
+	//! The number of nodes in use.
+	std::uint32_t num_nodes;
+
+	//! Root function
+	/*!
+	\return The index of the root, -1 if the tree is empty.
+	*/
+	std::int32_t root() const {
+		return (std::int32_t)num_nodes-1;
+	}
+};
+
+
+//! Leaves compare function.
+/*!
+A compare function used to sort the leaves by occurrences, ties are broken by symbol so that
+the tree does not depend on the sort implementation.
+\param first The first leaf to be compared.
+\param second The second leaf to be compared.
+*/
+static bool tree_leaves_compare(const HuffTreeNode& first, const HuffTreeNode& second){
+	if(first.occ != second.occ)
+		return (first.occ < second.occ);
+	return (first.symb < second.symb);
+}
+
+
+//! Creation of the huffman tree function.
+/*!
+A function used to create the huffman tree given the histogram, shared by the sequential and
+parallel classes. It uses the two-queue method, O(n) after sorting the leaves: the internal nodes
+are created with non-decreasing occurrences, so the two nodes with the lowest occurrences are always
+at the front of the leaves queue or of the internal nodes queue.
+\param histo The histogram (256 bins).
+\param tree The output tree.
+*/
+static void create_huffman_tree(const std::uint64_t* histo, HuffmanTree& tree){
+
+	// le foglie, ciascuna con simbolo e occorrenze, ordinate a partire da quelle con probabilita' piu' bassa
+	std::uint32_t n = 0;
+	for(int i=0; i<256; ++i){
+		if(histo[i] > 0){
+			HuffTreeNode leaf = {histo[i], i, -1, -1};
+			tree.nodes[n++] = leaf;
+		}
+	}
+	std::sort(tree.nodes, tree.nodes+n, tree_leaves_compare);
+	tree.num_leaves = n;
+	tree.num_nodes = n;
+
+	// con un solo simbolo la radice e' anche foglia
+	if(n < 2)
+		return;
+
+	// le due code sono le foglie [leaf, n) e i nodi interni [inner, k), a parita' scelgo la foglia
+	std::uint32_t leaf = 0;
+	std::uint32_t inner = n;
+	for(std::uint32_t k=n; k<2*n-1; ++k){
+		std::int32_t child[2];
+		for(int c=0; c<2; ++c){
+			if(leaf < n && (inner == k || tree.nodes[leaf].occ <= tree.nodes[inner].occ))
+				child[c] = (std::int32_t)leaf++;
+			else
+				child[c] = (std::int32_t)inner++;
+		}
+		HuffTreeNode node = {tree.nodes[child[0]].occ + tree.nodes[child[1]].occ, -1, child[0], child[1]};
+		tree.nodes[k] = node;
+	}
+	tree.num_nodes = 2*n-1;
+}
+
+
+//! Code lengths function.
+/*!
+A function used to compute the code length of every symbol, that is the depth of its leaf.
+The children of a node always come before it in the arena, so a single backward pass from the root
+gives every node its depth, without walking the tree.
+\param tree The huffman tree.
+\param lengths The output code lengths, indexed by symbol (256 entries), 0 for the symbols not in the tree.
+*/
+static void code_lengths(const HuffmanTree& tree, std::uint32_t* lengths){
+	std::fill(lengths, lengths+256, 0u);
+	if(tree.num_leaves == 0)
+		return;
+
+	// con un solo simbolo la radice e' anche foglia, gli assegno comunque un codice da 1 bit
+	if(tree.num_leaves == 1){
+		lengths[tree.nodes[0].symb] = 1;
+		return;
+	}
+
+	std::uint32_t depth[HUF_TREE_MAX_NODES];
+	depth[tree.num_nodes-1] = 0;
+	for(std::uint32_t k=tree.num_nodes-1; k>=tree.num_leaves; --k){
+		depth[tree.nodes[k].left] = depth[k]+1;
+		depth[tree.nodes[k].right] = depth[k]+1;
+	}
+	for(std::uint32_t k=0; k<tree.num_leaves; ++k)
+		lengths[tree.nodes[k].symb] = depth[k];
+}
+
+#endif /*HUFFMAN_TREE_H*/
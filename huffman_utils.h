@@ -4,22 +4,69 @@
 #include <vector>
 #include <utility> //pair
 #include <cstdint>
+#include <algorithm>
 
 // Constants
-#define HUF_MAGIC_NUMBER	0x42435001
+#define HUF_MAGIC_NUMBER	0x42435002
+// formato precedente (BCP1): un unico bitstream dopo l'header, viene ancora letto in decompressione
+#define HUF_MAGIC_NUMBER_V1	0x42435001
+// magic number che chiude l'indice dei blocchi in fondo al file ("BCPX")
+#define HUF_INDEX_MAGIC		0x42435058
 
 #define HUF_ONE_GB			1000000000
 #define HUF_ONE_HUNDRED_MB	100000000
 #define HUF_TEN_MB			10000000
 #define HUF_ONE_MB			1000000
+#define HUF_ONE_HUNDRED_KB	100000
 // per leggere l'header stimo che sia lungo al massimo 1 KB
 // 4B per il magic number
 // 4B per la lunghezza del nome del file originale
-// da 0B a 500B per il nome del file vero e proprio (un po' esagerato ma fa lo stesso)
+// da 0B a 488B per il nome del file vero e proprio (un po' esagerato ma fa lo stesso)
+// 8B per la lunghezza del file originale
+// 4B per la dimensione dei blocchi (solo BCP2)
 // 4B per il numero di simboli
 // 512B per il massimo numero possibile di coppie <lunghezza_codice, simbolo>
 #define HUF_HEADER_DIM			1024
 
+// dimensione massima non compressa dei blocchi del formato BCP2, i blocchi possono essere piu' corti
+#define HUF_BLOCK_DIM			HUF_TEN_MB
+// segmenti di cui compress_chunked() conta l'istogramma per scegliere dove finiscono i blocchi:
+// 40 per blocco, al massimo HUF_MAX_SEGMENTS per file (oltre i segmenti diventano piu' lunghi)
+#define HUF_SEGMENT_DIM			(HUF_BLOCK_DIM/40)
+#define HUF_MAX_SEGMENTS		16384
+// segmenti di cui plan_blocks() tiene l'istogramma nello stesso momento (almeno una finestra intera),
+// abbastanza per dividerli tra i core
+#define HUF_PLAN_SEGMENTS		256
+// header di un blocco: 1B tipo, 4B dimensione non compressa, 4B dimensione compressa (header escluso)
+#define HUF_BLOCK_HEADER_DIM	9
+// tipi di blocco
+#define HUF_BLOCK_HUFFMAN		0x00	// codificato con la tabella dell'header del file
+#define HUF_BLOCK_LOCAL			0x01	// codificato con la tabella scritta all'inizio del blocco
+#define HUF_BLOCK_STORED		0x02	// i byte originali copiati cosi' come sono: il blocco non si comprimeva
+#define HUF_BLOCK_END			0xFF	// fine dei blocchi, il contenuto e' l'indice
+// flag aggiunto al tipo (HUFFMAN o LOCAL): i simboli del blocco sono distribuiti a turno su piu' bitstream,
+// dopo l'eventuale tabella ci sono 1B numero di bitstream n e (n-1) x 4B dimensioni dei primi n-1 bitstream
+#define HUF_BLOCK_INTERLEAVED	0x10
+// numero massimo di bitstream interlacciati in un blocco
+#define HUF_MAX_STREAMS			8
+// entry dell'indice: 8B offset non compresso, 8B offset compresso in bit, 8B dimensione compressa
+#define HUF_INDEX_ENTRY_DIM		24
+// chiusura dell'indice: 8B lunghezza del file originale, 8B numero di blocchi, 4B magic number
+#define HUF_INDEX_TRAILER_DIM	20
+// lunghezza del file originale scritta nell'header quando non e' nota (compressione in una passata)
+#define HUF_UNKNOWN_LENGTH		0xFFFFFFFFFFFFFFFFull
+
+// numero predefinito di blocchi in volo nella pipeline di compressione
+#define HUF_PIPELINE_TOKENS		8
+
+// lunghezza massima predefinita dei codici: uguale a HUF_DECODE_ROOT_BITS, ogni simbolo viene
+// decodificato con un solo accesso a una tabella da 2^11 entry (8 KB, sta nella cache L1)
+#define HUF_MAX_CODE_LEN		11
+// limiti della lunghezza massima configurabile: 256 simboli richiedono almeno 8 bit,
+// i codici sono salvati in uint32_t
+#define HUF_MAX_CODE_LEN_MIN	8
+#define HUF_MAX_CODE_LEN_MAX	32
+
 
 //! Element of a DepthMap
 typedef std::pair<std::uint32_t,std::uint32_t> DepthMapElement;
@@ -42,6 +89,60 @@ struct Triplet{
 };
 
 
+//! BlockHeader struct
+/*!
+The header written at the beginning of every block of a BCP2 file.
+*/
+struct BlockHeader{
+	//! The block type (HUF_BLOCK_*).
+	std::uint8_t type;
+	//! The number of original bytes encoded in the block.
+	std::uint32_t dim;
+	//! The number of compressed bytes following the header.
+	std::uint32_t size;
+};
+
+
+//! FileHeader struct
+/*!
+The fields of the header of a compressed file (see Huffman::write_header()), as positions in the
+buffer that holds it so that reading it allocates nothing.
+*/
+struct FileHeader{
+	//! The magic number (HUF_MAGIC_NUMBER or HUF_MAGIC_NUMBER_V1).
+	std::uint32_t magic;
+	//! The position of the original filename.
+	std::uint64_t name_start;
+	//! The length of the original filename, 0 if the header has none.
+	std::uint32_t name_length;
+	//! The length of the original file, HUF_UNKNOWN_LENGTH if the header does not have it (single-pass and BCP1 files).
+	std::uint64_t file_len;
+	//! The length of the blocks, 0 for a BCP1 file (a single bitstream).
+	std::uint32_t block_dim;
+	//! The number of <symbol, length> pairs of the global table.
+	std::uint32_t num_symbols;
+	//! The position of the <symbol, length> pairs.
+	std::uint64_t table_start;
+	//! The position of the first byte after the header.
+	std::uint64_t data_start;
+};
+
+
+//! BlockIndexEntry struct
+/*!
+An entry of the block index written in the footer of a BCP2 file, one for each block.
+Blocks start on a byte boundary and can be decoded independently of each other.
+*/
+struct BlockIndexEntry{
+	//! Position in the original file of the first byte encoded in the block.
+	std::uint64_t uncompressed_offset;
+	//! Position in bits of the block header in the compressed file.
+	std::uint64_t bit_offset;
+	//! Compressed size of the block in bytes, header included.
+	std::uint64_t size;
+};
+
+
 //! Depth compare function.
 /*!
 A function used to compare elements of a depthmap. Used for sorting.
@@ -87,4 +188,106 @@ static void canonical_codes(DepthMap & depthmap, std::vector<Triplet>& codes){
 
 }
 
+
+//! Limit code lengths function.
+/*!
+A function used to bound the code lengths computed from the huffman tree (Kraft-sum repair).
+The codes longer than max_len are cut to max_len, then the longest codes that can still grow are
+made one bit longer until the Kraft sum is back to 1 at most, and the code space left free is given
+back shortening the longest codes. Finally the lengths are reassigned to the symbols by frequency,
+the most frequent symbols get the shortest codes.
+If the tree is already within the limit the lengths are not modified.
+\param lengths The code lengths indexed by symbol (256 entries, 0 if absent), updated in place.
+\param histo The histogram (256 bins) used to build the tree.
+\param max_len The maximum code length, raised to the minimum needed by the number of symbols.
+*/
+static void limit_code_lengths(std::uint32_t* lengths, const std::uint64_t* histo, std::uint32_t max_len){
+	std::uint32_t symbols[256];
+	std::uint32_t n = 0;
+	std::uint32_t longest = 0;
+	for(std::uint32_t s=0; s<256; ++s){
+		if(lengths[s] > 0){
+			symbols[n++] = s;
+			longest = std::max(longest, lengths[s]);
+		}
+	}
+	if(n < 2)
+		return;
+
+	// con n simboli servono almeno ceil(log2(n)) bit
+	std::uint32_t min_len = 0;
+	while((1u<<min_len) < n)
+		min_len++;
+	max_len = std::min(std::max(max_len, min_len), (std::uint32_t)HUF_MAX_CODE_LEN_MAX);
+	if(longest <= max_len)
+		return;
+
+	// conto i codici per lunghezza, quelli troppo lunghi vengono tagliati a max_len
+	std::uint32_t count[HUF_MAX_CODE_LEN_MAX+1] = {0};
+	for(std::uint32_t i=0; i<n; ++i)
+		count[std::min(lengths[symbols[i]], max_len)]++;
+
+	// somma di Kraft in unita' di 2^-max_len, per un codice prefisso non deve superare 2^max_len
+	std::uint64_t one = 1ull<<max_len;
+	std::uint64_t kraft = 0;
+	for(std::uint32_t l=1; l<=max_len; ++l)
+		kraft += (std::uint64_t)count[l] << (max_len-l);
+
+	// allungo di un bit il codice piu' lungo che puo' ancora crescere: e' quello che costa meno
+	while(kraft > one){
+		std::uint32_t l = max_len-1;
+		while(count[l] == 0)
+			l--;
+		count[l]--;
+		count[l+1]++;
+		kraft -= 1ull<<(max_len-l-1);
+	}
+
+	// se ho tolto troppo restituisco lo spazio accorciando i codici piu' lunghi
+	for(std::uint32_t l=max_len; l>1; --l){
+		while(count[l] > 0 && kraft + (1ull<<(max_len-l)) <= one){
+			count[l]--;
+			count[l-1]++;
+			kraft += 1ull<<(max_len-l);
+		}
+	}
+
+	// riassegno le lunghezze: i simboli piu' frequenti prendono i codici piu' corti
+	std::sort(symbols, symbols+n, [histo, lengths](std::uint32_t a, std::uint32_t b){
+		if(histo[a] != histo[b])
+			return histo[a] > histo[b];
+		if(lengths[a] != lengths[b])
+			return lengths[a] < lengths[b];
+		return a < b;
+	});
+	std::uint32_t i = 0;
+	for(std::uint32_t l=1; l<=max_len; ++l)
+		for(std::uint32_t k=0; k<count[l]; ++k)
+			lengths[symbols[i++]] = l;
+}
+
+
+//! Bucket depthmap function.
+/*!
+A function used to build the depthmap sorted by length and symbol, as canonical_codes() wants it,
+from the code lengths: the symbols are scanned in order and placed in the bucket of their length
+(counting sort), no comparison sort is needed.
+\param lengths The code lengths indexed by symbol (256 entries, 0 if absent), at most HUF_MAX_CODE_LEN_MAX.
+\param depthmap The output depthmap.
+*/
+static void bucket_depthmap(const std::uint32_t* lengths, DepthMap& depthmap){
+	// inizio di ogni lunghezza nella depthmap
+	std::uint32_t start[HUF_MAX_CODE_LEN_MAX+2] = {0};
+	for(std::uint32_t s=0; s<256; ++s)
+		if(lengths[s] > 0)
+			start[lengths[s]+1]++;
+	for(std::uint32_t l=1; l<=HUF_MAX_CODE_LEN_MAX+1; ++l)
+		start[l] += start[l-1];
+
+	depthmap.resize(start[HUF_MAX_CODE_LEN_MAX+1]);
+	for(std::uint32_t s=0; s<256; ++s)
+		if(lengths[s] > 0)
+			depthmap[start[lengths[s]]++] = DepthMapElement(lengths[s], s);
+}
+
 #endif //HUFFMAN_UTILS_H
\ No newline at end of file
@@ -5,18 +5,44 @@
 
 #include "par_huffman.h"
 #include "seq_huffman.h"
+#include "huffman_batch.h"
+#include "huffman_timer.h"
+#include "huffman_trace.h"
+#include "huffman_counters.h"
+#include <sstream>
+#if defined(_WIN32)
 #include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 using namespace std;
 using tbb::tick_count;
 
+// tempi delle fasi di un file: la tabella subito, il JSON tutto insieme alla fine
+static void report_file_timer(ostream& console, bool json, const string& name, const HuffmanTimer& file_timer, HuffmanTimer& run_timer, ostringstream& json_files){
+	run_timer.merge(file_timer);
+	if(json){
+		if(!json_files.str().empty())
+			json_files << ", ";
+		file_timer.print_json(json_files, name);
+	} else
+		file_timer.print_table(console, "Stage times of " + name);
+}
 
-int main (int argc, char *argv[]) {
+// contatori hardware di un file: la tabella subito, poi si azzerano per il file successivo
+static void report_file_counters(ostream& console, const string& name, HuffmanCounters& file_counters, HuffmanCounters& run_counters){
+	run_counters.merge(file_counters);
+	file_counters.print_table(console, "Hardware counters of " + name);
+	file_counters.reset();
+}
 
-	system("cls");
+int main (int argc, char *argv[]) {
 
+#if defined(_WIN32)
 	SYSTEM_INFO info_sistema;
 	GetSystemInfo(&info_sistema);
+#endif
 
 	// Check inputs from console
 	CMDLineInterface shell(argc, argv);
@@ -25,41 +51,192 @@ int main (int argc, char *argv[]) {
 		shell.error_message(code);
 		exit(1);
 	}
+
+	// con "-" stdout e' l'output compresso o decompresso: i messaggi vanno su stderr
+	bool streaming = shell.is_streaming();
+	ostream& console = streaming ? cerr : cout;
+#if defined(_WIN32)
+	if(streaming){
+		_setmode(_fileno(stdin), _O_BINARY);
+		_setmode(_fileno(stdout), _O_BINARY);
+	} else
+		system("cls");
+#endif
 	// Get list of input files
 	vector<string> input_files = shell.get_files();
+	int result = 0;
+
+	// memoria per i buffer: --max-memory, altrimenti quella disponibile nel sistema o nel cgroup
+	uint64_t budget = memory_budget(shell.get_max_memory());
+	console << "Memory budget: " << budget/HUF_ONE_MB << " MB" << endl;
+
+	// tempi delle fasi (-t, -v): un timer per file, sommati in quello della run
+	bool timing = shell.is_timer();
+	bool json = shell.is_json();
+	HuffmanTimer run_timer;
+	ostringstream json_files;
+
+	// timeline dei thread (--trace), scritta alla fine della run
+	HuffmanTrace* trace = shell.is_trace() ? new HuffmanTrace() : NULL;
+
+	// contatori hardware delle fasi (--counters): senza perf_event_open (container, Windows) si va avanti senza
+	HuffmanCounters* file_counters = NULL;
+	HuffmanCounters* run_counters = NULL;
+	if(shell.is_counters()){
+		file_counters = new HuffmanCounters();
+		if(file_counters->available())
+			run_counters = new HuffmanCounters();
+		else {
+			console << "Hardware counters not available: " << file_counters->error() << endl;
+			delete file_counters;
+			file_counters = NULL;
+		}
+	}
+
+	if(!shell.get_mode().compare("compression") && shell.is_batch() && !streaming) {
+
+		// BATCH COMPRESSION: tutti i file insieme, nella memoria disponibile
+		HuffmanBatch batch;
+		batch._memory_budget = budget;
+		batch._max_code_len = shell.get_max_code_len();
+		batch._parallel = shell.is_parallel();
+		batch._trace = trace;
+		if(batch.compress(input_files) > 0)
+			result = 1;
 
-	if(!shell.get_mode().compare("compression")) {
+	} else if(!shell.get_mode().compare("compression")) {
 		for(int num_files=0;num_files < input_files.size();++num_files){
+			HuffmanTimer file_timer;
+			TraceSpan file_span(trace, "file");
 
 			if(shell.is_parallel()){ //PARALLEL COMPRESSION
 
-				cout << "Parallel Compressing " << input_files[num_files] << "..." << endl;
+				console << "Parallel Compressing " << input_files[num_files] << "..." << endl;
 
 				ParHuffman par_huff;
-				par_huff.compress_chunked(input_files[num_files]);
+				par_huff._tokens = shell.get_tokens();
+				par_huff._max_code_len = shell.get_max_code_len();
+				par_huff._streams = shell.get_streams();
+				par_huff._memory_budget = budget;
+				par_huff._timer = timing ? &file_timer : NULL;
+				par_huff._trace = trace;
+				par_huff._counters = file_counters;
+				bool ok;
+				if(!input_files[num_files].compare("-"))
+					ok = par_huff.compress_stream(cin, cout, true);
+				else if(shell.is_single_pass())
+					ok = par_huff.compress_single_pass(input_files[num_files], true);
+				else
+					ok = par_huff.compress_chunked(input_files[num_files]);
+				if(!ok)
+					result = 1;
 
 			} else { //SEQUENTIAL COMPRESSION
 
-				cout << "Sequential Compressing " << input_files[num_files] << "..." << endl;
+				console << "Sequential Compressing " << input_files[num_files] << "..." << endl;
 
 				SeqHuffman seq_huff;
-				seq_huff.compress_chunked(input_files[num_files]);
+				seq_huff._tokens = shell.get_tokens();
+				seq_huff._max_code_len = shell.get_max_code_len();
+				seq_huff._streams = shell.get_streams();
+				seq_huff._memory_budget = budget;
+				seq_huff._timer = timing ? &file_timer : NULL;
+				seq_huff._trace = trace;
+				seq_huff._counters = file_counters;
+				bool ok;
+				if(!input_files[num_files].compare("-"))
+					ok = seq_huff.compress_stream(cin, cout, false);
+				else if(shell.is_single_pass())
+					ok = seq_huff.compress_single_pass(input_files[num_files], false);
+				else
+					ok = seq_huff.compress_chunked(input_files[num_files]);
+				if(!ok)
+					result = 1;
 			}
+			if(timing)
+				report_file_timer(console, json, input_files[num_files], file_timer, run_timer, json_files);
+			if(file_counters)
+				report_file_counters(console, input_files[num_files], *file_counters, *run_counters);
 		}
 	} else {// DECOMPRESS
 
 		for(int num_files=0;num_files < input_files.size();++num_files){
+			HuffmanTimer file_timer;
+			TraceSpan file_span(trace, "file");
 
-			SeqHuffman seq_huff;
-			seq_huff.decompress_chunked(input_files[num_files]);
+			if(shell.is_parallel()){ //PARALLEL DECOMPRESSION
 
+				console << "Parallel Decompressing " << input_files[num_files] << "..." << endl;
+
+				ParHuffman par_huff;
+				par_huff._tokens = shell.get_tokens();
+				par_huff._memory_budget = budget;
+				par_huff._timer = timing ? &file_timer : NULL;
+				par_huff._trace = trace;
+				par_huff._counters = file_counters;
+				bool ok;
+				if(!input_files[num_files].compare("-"))
+					ok = par_huff.decompress_stream(cin, cout, true);
+				else
+					ok = par_huff.decompress_chunked(input_files[num_files]);
+				if(!ok)
+					result = 1;
+
+			} else { //SEQUENTIAL DECOMPRESSION
+
+				console << "Sequential Decompressing " << input_files[num_files] << "..." << endl;
+
+				SeqHuffman seq_huff;
+				seq_huff._tokens = shell.get_tokens();
+				seq_huff._memory_budget = budget;
+				seq_huff._timer = timing ? &file_timer : NULL;
+				seq_huff._trace = trace;
+				seq_huff._counters = file_counters;
+				bool ok;
+				if(!input_files[num_files].compare("-"))
+					ok = seq_huff.decompress_stream(cin, cout, false);
+				else
+					ok = seq_huff.decompress_chunked(input_files[num_files]);
+				if(!ok)
+					result = 1;
+			}
+			if(timing)
+				report_file_timer(console, json, input_files[num_files], file_timer, run_timer, json_files);
+			if(file_counters)
+				report_file_counters(console, input_files[num_files], *file_counters, *run_counters);
 		}
 
 	}
 
-	system("pause");
+	if(timing && json){
+		console << "{\"files\": [" << json_files.str() << "], \"run\": ";
+		run_timer.print_json(console, "run");
+		if(run_counters){
+			console << ", \"counters\": ";
+			run_counters->print_json(console);
+		}
+		console << "}" << endl;
+	} else if(timing && input_files.size() > 1)
+		run_timer.print_table(console, "Stage times of the run");
+	if(run_counters && input_files.size() > 1 && !shell.is_batch())
+		run_counters->print_table(console, "Hardware counters of the run");
+	delete file_counters;
+	delete run_counters;
+
+	if(trace){
+		if(trace->write(HUF_TRACE_FILENAME))
+			console << "Trace written in " << HUF_TRACE_FILENAME << endl;
+		else
+			console << "Error: cannot write " << HUF_TRACE_FILENAME << endl;
+		delete trace;
+	}
+
+#if defined(_WIN32)
+	if(!streaming)
+		system("pause");
+#endif
 
-	return(0);
+	return(result);
 
 }
 
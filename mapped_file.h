@@ -0,0 +1,174 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdint>
+#include <string>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//!  MappedFile class is used to read a file without copying it
+/*!
+  This class maps a whole file in memory, read only, so that the histogram and the encoder
+  can read the input straight from the page cache instead of copying every chunk into a vector.
+  The kernel is told that the file is read sequentially, and the next chunk can be requested
+  in advance with willneed().
+*/
+class MappedFile {
+	//! The first byte of the mapping, NULL if nothing is mapped.
+	const std::uint8_t* _data;
+	//! The file length.
+	std::uint64_t _size;
+#if defined(_WIN32)
+	//! The file handle.
+	HANDLE _file;
+	//! The file mapping handle.
+	HANDLE _mapping;
+#else
+	//! The file descriptor.
+	int _fd;
+#endif
+
+	// la mappatura non si copia
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+	//! Constructor.
+	/*!
+	  An empty constructor, nothing is mapped until open() is called.
+	*/
+#if defined(_WIN32)
+	MappedFile() : _data(NULL), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(NULL) {}
+#else
+	MappedFile() : _data(NULL), _size(0), _fd(-1) {}
+#endif
+
+	//! Destructor.
+	~MappedFile() {
+		close();
+	}
+
+	//! Open function
+	/*!
+	  This function maps the whole file in memory. An empty file is opened successfully,
+	  but data() is NULL.
+	  \param filename The file to map.
+	  \return false if the file cannot be opened or mapped.
+	*/
+	bool open(const std::string& filename) {
+		close();
+#if defined(_WIN32)
+		_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (_file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(_file, &size)) {
+			close();
+			return false;
+		}
+		_size = (std::uint64_t)size.QuadPart;
+		if (_size == 0)
+			return true;
+		_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (_mapping == NULL) {
+			close();
+			return false;
+		}
+		_data = (const std::uint8_t*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (_data == NULL) {
+			close();
+			return false;
+		}
+#else
+		_fd = ::open(filename.c_str(), O_RDONLY);
+		if (_fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+			close();
+			return false;
+		}
+		_size = (std::uint64_t)st.st_size;
+		if (_size == 0)
+			return true;
+		void* p = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+		if (p == MAP_FAILED) {
+			close();
+			return false;
+		}
+		_data = (const std::uint8_t*)p;
+		// il file viene letto dall'inizio alla fine: read-ahead aggressivo, pagine lette scartabili
+		madvise(p, _size, MADV_SEQUENTIAL);
+#endif
+		return true;
+	}
+
+	//! Close function
+	/*!
+	  This function unmaps the file and closes it, it is called by the destructor.
+	*/
+	void close() {
+#if defined(_WIN32)
+		if (_data != NULL)
+			UnmapViewOfFile(_data);
+		if (_mapping != NULL)
+			CloseHandle(_mapping);
+		if (_file != INVALID_HANDLE_VALUE)
+			CloseHandle(_file);
+		_mapping = NULL;
+		_file = INVALID_HANDLE_VALUE;
+#else
+		if (_data != NULL)
+			munmap((void*)_data, _size);
+		if (_fd >= 0)
+			::close(_fd);
+		_fd = -1;
+#endif
+		_data = NULL;
+		_size = 0;
+	}
+
+	//! Will need function
+	/*!
+	  This function asks the kernel to start reading a range of the file, so that it is already
+	  in memory when the encoder gets there.
+	  \param offset The position of the range in the file.
+	  \param len The range length.
+	*/
+	void willneed(std::uint64_t offset, std::uint64_t len) {
+		if (_data == NULL || offset >= _size)
+			return;
+		if (len > _size-offset)
+			len = _size-offset;
+#if !defined(_WIN32)
+		// madvise vuole un indirizzo allineato alla pagina
+		std::uint64_t page = (std::uint64_t)sysconf(_SC_PAGESIZE);
+		std::uint64_t begin = offset - offset%page;
+		madvise((void*)(_data+begin), len+(offset-begin), MADV_WILLNEED);
+#endif
+	}
+
+	//! Data function
+	/*!
+	  \return The first byte of the file, NULL if the file is empty or not mapped.
+	*/
+	const std::uint8_t* data() const {
+		return _data;
+	}
+
+	//! Size function
+	/*!
+	  \return The file length.
+	*/
+	std::uint64_t size() const {
+		return _size;
+	}
+};
+
+#endif /*MAPPED_FILE_H*/
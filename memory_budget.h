@@ -0,0 +1,215 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include "huffman_utils.h"
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+// nessun limite trovato
+#define HUF_MEMORY_UNLIMITED		0xFFFFFFFFFFFFFFFFull
+// i limiti cgroup v1 oltre questo valore significano "nessun limite" (PAGE_COUNTER_MAX arrotondato)
+#define HUF_MEMORY_CGROUP_NO_LIMIT	(1ull<<60)
+// memoria lasciata al resto del processo quando il budget non e' esplicito: il 10%, almeno 64 MB
+#define HUF_MEMORY_RESERVE_PERCENT	10
+#define HUF_MEMORY_RESERVE_MIN		(64ull*HUF_ONE_MB)
+// budget usato se il sistema non dice niente (ne' cgroup ne' /proc/meminfo)
+#define HUF_MEMORY_DEFAULT_BUDGET	HUF_ONE_GB
+
+
+//! Read memory value function.
+/*!
+A function used to read a memory size from a cgroup file, which holds a number of bytes or "max".
+\param path The file.
+\return The value, HUF_MEMORY_UNLIMITED if the file is missing, says "max" or holds no limit.
+*/
+static std::uint64_t read_memory_value(const std::string& path){
+	std::ifstream file_in(path);
+	std::string value;
+	if(!(file_in >> value) || value.empty() || value.size() > 20 ||
+		!std::all_of(value.begin(), value.end(), [](char c){return (c >= '0' && c <= '9');}))
+		return HUF_MEMORY_UNLIMITED;
+	std::uint64_t bytes = std::stoull(value);
+	return (bytes >= HUF_MEMORY_CGROUP_NO_LIMIT) ? HUF_MEMORY_UNLIMITED : bytes;
+}
+
+
+//! Cgroup available memory function.
+/*!
+A function used to compute how much memory the process can still allocate before its cgroup (or one of the
+cgroups above it) hits the limit and the OOM killer steps in. The cgroups of the process are read from
+/proc/self/cgroup: with cgroup v2 the limit is memory.max and the usage memory.current, with cgroup v1
+memory.limit_in_bytes and memory.usage_in_bytes of the memory controller.
+Inside a container the cgroup path may not exist in the mounted hierarchy, the root of the hierarchy is
+then the cgroup of the container.
+\return The memory left under the tightest limit, HUF_MEMORY_UNLIMITED if there is no limit (or no cgroup).
+*/
+static std::uint64_t cgroup_available_memory(){
+	std::uint64_t available = HUF_MEMORY_UNLIMITED;
+#if defined(__linux__)
+	std::ifstream cgroup("/proc/self/cgroup");
+	std::string line;
+	while(std::getline(cgroup, line)){
+		// formato: id:controller,controller:percorso, con cgroup v2 la lista dei controller e' vuota
+		std::size_t first = line.find(':');
+		std::size_t second = (first == std::string::npos) ? std::string::npos : line.find(':', first+1);
+		if(second == std::string::npos)
+			continue;
+		std::string controllers = "," + line.substr(first+1, second-first-1) + ",";
+		std::string path = line.substr(second+1);
+
+		std::string root, limit_file, usage_file;
+		if(second == first+1){
+			root = "/sys/fs/cgroup";
+			limit_file = "/memory.max";
+			usage_file = "/memory.current";
+		} else if(controllers.find(",memory,") != std::string::npos){
+			root = "/sys/fs/cgroup/memory";
+			limit_file = "/memory.limit_in_bytes";
+			usage_file = "/memory.usage_in_bytes";
+		} else
+			continue;
+
+		// il limite piu' stretto puo' essere su un cgroup padre: risalgo fino alla radice
+		while(!path.empty() && path != "/"){
+			std::string dir = root + path;
+			std::uint64_t limit = read_memory_value(dir + limit_file);
+			if(limit != HUF_MEMORY_UNLIMITED){
+				std::uint64_t usage = read_memory_value(dir + usage_file);
+				if(usage == HUF_MEMORY_UNLIMITED)
+					usage = 0;
+				available = std::min(available, (limit > usage) ? limit-usage : 0);
+			}
+			path = path.substr(0, path.rfind('/'));
+		}
+		std::uint64_t limit = read_memory_value(root + limit_file);
+		if(limit != HUF_MEMORY_UNLIMITED){
+			std::uint64_t usage = read_memory_value(root + usage_file);
+			if(usage == HUF_MEMORY_UNLIMITED)
+				usage = 0;
+			available = std::min(available, (limit > usage) ? limit-usage : 0);
+		}
+	}
+#endif
+	return available;
+}
+
+
+//! System available memory function.
+/*!
+A function used to ask the operating system how much memory can be allocated without swapping:
+MemAvailable from /proc/meminfo on Linux (free memory plus the cache that can be dropped),
+the available physical memory on Windows.
+\return The available memory, HUF_MEMORY_UNLIMITED if it cannot be read.
+*/
+static std::uint64_t system_available_memory(){
+#if defined(_WIN32)
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if(GlobalMemoryStatusEx(&status))
+		return status.ullAvailPhys;
+#elif defined(__linux__)
+	std::ifstream meminfo("/proc/meminfo");
+	std::string key, unit;
+	std::uint64_t value;
+	std::uint64_t free_kb = HUF_MEMORY_UNLIMITED;
+	while(meminfo >> key >> value){
+		std::getline(meminfo, unit);
+		if(key == "MemAvailable:")
+			return value*1024;
+		// kernel senza MemAvailable (prima del 3.14): uso la memoria libera
+		if(key == "MemFree:")
+			free_kb = value;
+	}
+	if(free_kb != HUF_MEMORY_UNLIMITED)
+		return free_kb*1024;
+#endif
+	return HUF_MEMORY_UNLIMITED;
+}
+
+
+//! Memory budget function.
+/*!
+A function used to decide how much memory the program can use for its buffers.
+With an explicit limit (--max-memory) the budget is that limit, bounded only by the memory left in the
+cgroup: going over it would get the process killed. Otherwise the budget is the memory available in the
+system or in the cgroup, whichever is smaller, minus a reserve for the rest of the process.
+\param max_memory The limit given by the user in bytes, 0 if not given.
+\return The budget in bytes.
+*/
+static std::uint64_t memory_budget(std::uint64_t max_memory){
+	std::uint64_t cgroup = cgroup_available_memory();
+	if(max_memory > 0)
+		return std::min(max_memory, cgroup);
+
+	std::uint64_t available = std::min(system_available_memory(), cgroup);
+	if(available == HUF_MEMORY_UNLIMITED)
+		return HUF_MEMORY_DEFAULT_BUDGET;
+
+	std::uint64_t reserve = std::max(available/100*HUF_MEMORY_RESERVE_PERCENT, (std::uint64_t)HUF_MEMORY_RESERVE_MIN);
+	return (available > 2*reserve) ? available-reserve : available/2;
+}
+
+
+//! Budget macrochunk function.
+/*!
+A function used to size the macrochunks of the histogram pass: while a macrochunk is read the next one
+is prefetched (MappedFile::willneed()), so two of them are resident. They take half of the budget at most.
+\param budget The memory budget.
+\return The length of a macrochunk, between HUF_BLOCK_DIM and HUF_ONE_GB.
+*/
+static std::uint64_t budget_macrochunk_dim(std::uint64_t budget){
+	return std::min(std::max(budget/4, (std::uint64_t)HUF_BLOCK_DIM), (std::uint64_t)HUF_ONE_GB);
+}
+
+
+//! Budget tokens function.
+/*!
+A function used to size a pipeline: the number of blocks in flight is the one asked by the user (--tokens),
+lowered until their buffers fit in the budget.
+\param budget The memory budget.
+\param requested The number of tokens asked.
+\param token_memory The memory used by one block in flight.
+\return The number of tokens, at least 1.
+*/
+static unsigned budget_tokens(std::uint64_t budget, unsigned requested, std::uint64_t token_memory){
+	std::uint64_t fit = (token_memory > 0) ? budget/token_memory : requested;
+	return (unsigned)std::max((std::uint64_t)1, std::min((std::uint64_t)requested, fit));
+}
+
+
+//! Budget microchunks function.
+/*!
+A function used to split the encoding of a block in microchunks, so that the output reserved for a
+microchunk (and its copies, e.g. the private segments of the parallel encoder) fits in the budget of the block.
+\param dim The length of the block.
+\param max_len The longest code length, every symbol takes max_len bits at most.
+\param block_budget The memory available for the block.
+\param copies How many buffers as big as the output of a microchunk are used.
+\return The number of microchunks, at least 1.
+*/
+static std::uint64_t budget_microchunks(std::uint64_t dim, std::uint32_t max_len, std::uint64_t block_budget, unsigned copies){
+	std::uint64_t output = copies*((dim*max_len)/8 + 1);
+	if(block_budget == 0)
+		return std::max(dim, (std::uint64_t)1);
+	std::uint64_t n = 1 + (output-1)/block_budget;
+	return std::min(n, std::max(dim, (std::uint64_t)1));
+}
+
+
+//! Budget decode chunk function.
+/*!
+A function used to size the compressed chunks read by the parallel decompression: a chunk and its
+decoded bytes, up to 8 times longer with 1-bit codes, have to fit in the budget.
+\param budget The memory budget.
+\return The length of a compressed chunk, between HUF_ONE_MB and HUF_ONE_HUNDRED_MB.
+*/
+static std::uint64_t budget_decode_chunk_dim(std::uint64_t budget){
+	return std::min(std::max(budget/9, (std::uint64_t)HUF_ONE_MB), (std::uint64_t)HUF_ONE_HUNDRED_MB);
+}
+
+#endif /*MEMORY_BUDGET_H*/
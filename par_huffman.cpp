@@ -1,27 +1,31 @@
 #include <iostream>
 #include <fstream>
+#include <cstring>
 #include "par_huffman.h"
 #include "par_huffman_utils.h"
 #include "bitwriter.h"
 #include "bitreader.h"
 #include "tbb/tbb.h"
-#include "tbb/concurrent_vector.h"
 
 using namespace std;
 using namespace tbb;
 
-void ParHuffman::compress_chunked(string filename){
+bool ParHuffman::compress_chunked(string filename){
 	// Utility
 	tick_count tt1, tt2;
 	tt1 = tick_count::now();
 
-	// Check for chunking 
-	ifstream file_in(filename, ifstream::in|ifstream::binary|fstream::ate);
-	// Whitespaces are accepted
-	file_in.unsetf (ifstream::skipws);
-	// Check file length
-	uint64_t file_len = (uint64_t) file_in.tellg();
-	uint64_t MAX_LEN = HUF_ONE_GB;
+	// Map the input file, the histogram and the encoder read straight from the mapping
+	MappedFile mapped;
+	uint64_t file_len;
+	const uint8_t* in;
+	if(!open_input(mapped, filename, in, file_len)){
+		cerr << "Error: cannot read " << filename << endl;
+		return false;
+	}
+
+	// Check for chunking, the macrochunks are sized from the memory budget
+	uint64_t MAX_LEN = budget_macrochunk_dim(_memory_budget);
 	cerr << "MAX_LEN: " << MAX_LEN/1000000 << "MB" << endl;
 	uint64_t num_macrochunks = 1;
 	if(file_len > MAX_LEN) 
@@ -31,139 +35,166 @@ void ParHuffman::compress_chunked(string filename){
 	//Initialize parallel object
 	init(filename);
 
-	// Global histogram
+	// Global histogram and blocks
 	TBBHistoReduce tbbhr;
+	vector<BlockPlan> plan;
 
-	// For each macrochunk -> read and histo
-	tick_count th1, th2;
-	th1 = tick_count::now();
-	for(uint64_t k=0; k < num_macrochunks; ++k) {
-		read_file(file_in, k*macrochunk_dim, macrochunk_dim);
-		create_histo(tbbhr, macrochunk_dim);
-		cerr << "\rHuffman computation: " << ((100*(k+1))/num_macrochunks) << "%";
-	}
-	th2 = tick_count::now();
-	if(num_macrochunks==1) cerr << "\rHuffman computation: 100%";
-	//cerr << endl << "Time for all sub-histograms: " << (th2-th1).seconds() << " sec" << endl;
-
-	// For each exceeding byte -> read and histo
-	if(num_macrochunks*macrochunk_dim < file_len){ 
-		read_file(file_in, num_macrochunks*macrochunk_dim, file_len-num_macrochunks*macrochunk_dim);
-		create_histo(tbbhr, (file_len - num_macrochunks*macrochunk_dim));
+	// For each macrochunk -> read, histo and plan the blocks
+	{
+		StageTimer stage(_timer, HUF_STAGE_HISTOGRAM, file_len);
+		for(uint64_t k=0; k < num_macrochunks; ++k) {
+			TraceSpan span(_trace, "histogram chunk", macrochunk_dim);
+			mapped.willneed((k+1)*macrochunk_dim, macrochunk_dim);
+			plan_blocks(in, k*macrochunk_dim, macrochunk_dim, file_len, tbbhr._histo, plan);
+			cerr << "\rHuffman computation: " << ((100*(k+1))/num_macrochunks) << "%";
+		}
+		if(num_macrochunks==1) cerr << "\rHuffman computation: 100%";
+
+		// For each exceeding byte -> read, histo and plan the blocks
+		if(num_macrochunks*macrochunk_dim < file_len){ 
+			plan_blocks(in, num_macrochunks*macrochunk_dim, (file_len - num_macrochunks*macrochunk_dim), file_len, tbbhr._histo, plan);
+		}
 	}
 
 	// crea la mappa dei codici
 	CodeVector codes_map = create_code_map(tbbhr);
 
-	// Write file header
-	BitWriter btw = write_header(codes_map);
+	// nessun blocco usa i codici dell'header (tutti copiati, per esempio): la tabella non si scrive
+	if(!global_table_used(plan, codes_map))
+		codes_map = CodeVector();
 
-	MEMORYSTATUSEX status;
-	status.dwLength = sizeof(status);
-	GlobalMemoryStatusEx(&status);
-	uint64_t available_ram = status.ullAvailPhys;
+	// Write file header
+	BitWriter btw = write_header(codes_map, file_len);
 
 	ofstream output_file(_output_filename, fstream::out|fstream::binary);
 	cerr << endl << "Output filename: " << _output_filename << endl;
 
-	// Write compressed file chunk-by-chunk
-	tick_count tw1, tw2;
-	tw1 = tick_count::now();
-	for(uint64_t k=0; k < num_macrochunks; ++k) {
-		read_file(file_in, k*macrochunk_dim, macrochunk_dim);
-		write_chunks_compressed(available_ram, macrochunk_dim, codes_map, btw);
-		output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
-		_file_out.clear();
-		cerr << "\rWrite compressed file: " << ((100*(k+1))/num_macrochunks) << "%";
-	}
-	if(num_macrochunks==1) cerr << "\rWrite compressed file: 100%";
-	// Write exceeding byte
-	if(num_macrochunks*macrochunk_dim < file_len){ 
-		read_file(file_in, num_macrochunks*macrochunk_dim, file_len-num_macrochunks*macrochunk_dim);
-		write_chunks_compressed(available_ram, file_len-(num_macrochunks*macrochunk_dim), codes_map, btw);
-		output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
-		_file_out.clear();
-	}
+	// Write compressed file block-by-block: read, encode and write overlap in a pipeline
+	btw.sync();
+	write_output(output_file, btw);
+	write_blocks(output_file, mapped, in, file_len, plan, codes_map, true);
+	if(file_len==0) cerr << "\rWrite compressed file: 100%";
+	write_footer(btw, file_len);
 	btw.flush();
-	tw2 = tick_count::now();
-	//cerr << endl << "Time for all writing (buffer): " << (tw2-tw1).seconds() << " sec" << endl;
 
 	// Write on HDD
-	tick_count twhd1, twhd2;
-	twhd1 = tick_count::now();
-	if(_file_out.size() != 0)
-		output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
+	write_output(output_file, btw);
 	output_file.close();
-	file_in.close();
-	twhd2 = tick_count::now();
-	//cerr << "Time for all writing (Hard Disk): " << (twhd2-twhd1).seconds() << " sec" << endl;
+	mapped.close();
 	cerr << endl;
+	if(output_file.fail())
+		cerr << "Error: cannot write " << _output_filename << endl;
 
 	tt2 = tick_count::now();
+	if(_timer)
+		_timer->add(HUF_STAGE_TOTAL, (tt2-tt1).seconds(), file_len);
 	cerr <<  "Total time for compression: " << (tt2-tt1).seconds() << " sec" << endl << endl;
+
+	return !output_file.fail();
 }
 
-void ParHuffman::write_chunks_compressed(uint64_t available_ram, uint64_t macrochunk_dim, CodeVector codes_map, BitWriter& btw){
+void ParHuffman::write_chunks_compressed(uint64_t block_budget, const uint8_t* data, uint64_t macrochunk_dim, CodeVector codes_map, BitWriter& btw){
+
+	if(macrochunk_dim == 0)
+		return;
 
-	uint64_t num_microchunk = 1 + (macrochunk_dim*8-1)/available_ram;
-	if(num_microchunk==0)
-		num_microchunk=1;
-	num_microchunk++; // overprovisioning
+	// ogni microchunk usa due volte il suo output: i segmenti privati e la copia nel bit writer,
+	// i microchunk sono tanti quanti servono perche' stiano nel budget del blocco
+	uint64_t num_microchunk = budget_microchunks(macrochunk_dim, codes_map.max_len(), block_budget, 2);
 	//cerr << "\nNumero di microchunks: " << num_microchunk << endl;
 	uint64_t microchunk_dim = macrochunk_dim/num_microchunk; 
 	//cerr << "Dimensione di un microchunk: " << microchunk_dim/1000000 << " MB" << endl;
 
-	for (size_t i=0; i < num_microchunk; ++i) {
-		vector<pair<uint32_t, uint32_t>> buffer_map(microchunk_dim);
-		parallel_for(blocked_range<int>(i*microchunk_dim, microchunk_dim*(i+1),10000), [&](const blocked_range<int>& range) {
-			pair<uint32_t,uint32_t> element;
-			for( int r=range.begin(); r!=range.end(); ++r ){
-				element = codes_map.codes_vector[_file_in[r]];
-				buffer_map[r-i*microchunk_dim].first = element.first;
-				buffer_map[r-i*microchunk_dim].second = element.second;
-			}
+	for (uint64_t i=0; i < num_microchunk; ++i) {
+		// l'ultimo microchunk comprende anche i byte tagliati dall'approssimazione nella divisione
+		uint64_t begin = i*microchunk_dim;
+		uint64_t end = (i == num_microchunk-1) ? macrochunk_dim : begin+microchunk_dim;
+		if(begin == end)
+			continue;
+
+		// ogni task codifica il proprio segmento in un buffer privato
+		uint64_t num_segments = 1 + (end-begin-1)/HUF_ONE_MB;
+		vector<EncodeSegment> segments(num_segments);
+		{
+			StageTimer stage(_timer, HUF_STAGE_ENCODE, end-begin);
+			parallel_for(blocked_range<uint64_t>(0, num_segments, 1), [&](const blocked_range<uint64_t>& range) {
+				TraceSpan span(_trace, "encode segments", range.size()*HUF_ONE_MB);
+				StageCounters counters(_counters, HUF_STAGE_ENCODE);
+				uint64_t bytes = 0;
+				for(uint64_t s=range.begin(); s!=range.end(); ++s){
+					segments[s].begin = begin + s*HUF_ONE_MB;
+					segments[s].end = min(end, segments[s].begin + HUF_ONE_MB);
+					par_encode_segment(codes_map, data, segments[s]);
+					bytes += segments[s].end - segments[s].begin;
+				}
+				counters.set_bytes(bytes);
+			});
+		}
+		StageTimer stage(_timer, HUF_STAGE_PACK);
+
+		// somma prefissa delle lunghezze: posizione in bit di ogni segmento nell'output
+		uint64_t used = btw.sync();
+		uint64_t total_bits = used + parallel_scan(blocked_range<uint64_t>(0, num_segments), (uint64_t)0,
+			[&](const blocked_range<uint64_t>& range, uint64_t sum, bool is_final) {
+				for(uint64_t s=range.begin(); s!=range.end(); ++s){
+					if(is_final)
+						segments[s].offset = used + sum;
+					sum += segments[s].nbits;
+				}
+				return sum;
+			},
+			[](uint64_t x, uint64_t y) { return x+y; });
 
+		// copio i segmenti al loro posto, poi unisco in ordine i byte condivisi tra due segmenti
+		btw.reserve(total_bits/8 + 1);
+		uint8_t* out = btw.current();
+		parallel_for(blocked_range<uint64_t>(0, num_segments, 1), [&](const blocked_range<uint64_t>& range) {
+			TraceSpan span(_trace, "stitch segments");
+			for(uint64_t s=range.begin(); s!=range.end(); ++s)
+				par_stitch_segment(out, segments[s]);
 		});
-		for (size_t j = 0; j < microchunk_dim; j++)
-			btw.write(buffer_map[j].first, buffer_map[j].second);
-		buffer_map.clear();
-	}
-	// Legge la parte del file che viene tagliata dall'approssimazione nella divisione in chunks
-	pair<uint32_t,uint32_t> element;
-	//cerr << "Scrivo un byte avanzato, infatti (num_microchunk*microchunk_dim)=" << num_microchunk*microchunk_dim << " < file_len=" << macrochunk_dim << endl;
-	for (size_t i=num_microchunk*microchunk_dim; i < macrochunk_dim; i++){
-		element = codes_map.codes_vector[_file_in[i]];
-		btw.write(element.first, element.second);
+		{
+			TraceSpan span(_trace, "stitch heads");
+			for(uint64_t s=0; s<num_segments; ++s)
+				par_stitch_head(out, segments[s]);
+		}
+
+		btw.advance(total_bits-used);
+		stage.set_bytes((total_bits-used)/8);
 	}
 }
 
 
-void ParHuffman::create_histo(TBBHistoReduce& tbbhr, uint64_t chunk_dim){
+void ParHuffman::create_histo(TBBHistoReduce& tbbhr, const uint8_t* data, uint64_t chunk_dim){
 	// Creazione dell'istogramma in parallelo con parallel_reduce
-	parallel_reduce(blocked_range<uint8_t*>(_file_in.data(),_file_in.data()+chunk_dim), tbbhr);
+	tbbhr._trace = _trace;
+	tbbhr._counters = _counters;
+	parallel_reduce(blocked_range<const uint8_t*>(data,data+chunk_dim,HUF_ONE_HUNDRED_KB), tbbhr);
 }
 
 CodeVector ParHuffman::create_code_map(TBBHistoReduce& tbbhr){
-	// utili per ottimizzazione
-	tick_count t0, t1;
+	StageTimer stage(_timer, HUF_STAGE_TREE);
+	StageCounters counters(_counters, HUF_STAGE_TREE);
+	TraceSpan span(_trace, "tree");
 
-	// creo un vettore che conterr le foglie dell'albero di huffman, ciascuna con simbolo e occorrenze
-	t0 = tick_count::now();
-	TBBLeavesVector leaves_vect;
-	par_create_huffman_tree(tbbhr._histo, leaves_vect);
-	//par_create_huffman_tree(histo, leaves_vect);
-	t1 = tick_count::now();
-	//cerr << endl << "[PAR] La creazione dell'albero ha impiegato " << (t1 - t0).seconds() << " sec" << endl;
+	// creo l'albero di huffman nell'arena, sullo stack: nessuna allocazione per nodo
+	HuffmanTree tree;
+	create_huffman_tree(tbbhr._histo.data(), tree);
 
-	leaves_vect[0]->setRoot(true);
+	// file vuoto: non c'e' nessun simbolo da codificare
+	if(tree.num_leaves == 0)
+		return CodeVector();
 
-	// creo una depthmap, esplorando tutto l'albero, per sapere a che profondit si trovano i simboli
-	// la depthmap contiene le coppie <lunghezza_simbolo, simbolo>
-	DepthMap depthmap;
-	par_depth_assign(leaves_vect[0], depthmap);
+	// calcolo le lunghezze dei codici con una sola passata all'indietro sull'arena
+	uint32_t lengths[256];
+	code_lengths(tree, lengths);
+
+	// su input molto sbilanciati l'albero puo' essere piu' profondo del limite
+	limit_code_lengths(lengths, tbbhr._histo.data(), _max_code_len);
 
-	// ordino la depthmap per profondit 
-	sort(depthmap.begin(), depthmap.end(), depth_compare);
+	// depthmap <lunghezza_codice, simbolo> gia' ordinata per lunghezza e simbolo
+	DepthMap depthmap;
+	bucket_depthmap(lengths, depthmap);
 
 	// creo i codici canonici usando la depthmap e li scrivo in codes
 	vector<Triplet> codes;
@@ -180,6 +211,274 @@ CodeVector ParHuffman::create_code_map(TBBHistoReduce& tbbhr){
 	return codes_map;
 }
 
-void ParHuffman::decompress_chunked (string filename) {
+CodeVector ParHuffman::create_block_code_map(Histo& histo){
+	TBBHistoReduce tbbhr;
+	tbbhr._histo = histo;
+	return create_code_map(tbbhr);
+}
+
+void ParHuffman::segment_histos(const uint8_t* in, vector<BlockPlan>& segments, Histo& histo){
+	// un istogramma per segmento in parallelo con parallel_reduce, ogni segmento e' scritto da un solo body
+	TBBSegmentReduce tbbsr(in, segments);
+	tbbsr._trace = _trace;
+	tbbsr._counters = _counters;
+	parallel_reduce(blocked_range<size_t>(0, segments.size()), tbbsr);
+	for(size_t i=0; i<256; ++i)
+		histo[i] += tbbsr._histo[i];
+}
+
+uint64_t ParHuffman::decode_chunk(const HuffmanDecoder& decoder, uint64_t start_bit, uint64_t max_symbols){
+
+	const uint8_t* buf = _file_in.data();
+	uint64_t end_bit = _file_in.size()*8;
+	uint64_t segment_bits = HUF_ONE_HUNDRED_KB*8;
+
+	// divido il bitstream in segmenti, l'ultimo arriva fino alla fine del chunk
+	size_t num_segments = 1;
+	if(end_bit > start_bit)
+		num_segments = 1 + (end_bit-start_bit-1)/segment_bits;
+	vector<DecodeSegment> segments(num_segments);
+	for(size_t i=0; i<num_segments; ++i){
+		segments[i].begin = start_bit + i*segment_bits;
+		segments[i].end = min(segments[i].begin + segment_bits, end_bit);
+		segments[i].start = segments[i].begin;
+	}
+	segments.back().end = end_bit;
+
+	// decodifica speculativa: ogni segmento parte dal suo primo bit
+	parallel_for(blocked_range<size_t>(0, num_segments), [&](const blocked_range<size_t>& range) {
+		TraceSpan span(_trace, "decode segments");
+		StageCounters counters(_counters, HUF_STAGE_DECODE);
+		uint64_t bytes = 0;
+		for(size_t i=range.begin(); i!=range.end(); ++i){
+			par_decode_segment(decoder, buf, end_bit, segments[i]);
+			bytes += segments[i].symbols.size();
+		}
+		counters.set_bytes(bytes);
+	});
+
+	// sincronizzazione: il primo segmento e' sicuramente corretto, ogni segmento che non parte
+	// dove finisce il precedente viene decodificato di nuovo, finche' non ci sono piu' differenze
+	vector<size_t> redo;
+	do{
+		redo.clear();
+		for(size_t i=1; i<num_segments; ++i)
+			if(segments[i].start != segments[i-1].exit)
+				redo.push_back(i);
+		// aggiorno prima tutte le partenze, cosi' non dipendono dall'ordine di esecuzione dei task
+		for(size_t k=redo.size(); k-->0; )
+			segments[redo[k]].start = segments[redo[k]-1].exit;
+		parallel_for(blocked_range<size_t>(0, redo.size()), [&](const blocked_range<size_t>& range) {
+			TraceSpan span(_trace, "redecode segments");
+			// lavoro rifatto: i cicli contano, i byte sono gia' stati contati
+			StageCounters counters(_counters, HUF_STAGE_DECODE);
+			for(size_t k=range.begin(); k!=range.end(); ++k)
+				par_decode_segment(decoder, buf, end_bit, segments[redo[k]]);
+		});
+	} while(!redo.empty());
+
+	// calcolo la posizione di ogni segmento nell'output e copio i simboli
+	vector<uint64_t> offsets(num_segments+1, 0);
+	for(size_t i=0; i<num_segments; ++i)
+		offsets[i+1] = offsets[i] + segments[i].symbols.size();
+	uint64_t tot_symbols = min(offsets[num_segments], max_symbols);
+	_file_out.resize(tot_symbols);
 
+	parallel_for(blocked_range<size_t>(0, num_segments), [&](const blocked_range<size_t>& range) {
+		TraceSpan span(_trace, "copy segments");
+		for(size_t i=range.begin(); i!=range.end(); ++i){
+			if(offsets[i] >= tot_symbols)
+				continue;
+			uint64_t n = min<uint64_t>(segments[i].symbols.size(), tot_symbols-offsets[i]);
+			if(n != 0)
+				memcpy(&_file_out[offsets[i]], segments[i].symbols.data(), n);
+		}
+	});
+
+	return segments.back().exit;
+}
+
+bool ParHuffman::decompress_chunked (string filename) {
+	// Utility
+	tick_count tt1, tt2;
+	tt1 = tick_count::now();
+
+	ifstream file_in(filename, ifstream::in|ifstream::binary|fstream::ate);
+	// Whitespaces are accepted
+	file_in.unsetf (ifstream::skipws);
+	uint64_t compressed_len = (uint64_t) file_in.tellg();
+
+	cerr << "Reading the header..." << endl << endl;
+	DepthMap depthmap;
+	uint64_t file_len;
+	uint32_t block_dim;
+	uint64_t data_start = read_header(file_in, depthmap, file_len, block_dim);
+	default_output_filename(filename);
+	uint64_t index_len;
+
+	// creo il file di output
+	ofstream output_file(_output_filename, fstream::out|fstream::binary);
+
+	uint64_t decoded = 0;
+	if(block_dim == 0){
+		// BCP1: la lunghezza non e' nell'header, decodifico tutti i codici interi fino alla fine dei dati
+		if(!depthmap.empty()){
+			HuffmanDecoder decoder(depthmap);
+			decoded = decode_bitstream(file_in, output_file, decoder, data_start, compressed_len, HUF_UNKNOWN_LENGTH);
+		}
+		file_len = decoded;
+	}
+	else if(file_len > 0){
+		HuffmanDecoder decoder(depthmap);
+		// l'indice dice quanto leggere e quanto allocare per ogni chunk: lo controllo tutto prima di usarlo
+		// (in single-pass la lunghezza del file originale e' scritta solo nell'indice)
+		if(!read_index(file_in, compressed_len, index_len))
+			cerr << "Error: block index not found" << endl;
+		else if((file_len != HUF_UNKNOWN_LENGTH && file_len != index_len) || !check_index(data_start, compressed_len, index_len, block_dim))
+			cerr << "Error: corrupted block index" << endl;
+		else {
+			file_len = index_len;
+			decoded = decode_blocks(file_in, output_file, decoder, file_len);
+		}
+	}
+	cerr << endl;
+
+	if(decoded != file_len)
+		cerr << "Error: corrupted file, " << decoded << " bytes decoded out of " << file_len << endl;
+
+	file_in.close();
+	output_file.close();
+
+	tt2 = tick_count::now();
+	if(_timer)
+		_timer->add(HUF_STAGE_TOTAL, (tt2-tt1).seconds(), decoded);
+	cerr <<  "Total time for decompression: " << (tt2-tt1).seconds() << " sec" << endl << endl;
+
+	return decoded == file_len;
+}
+
+uint64_t ParHuffman::decode_bitstream(ifstream& file_in, ofstream& output_file, const HuffmanDecoder& decoder, uint64_t data_start, uint64_t compressed_len, uint64_t file_len){
+
+	// Check for chunking, ogni chunk viene diviso in segmenti decodificati in parallelo
+	uint64_t MAX_LEN = budget_decode_chunk_dim(_memory_budget);
+	cerr << "Chunk dim: " << MAX_LEN << ", data start offset: " << data_start << endl << endl;
+
+	uint64_t decoded = 0;
+	uint64_t chunk_start = data_start;
+	uint64_t start_bit = 0;
+	while(decoded < file_len && chunk_start < compressed_len){
+		// leggo un chunk che riparte dal byte che contiene il primo codice non ancora decodificato
+		TraceSpan span(_trace, "decode chunk");
+		read_file(file_in, chunk_start, min(MAX_LEN, compressed_len-chunk_start));
+		uint64_t pos;
+		{
+			StageTimer stage(_timer, HUF_STAGE_DECODE);
+			pos = decode_chunk(decoder, start_bit, file_len-decoded);
+			stage.set_bytes(_file_out.size());
+		}
+		decoded += _file_out.size();
+
+		// scrivo su file _file_out e lo svuoto
+		if(_file_out.size() != 0){
+			StageTimer stage(_timer, HUF_STAGE_WRITE, _file_out.size());
+			output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
+		}
+		_file_out.clear();
+
+		// se non ho avanzato di almeno un byte il file e' finito (o e' corrotto)
+		if(pos/8 == 0)
+			break;
+		chunk_start += pos/8;
+		start_bit = pos%8;
+		cerr << "\rParallel decompression: " << ((100*(chunk_start-data_start))/(compressed_len-data_start)) << "%";
+	}
+	return decoded;
+}
+
+uint64_t ParHuffman::decode_blocks(ifstream& file_in, ofstream& output_file, const HuffmanDecoder& decoder, uint64_t file_len){
+
+	// ogni chunk contiene blocchi interi fino a circa MAX_LEN byte compressi, decodificati in parallelo
+	uint64_t MAX_LEN = budget_decode_chunk_dim(_memory_budget);
+	cerr << "Chunk dim: " << MAX_LEN << ", blocks: " << _index.size() << endl << endl;
+
+	uint64_t decoded = 0;
+	size_t first = 0;
+	while(first < _index.size()){
+		uint64_t chunk_start = _index[first].bit_offset/8;
+		size_t last = first+1;
+		while(last < _index.size() && _index[last].bit_offset/8 + _index[last].size - chunk_start <= MAX_LEN)
+			last++;
+		uint64_t chunk_end = _index[last-1].bit_offset/8 + _index[last-1].size;
+
+		uint64_t out_start = _index[first].uncompressed_offset;
+		uint64_t out_end = (last < _index.size()) ? _index[last].uncompressed_offset : file_len;
+		if(out_end < out_start || out_end > file_len)
+			break;
+
+		TraceSpan span(_trace, "decode chunk", out_end-out_start);
+		read_file(file_in, chunk_start, chunk_end-chunk_start);
+		_file_out.resize(out_end-out_start);
+
+		tbb::atomic<uint64_t> bad_blocks;
+		bad_blocks = 0;
+		{
+			StageTimer stage(_timer, HUF_STAGE_DECODE, out_end-out_start);
+			if(last-first == 1){
+				// un solo blocco nel chunk: lo divido in segmenti con la decodifica speculativa
+				// (solo con la tabella globale, un blocco con la sua tabella viene decodificato da un solo thread)
+				BlockHeader bh = parse_block_header(_file_in.data());
+				if(bh.dim != out_end-out_start || HUF_BLOCK_HEADER_DIM + bh.size > _file_in.size())
+					bad_blocks++;
+				else if(bh.type == HUF_BLOCK_HUFFMAN && !decoder.empty()){
+					if(decode_chunk(decoder, HUF_BLOCK_HEADER_DIM*8, bh.dim) == 0 || _file_out.size() != bh.dim)
+						bad_blocks++;
+				}
+				else {
+					StageCounters counters(_counters, HUF_STAGE_DECODE, bh.dim);
+					if(!decode_block(&_file_in[HUF_BLOCK_HEADER_DIM], bh, decoder, _file_out.data()))
+						bad_blocks++;
+				}
+			} else {
+				parallel_for(blocked_range<size_t>(first, last, 1), [&](const blocked_range<size_t>& range) {
+					TraceSpan span(_trace, "decode blocks");
+					StageCounters counters(_counters, HUF_STAGE_DECODE);
+					uint64_t bytes = 0;
+					for(size_t i=range.begin(); i!=range.end(); ++i){
+						uint64_t block_start = _index[i].bit_offset/8 - chunk_start;
+						uint64_t block_end = (i+1 < _index.size()) ? _index[i+1].uncompressed_offset : file_len;
+						uint64_t dim = block_end - _index[i].uncompressed_offset;
+						bytes += dim;
+						if(block_start + HUF_BLOCK_HEADER_DIM > _file_in.size()){
+							bad_blocks++;
+							continue;
+						}
+						BlockHeader bh = parse_block_header(&_file_in[block_start]);
+						if(bh.dim != dim || block_start + HUF_BLOCK_HEADER_DIM + bh.size > _file_in.size()){
+							bad_blocks++;
+							continue;
+						}
+						if(!decode_block(&_file_in[block_start+HUF_BLOCK_HEADER_DIM], bh, decoder, &_file_out[_index[i].uncompressed_offset-out_start]))
+							bad_blocks++;
+					}
+					counters.set_bytes(bytes);
+				});
+			}
+		}
+		if(bad_blocks != 0){
+			cerr << endl << "Error: " << bad_blocks << " corrupted blocks" << endl;
+			break;
+		}
+
+		// scrivo su file _file_out e lo svuoto
+		if(_file_out.size() != 0){
+			StageTimer stage(_timer, HUF_STAGE_WRITE, _file_out.size());
+			output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
+		}
+		decoded += _file_out.size();
+		_file_out.clear();
+
+		first = last;
+		cerr << "\rParallel decompression: " << ((100*decoded)/file_len) << "%";
+	}
+	return decoded;
 }
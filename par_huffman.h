@@ -3,6 +3,8 @@
 
 #include "bitwriter.h"
 #include "huffman.h"
+#include "huffman_decoder.h"
+#include "huffman_histo.h"
 #include "tbb/tbb.h"
 
 #include <map>
@@ -12,33 +14,31 @@
   This class is used to compute an histogram over a blocked range using TBB
   parallel_reduce function, in order to run the computation on all the available
   cores in the computer.
+  Every body owns its histogram, so the counters are plain 64-bit integers filled
+  by histo_accumulate() and summed only when two bodies are joined.
 */
 struct TBBHistoReduce{
 	//! Histogram vector.
     /*! This vector contains the histogram's bin. */
-	std::vector<tbb::atomic<std::uint32_t>> _histo; 
+	Histo _histo;
+	//! The trace of the ranges, NULL if tracing is off.
+	HuffmanTrace* _trace;
+	//! The hardware counters of the ranges, NULL if they are off.
+	HuffmanCounters* _counters;
 
 	//! Constructor.
     /*!
       An empty constructor, it creates the object and initializes data and the histogram vector
     */
-	TBBHistoReduce() {
-		tbb::atomic<uint32_t> j;
-		j = 0;
-		_histo.assign(256,j);
-	}
+	TBBHistoReduce() : _histo(256, 0), _trace(NULL), _counters(NULL) {}
 
 	// non penso serva documentazione per questi costruttori/metodi, visto che sono di servizio
-	TBBHistoReduce(TBBHistoReduce& tbbhr, tbb::split) {
-		tbb::atomic<uint32_t> j;
-		j = 0;
-		_histo.assign(256,j);
-	}
+	TBBHistoReduce(TBBHistoReduce& tbbhr, tbb::split) : _histo(256, 0), _trace(tbbhr._trace), _counters(tbbhr._counters) {}
 
-	void operator()(const tbb::blocked_range<std::uint8_t*>& r){
-		for(std::uint8_t* u=r.begin(); u!=r.end(); ++u)
-			_histo[*u]++;
-		
+	void operator()(const tbb::blocked_range<const std::uint8_t*>& r){
+		TraceSpan span(_trace, "histogram range", r.size());
+		StageCounters counters(_counters, HUF_STAGE_HISTOGRAM, r.size());
+		histo_accumulate(r.begin(), r.size(), _histo.data());
 	}
 
 	void join(TBBHistoReduce& tbbhr){
@@ -47,6 +47,54 @@ struct TBBHistoReduce{
 	}
 };
 
+//! TBBSegmentReduce class, used to compute the histograms of the segments in parallel threads
+/*!
+  This class is used by ParHuffman::segment_histos() with TBB parallel_reduce over a range of segments:
+  every segment gets its own histogram, written only by the body that counts it, and the body sums
+  the segments it counted in its histogram of the file, joined as in TBBHistoReduce.
+*/
+struct TBBSegmentReduce{
+	//! Histogram vector, the sum of the segments counted by this body.
+	Histo _histo;
+	//! The input file content.
+	const std::uint8_t* _in;
+	//! The segments, every one holds its histogram.
+	std::vector<BlockPlan>* _segments;
+	//! The trace of the ranges, NULL if tracing is off.
+	HuffmanTrace* _trace;
+	//! The hardware counters of the ranges, NULL if they are off.
+	HuffmanCounters* _counters;
+
+	//! Constructor.
+    /*!
+      \param in The input file content.
+	  \param segments The segments.
+    */
+	TBBSegmentReduce(const std::uint8_t* in, std::vector<BlockPlan>& segments) : _histo(256, 0), _in(in), _segments(&segments), _trace(NULL), _counters(NULL) {}
+
+	TBBSegmentReduce(TBBSegmentReduce& tbbsr, tbb::split) : _histo(256, 0), _in(tbbsr._in), _segments(tbbsr._segments), _trace(tbbsr._trace), _counters(tbbsr._counters) {}
+
+	void operator()(const tbb::blocked_range<std::size_t>& r){
+		std::uint64_t bytes = 0;
+		for(std::size_t s=r.begin(); s!=r.end(); ++s)
+			bytes += (*_segments)[s].dim;
+		TraceSpan span(_trace, "segment histograms", bytes);
+		StageCounters counters(_counters, HUF_STAGE_HISTOGRAM, bytes);
+		for(std::size_t s=r.begin(); s!=r.end(); ++s){
+			BlockPlan& seg = (*_segments)[s];
+			seg.histo.assign(256, 0);
+			histo_accumulate(_in + seg.offset, seg.dim, seg.histo.data());
+			for(std::size_t i=0; i<256; ++i)
+				_histo[i] += seg.histo[i];
+		}
+	}
+
+	void join(TBBSegmentReduce& tbbsr){
+		for(std::size_t i=0; i<256; ++i)
+			_histo[i] += tbbsr._histo[i];
+	}
+};
+
 //! ParHuffman class, used to compress and decompress using TBB parallel functions
 /*!
   This class is used to compress and decompress files using TBB library.
@@ -61,9 +109,10 @@ public:
     /*!
 	  This function computes the histogram over a specific chunk using a TBBHistoReduce object and TBB's parallel reduce
       \param histo The TBBHistoReduce object used to create the histogram.
+	  \param data The chunk.
 	  \param chunk_dim The chunk length.
     */
-	void create_histo(TBBHistoReduce& histo, std::uint64_t chunk_dim);
+	void create_histo(TBBHistoReduce& histo, const std::uint8_t* data, std::uint64_t chunk_dim);
 	
 	//! Create code map function
     /*!
@@ -71,18 +120,50 @@ public:
       \param tbbhr The histogram object.
 	  \return returns a map that contains symbols, canonical codes and codes lengths( <symbol, <code, code_len>>).
     */
-	CodeVector ParHuffman::create_code_map(TBBHistoReduce& tbbhr);
+	CodeVector create_code_map(TBBHistoReduce& tbbhr);
+
+	//! Create block code map function
+    /*!
+	  This function assigns the canonical codes to the symbols of a single block, used by the single-pass mode.
+      \param histo The histogram of the block.
+	  \return The codes map of the block.
+    */
+	CodeVector create_block_code_map(Histo& histo);
+
+	//! Segment histograms function
+    /*!
+	  This function counts the histograms of the segments of plan_blocks() in parallel, using a TBBSegmentReduce object and TBB's parallel reduce.
+      \param in The input file content.
+	  \param segments The segments, their histograms are filled.
+	  \param histo The histogram of the file, the counts of the segments are added to it.
+    */
+	void segment_histos(const std::uint8_t* in, std::vector<BlockPlan>& segments, Histo& histo);
 	
 	//! Write compressed chunks function
     /*!
 	  This function write a compressed chunk of the original file into the output vector.
 	  NOTE: this function does not write anything on the hard drive.
-      \param available_ram A uint64_t containing the total amount of available ram.
+      \param block_budget The memory available to encode the block, it sets the number of microchunks.
+	  \param data The current file chunk to compress.
 	  \param macrochunk_dim A uint64_t containing the length of the current file chunk to compress.
 	  \param codes_map The codes map computed from the histogram.
 	  \param btw A reference to the bit writer object used to write to the output vector.
     */
-	void write_chunks_compressed(std::uint64_t available_ram, std::uint64_t macrochunk_dim, CodeVector codes_map, BitWriter& btw);
+	void write_chunks_compressed(std::uint64_t block_budget, const std::uint8_t* data, std::uint64_t macrochunk_dim, CodeVector codes_map, BitWriter& btw);
+
+	//! Decode chunk function
+    /*!
+	  This function decodes in parallel all the whole codes contained in the _file_in vector and
+	  writes the symbols into the _file_out vector.
+	  The bitstream is split into segments that are decoded speculatively on all the cores, then
+	  the segments that did not start on a code boundary are decoded again until all of them agree.
+      \param decoder The canonical decoder built from the header.
+	  \param start_bit The bit position of the first code in the _file_in vector.
+	  \param max_symbols The maximum number of symbols to decode, it drops the padding at the end of the file.
+	  \return The bit position right after the last code decoded.
+    */
+	std::uint64_t decode_chunk(const HuffmanDecoder& decoder, std::uint64_t start_bit, std::uint64_t max_symbols);
+
 
 	//! Compress function
     /*!
@@ -97,18 +178,45 @@ public:
     /*!
 	  This function compresses the the given file.
       \param filename The current file's name.
+	  \return false if the file cannot be read or the compressed file cannot be written.
     */
-	void compress_chunked(std::string filename);
+	bool compress_chunked(std::string filename);
 	
 	//! Chunked decompress function
     /*!
 	  This function decompresses the the given file.
       \param filename The current file's name.
+	  \return false if the file is truncated or corrupted.
     */
-	void decompress_chunked(std::string filename);
+	bool decompress_chunked(std::string filename);
 
 private:
 
+	//! Decode bitstream function
+    /*!
+	  This function decodes the single bitstream of a BCP1 file, one chunk at a time, using decode_chunk().
+      \param file_in The compressed file.
+	  \param output_file The decompressed file.
+	  \param decoder The canonical decoder built from the header.
+	  \param data_start The offset of the bitstream.
+	  \param file_len The number of symbols to decode, HUF_UNKNOWN_LENGTH to decode every whole code up to the end of the file.
+	  \param file_len The length of the original file.
+	  \return The number of decoded bytes.
+    */
+	std::uint64_t decode_bitstream(std::ifstream& file_in, std::ofstream& output_file, const HuffmanDecoder& decoder, std::uint64_t data_start, std::uint64_t compressed_len, std::uint64_t file_len);
+
+	//! Decode blocks function
+    /*!
+	  This function decodes the blocks of a BCP2 file listed in _index: the blocks are read a chunk at a time
+	  and the blocks of a chunk are decoded in parallel, each one straight into its position in the output.
+      \param file_in The compressed file.
+	  \param output_file The decompressed file.
+	  \param decoder The canonical decoder built from the header.
+	  \param file_len The length of the original file.
+	  \return The number of decoded bytes.
+    */
+	std::uint64_t decode_blocks(std::ifstream& file_in, std::ofstream& output_file, const HuffmanDecoder& decoder, std::uint64_t file_len);
+
 };
 
 #endif /*PAR_HUFFMAN_H*/
\ No newline at end of file
@@ -6,120 +6,138 @@
 #include <map>
 #include <algorithm>
 #include "tbb/tbb.h"
-#include "tbb/concurrent_vector.h"
 #include "tbb/parallel_reduce.h"
 #include "tbb/blocked_range.h"
-#include "par_huffman_node.h"
+#include "huffman_tree.h"
+#include "huffman_histo.h"
 
 
 //---------------------------------------------------------------------------------------------
 // ----------- DEFINITIONS AND METHODS FOR PARALLEL EXECUTION----------------------------------
 //---------------------------------------------------------------------------------------------
 
-//! A histogram implemented using TBB's data types.
-typedef std::vector<tbb::atomic<std::uint32_t>> TBBHisto;
-//! A leaves vector implemented using TBB's concurrent_vector.
-typedef tbb::concurrent_vector<ParHuffNode*> TBBLeavesVector;
-
-
-//! Parallel creation of the huffman tree function.
+//! EncodeSegment struct
 /*!
-A function used to create the huffman tree given the histogram.
-\param histo The histogram of the input file.
-\param leaves_vect The vector containing the tree's leaves.
+A struct representing a range of the input that is encoded by a single task into a private buffer.
+The position of the segment in the output bitstream is computed by a prefix sum of the segment lengths,
+then the private bits are shifted to that position.
 */
-void par_create_huffman_tree(TBBHisto histo, TBBLeavesVector& leaves_vect){
-
-	// creo un vettore che conterr le foglie dell'albero di huffman, ciascuna con simbolo e occorrenze
-	parallel_for(tbb::blocked_range<int>( 0, histo.size()), [&](const tbb::blocked_range<int>& range) {
-		for( int i=range.begin(); i!=range.end(); ++i ){
-			if(histo[i] > 0){
-				tbb::atomic<int> j;
-				j = i;
-				leaves_vect.push_back(new ParHuffNode(j,histo[i]));
-			}
-		}
-	});
-
-	// ordino le foglie per occorrenze, in modo da partire da quelle con probabilit pi bassa
-	std::sort(leaves_vect.begin(), leaves_vect.end(), ParHuffNode::leaves_compare);
-
-	/* Dal momento che i concurrent vector non supportano pop_back() n insert,
-	copio i dati in un vector per il pezzo critico, poi li rimetto nel concurrent_vector
-	NB: vec  un normalissimo std::vector											*/
-	std::vector<ParHuffNode*> vec;
-	vec.assign(leaves_vect.begin(), leaves_vect.end());
-
-	// Creazione dell'albero utilizzando std::vector anzich tbb::concurrent_vector
-	while(vec.size() > 1){
-		// scelgo i due nodi con probabilit minore
-		ParHuffNode* node1;
-		ParHuffNode* node2;
-		node1 = vec.back();
-
-		vec.pop_back(); 
-		node2 = vec.back();
-		vec.pop_back(); 
-
-		unsigned tot_occ = node1->getOcc() + node2->getOcc();
-
-		// Il template tbb::atomic non ha un costruttore in fase di dichiarazione
-		// Occorre prima dichiarare, poi inizializzare (vedi anche sotto)
-		tbb::atomic<unsigned> atomic_tot_occ;
-		atomic_tot_occ = tot_occ;
-
-		tbb::atomic<int> j;
-		j = -1;
-
-		// inserisco il nodo padre nella posizione giusta in base alle probabilit
-		for(unsigned i=0; i<vec.size(); ++i){
-
-			if(vec[i]->getOcc() <= tot_occ){
-				vec.insert(vec.begin()+i, new ParHuffNode(j, atomic_tot_occ, false, node1, node2));
-				break;
-			} else if(i == vec.size()-1){
-				vec.insert(vec.begin()+(i+1), new ParHuffNode(j, atomic_tot_occ, false, node1, node2)); 
-				break;
-			}
-		}
-
-		// se sono arrivato alla fine creo la root
-		if(vec.size() == 0)	vec.push_back(new ParHuffNode(j, atomic_tot_occ, false, node1, node2));
+struct EncodeSegment{
+	//! Position of the first input byte.
+	std::uint64_t begin;
+	//! Position after the last input byte.
+	std::uint64_t end;
+	//! Length in bits of the encoded segment.
+	std::uint64_t nbits;
+	//! Bit position of the segment in the output, relative to the first byte written.
+	std::uint64_t offset;
+	//! The encoded bits, starting at bit 0 and padded with zeros.
+	std::vector<std::uint8_t> bits;
+};
+
+//! Parallel encode segment function.
+/*!
+A function used to encode a segment of the input into the private buffer of the segment.
+\param codes_map The codes map.
+\param in The input buffer.
+\param seg The segment to encode.
+*/
+static void par_encode_segment(const CodeVector& codes_map, const std::uint8_t* in, EncodeSegment& seg){
+	BitWriter btw(seg.bits);
+	btw.reserve(((seg.end-seg.begin)*codes_map.max_len())/8 + 1);
+	for(std::uint64_t i=seg.begin; i<seg.end; ++i){
+		const std::pair<std::uint32_t, std::uint32_t>& element = codes_map.codes_vector[in[i]];
+		btw.write(element.first, (std::uint8_t)element.second);
 	}
-	// Creato l'albero, rimetto i valori nel concurrent_vector originario
-	leaves_vect.clear();
-	leaves_vect.assign(vec.begin(), vec.end());
-
+	seg.nbits = btw.tell_bit();
+	btw.flush();
 }
 
-//! Parallel depth assign function.
+//! Parallel stitch segment function.
 /*!
-A function used to the depth values to each node of the huffman tree.
-It's a recursive function that explores the tree depth-first.
-\param tbb_huff_node The current node.
-\param depthmap The map that will contain the depth values.
+A function used to copy the bits of an encoded segment to its position in the output.
+Every output byte is written by the segment holding its first bit, so the segments can be
+stitched in parallel; the first byte of a segment that does not start on a byte boundary
+is shared with the previous segment and it is left to par_stitch_head().
+\param out The output buffer, out[0] is the byte containing the bit at offset 0.
+\param seg The segment to copy.
 */
-void par_depth_assign(ParHuffNode* tbb_huff_node, DepthMap & depthmap){
-	if(tbb_huff_node->isLeaf()){
-		depthmap.push_back(DepthMapElement(tbb_huff_node->getDepth(), tbb_huff_node->getSymb()));
+static void par_stitch_segment(std::uint8_t* out, const EncodeSegment& seg){
+	if(seg.nbits == 0)
+		return;
+	std::uint64_t first = (seg.offset+7)>>3;
+	std::uint64_t last = (seg.offset+seg.nbits-1)>>3;
+	// ogni byte di output e' uno shift a cavallo di due byte del buffer privato
+	std::uint32_t shift = (std::uint32_t)((8 - (seg.offset&7)) & 7);
+	std::uint64_t size = seg.bits.size();
+	const std::uint8_t* src = seg.bits.data();
+	if(shift == 0){
+		memcpy(out+first, src, last-first+1);
 		return;
-	} else {
-		if(tbb_huff_node->isRoot()){
-			tbb_huff_node->getLeft()->setDepth(1);
-			tbb_huff_node->getRight()->setDepth(1);
+	}
+	for(std::uint64_t j=first; j<=last; ++j){
+		std::uint64_t k = j-first;
+		std::uint8_t lo = (k+1 < size) ? src[k+1] : 0;
+		out[j] = (std::uint8_t)((src[k]<<shift) | (lo>>(8-shift)));
+	}
+}
 
-			par_depth_assign(tbb_huff_node->getLeft(), depthmap);
-			par_depth_assign(tbb_huff_node->getRight(), depthmap);
-		} else {
-			tbb_huff_node->getLeft()->setDepth(tbb_huff_node->getDepth());
-			tbb_huff_node->getLeft()->increaseDepth(1);
-			tbb_huff_node->getRight()->setDepth(tbb_huff_node->getDepth());
-			tbb_huff_node->getRight()->increaseDepth(1);
+//! Parallel stitch head function.
+/*!
+A function used to merge the first bits of a segment with the last byte of the bits before it.
+It must be called in order on the segments, after par_stitch_segment().
+\param out The output buffer, out[0] is the byte containing the bit at offset 0.
+\param seg The segment.
+*/
+static void par_stitch_head(std::uint8_t* out, const EncodeSegment& seg){
+	std::uint32_t used = (std::uint32_t)(seg.offset&7);
+	if(seg.nbits == 0 || used == 0)
+		return;
+	std::uint8_t& b = out[seg.offset>>3];
+	b = (std::uint8_t)((b & (0xff<<(8-used))) | (seg.bits[0]>>used));
+}
 
-			par_depth_assign(tbb_huff_node->getLeft(), depthmap);
-			par_depth_assign(tbb_huff_node->getRight(), depthmap);
-		}
-	}
+//! DecodeSegment struct
+/*!
+A struct representing a segment of the compressed bitstream that is decoded by a single task.
+The position of the first code inside the segment is not known in advance: the segment is first
+decoded speculatively from its first bit, then decoded again from the exit position of the previous
+segment until the two positions match (huffman codes resynchronize after a few symbols).
+*/
+struct DecodeSegment{
+	//! Bit position where the segment begins.
+	std::uint64_t begin;
+	//! Bit position where the segment ends, the code crossing this position belongs to the segment.
+	std::uint64_t end;
+	//! Bit position from which the segment has been decoded.
+	std::uint64_t start;
+	//! Bit position right after the last code decoded, it is the start of the next segment.
+	std::uint64_t exit;
+	//! The decoded symbols.
+	std::vector<std::uint8_t> symbols;
+};
+
+//! Parallel decode segment function.
+/*!
+A function used to decode a segment from its start position, the symbols and the exit position
+are saved in the segment itself.
+\param decoder The canonical decoder.
+\param buf The compressed bitstream.
+\param end_bit The position of the first bit after the end of the bitstream.
+\param seg The segment to decode.
+*/
+static void par_decode_segment(const HuffmanDecoder& decoder, const std::uint8_t* buf, std::uint64_t end_bit, DecodeSegment& seg){
+	// i codici che iniziano nel segmento sono al massimo (end-start)/min_len, arrotondato per eccesso
+	std::uint64_t max_symbols = 1;
+	if(seg.end > seg.start)
+		max_symbols += (seg.end-seg.start)/decoder.min_len();
+	seg.symbols.resize(max_symbols);
+
+	BitReader btr(buf, end_bit/8);
+	btr.seek_bit(seg.start);
+	std::uint64_t n = decoder.decode_run(btr, seg.end, seg.symbols.data(), max_symbols);
+	seg.symbols.resize(n);
+	seg.exit = btr.tell_bit();
 }
 
-#endif /*PAR_HUFFMAN_UTILS_H*/
\ No newline at end of file
+#endif /*PAR_HUFFMAN_UTILS_H*/
@@ -4,30 +4,37 @@
 #include "bitreader.h"
 #include "tbb/tbb.h"
 #include "seq_huffman.h"
+#include "huffman_decoder.h"
 #include "seq_huffman_utils.h"
 
 using namespace std;
 using namespace tbb;
 
-void SeqHuffman::create_histo(vector<uint32_t>& histo, uint64_t chunk_dim){
-	for(size_t i=0; i<chunk_dim; ++i)
-		histo[_file_in[i]]++;
+void SeqHuffman::create_histo(Histo& histo, const uint8_t* data, uint64_t chunk_dim){
+	histo_accumulate(data, chunk_dim, histo.data());
 }
 
-CodeVector SeqHuffman::create_code_map(vector<uint32_t>& histo){
-	tick_count t0, t1;
-	t0 = tick_count::now();
-	LeavesVector leaves_vect;
-	seq_create_huffman_tree(histo, leaves_vect);
-	t1 = tick_count::now();
-	//cerr << "[SEQ] La creazione dell'albero ha impiegato " << (t1 - t0).seconds() << " sec" << endl;
+CodeVector SeqHuffman::create_code_map(Histo& histo){
+	StageTimer stage(_timer, HUF_STAGE_TREE);
+	StageCounters counters(_counters, HUF_STAGE_TREE);
+	TraceSpan span(_trace, "tree");
+	HuffmanTree tree;
+	create_huffman_tree(histo.data(), tree);
 
-	leaves_vect[0]->setRoot(true);
-	DepthMap depthmap;
-	seq_depth_assign(leaves_vect[0], depthmap);
+	// file vuoto: non c'e' nessun simbolo da codificare
+	if(tree.num_leaves == 0)
+		return CodeVector();
+
+	// calcolo le lunghezze dei codici con una sola passata all'indietro sull'arena
+	uint32_t lengths[256];
+	code_lengths(tree, lengths);
+
+	// su input molto sbilanciati l'albero puo' essere piu' profondo del limite
+	limit_code_lengths(lengths, histo.data(), _max_code_len);
 
-	// ordino la depthmap per profondit 
-	sort(depthmap.begin(), depthmap.end(), depth_compare);
+	// depthmap <lunghezza_codice, simbolo> gia' ordinata per lunghezza e simbolo
+	DepthMap depthmap;
+	bucket_depthmap(lengths, depthmap);
 
 	// creo i codici canonici usando la depthmap e li scrivo in codes
 	vector<Triplet> codes;
@@ -44,50 +51,70 @@ CodeVector SeqHuffman::create_code_map(vector<uint32_t>& histo){
 	return codes_map;
 }
 
+CodeVector SeqHuffman::create_block_code_map(Histo& histo){
+	return create_code_map(histo);
+}
 
-void SeqHuffman::write_chunks_compressed(std::uint64_t available_ram, std::uint64_t macrochunk_dim, CodeVector codes_map, BitWriter& btw){
+void SeqHuffman::segment_histos(const uint8_t* in, vector<BlockPlan>& segments, Histo& histo){
+	for(size_t s=0; s<segments.size(); ++s){
+		BlockPlan& seg = segments[s];
+		seg.histo.assign(256, 0);
+		histo_accumulate(in + seg.offset, seg.dim, seg.histo.data());
+		for(size_t i=0; i<256; ++i)
+			histo[i] += seg.histo[i];
+	}
+}
+
+
+void SeqHuffman::write_chunks_compressed(std::uint64_t block_budget, const std::uint8_t* data, std::uint64_t macrochunk_dim, CodeVector codes_map, BitWriter& btw){
 
-	uint64_t num_microchunk = 1 + (macrochunk_dim*8-1)/available_ram;
-	if(num_microchunk==0)
-		num_microchunk=1;
-	num_microchunk++; // overprovisioning
+	if(macrochunk_dim == 0)
+		return;
+	// un solo bit writer: i codici vengono impacchettati mentre si codifica
+	StageTimer stage(_timer, HUF_STAGE_ENCODE, macrochunk_dim);
+	StageCounters counters(_counters, HUF_STAGE_ENCODE, macrochunk_dim);
+
+	// ogni microchunk occupa al massimo microchunk_dim*max_len bit, riservo lo spazio una volta sola:
+	// i microchunk sono tanti quanti servono perche' lo spazio riservato stia nel budget del blocco
+	uint32_t max_len = codes_map.max_len();
+	uint64_t num_microchunk = budget_microchunks(macrochunk_dim, max_len, block_budget, 1);
 	//cerr << "\nNumero di microchunks: " << num_microchunk << endl;
 	uint64_t microchunk_dim = macrochunk_dim/num_microchunk; 
 	//cerr << "Dimensione di un microchunk: " << microchunk_dim/1000000 << " MB" << endl;
 
 	for (size_t i=0; i < num_microchunk; ++i) {
-		vector<pair<uint32_t, uint32_t>> buffer_map(microchunk_dim);
+		btw.reserve((microchunk_dim*max_len)/8 + 1);
 		pair<uint32_t,uint32_t> element;
-		for( int r=i*microchunk_dim; r<(microchunk_dim*(i+1)); ++r ){
-			element = codes_map.codes_vector[_file_in[r]];
-			buffer_map[r-i*microchunk_dim].first = element.first;
-			buffer_map[r-i*microchunk_dim].second = element.second;
+		for( uint64_t r=i*microchunk_dim; r<(microchunk_dim*(i+1)); ++r ){
+			element = codes_map.codes_vector[data[r]];
+			btw.write(element.first, element.second);
 		}
-
-		for (size_t j = 0; j < microchunk_dim; j++)
-			btw.write(buffer_map[j].first, buffer_map[j].second);
-		buffer_map.clear();
 	}
 	// Legge la parte del file che viene tagliata dall'approssimazione nella divisione in chunks
 	pair<uint32_t,uint32_t> element;
+	btw.reserve(((macrochunk_dim-num_microchunk*microchunk_dim)*max_len)/8 + 1);
 	for (size_t i=num_microchunk*microchunk_dim; i < macrochunk_dim; i++){
-		element = codes_map.codes_vector[_file_in[i]];
+		element = codes_map.codes_vector[data[i]];
 		btw.write(element.first, element.second);
 	}
 }
 
-void SeqHuffman::compress_chunked(string filename){
+bool SeqHuffman::compress_chunked(string filename){
 	// Utility
 	tick_count tt1, tt2;
 	tt1 = tick_count::now();
 
-	// Check for chunking 
-	ifstream file_in(filename, ifstream::in|ifstream::binary|fstream::ate);
-	// Whitespaces are accepted
-	file_in.unsetf (ifstream::skipws);
-	// Check file length
-	uint64_t file_len = (uint64_t) file_in.tellg();
-	uint64_t MAX_LEN = HUF_ONE_GB; 
+	// Map the input file, the histogram and the encoder read straight from the mapping
+	MappedFile mapped;
+	uint64_t file_len;
+	const uint8_t* in;
+	if(!open_input(mapped, filename, in, file_len)){
+		cerr << "Error: cannot read " << filename << endl;
+		return false;
+	}
+
+	// Check for chunking, the macrochunks are sized from the memory budget
+	uint64_t MAX_LEN = budget_macrochunk_dim(_memory_budget);
 	cerr << "MAX_LEN: " << MAX_LEN/1000000 << "MB" << endl;
 	uint64_t num_macrochunks = 1;
 	if(file_len > MAX_LEN) 
@@ -97,246 +124,217 @@ void SeqHuffman::compress_chunked(string filename){
 	//Initialize sequential object
 	init(filename);
 
-	// Global histogram
-	vector<uint32_t> histo(256);
+	// Global histogram and blocks
+	Histo histo(256, 0);
+	vector<BlockPlan> plan;
+
+	// For each macrochunk -> read, histo and plan the blocks
+	{
+		StageTimer stage(_timer, HUF_STAGE_HISTOGRAM, file_len);
+		StageCounters counters(_counters, HUF_STAGE_HISTOGRAM, file_len);
+		for(uint64_t k=0; k < num_macrochunks; ++k) {
+			TraceSpan span(_trace, "histogram chunk", macrochunk_dim);
+			mapped.willneed((k+1)*macrochunk_dim, macrochunk_dim);
+			plan_blocks(in, k*macrochunk_dim, macrochunk_dim, file_len, histo, plan);
+			cerr << "\rHuffman computation: " << ((100*(k+1))/num_macrochunks) << "%";
+		}
+		if(num_macrochunks==1) cerr << "\rHistogram computation: 100%";
 
-	// For each macrochunk -> read and histo
-	tick_count th1, th2;
-	th1 = tick_count::now();
-	for(uint64_t k=0; k < num_macrochunks; ++k) {
-		read_file(file_in, k*macrochunk_dim, macrochunk_dim);
-		create_histo(histo, macrochunk_dim);
-		cerr << "\rHuffman computation: " << ((100*(k+1))/num_macrochunks) << "%";
-	}
-	th2 = tick_count::now();
-	if(num_macrochunks==1) cerr << "\rHistogram computation: 100%";
-	//cerr << endl << "Time for all sub-histograms: " << (th2-th1).seconds() << " sec" << endl << endl;
-
-	// For each exceeding byte -> read and histo
-	if(num_macrochunks*macrochunk_dim < file_len){ 
-		read_file(file_in, num_macrochunks*macrochunk_dim, file_len-num_macrochunks*macrochunk_dim);
-		create_histo(histo, (file_len - num_macrochunks*macrochunk_dim));
+		// For each exceeding byte -> read, histo and plan the blocks
+		if(num_macrochunks*macrochunk_dim < file_len){ 
+			plan_blocks(in, num_macrochunks*macrochunk_dim, (file_len - num_macrochunks*macrochunk_dim), file_len, histo, plan);
+		}
 	}
 
 	// Create vector <code, len_code> - index i is the symbol
 	CodeVector codes_map = create_code_map(histo);
 
-	// Write file header
-	BitWriter btw = write_header(codes_map);
+	// nessun blocco usa i codici dell'header (tutti copiati, per esempio): la tabella non si scrive
+	if(!global_table_used(plan, codes_map))
+		codes_map = CodeVector();
 
-	MEMORYSTATUSEX status;
-	status.dwLength = sizeof(status);
-	GlobalMemoryStatusEx(&status);
-	uint64_t available_ram = status.ullAvailPhys;
+	// Write file header
+	BitWriter btw = write_header(codes_map, file_len);
 
 	ofstream output_file(_output_filename, fstream::out|fstream::binary);
 	cerr << endl << "Output filename: " << _output_filename << endl;
 
-	// Write compressed file chunk-by-chunk
-	tick_count tw1, tw2;
-	tw1 = tick_count::now();
-	for(uint64_t k=0; k < num_macrochunks; ++k) {
-		read_file(file_in, k*macrochunk_dim, macrochunk_dim);
-		write_chunks_compressed(available_ram, macrochunk_dim, codes_map, btw);
-		output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
-		_file_out.clear();
-		cerr << "\rWrite compressed file: " << ((100*(k+1))/num_macrochunks) << "%";
-	}
-	if(num_macrochunks==1) cerr << "\rWrite compressed file: 100%";
-	// Write exceeding byte
-	if(num_macrochunks*macrochunk_dim < file_len){ 
-		read_file(file_in, num_macrochunks*macrochunk_dim, file_len-num_macrochunks*macrochunk_dim);
-		write_chunks_compressed(available_ram, file_len-(num_macrochunks*macrochunk_dim), codes_map, btw);
-		output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
-		_file_out.clear();
-	}
+	// Write compressed file block-by-block: read, encode and write overlap in a pipeline
+	btw.sync();
+	write_output(output_file, btw);
+	write_blocks(output_file, mapped, in, file_len, plan, codes_map, false);
+	if(file_len==0) cerr << "\rWrite compressed file: 100%";
+	write_footer(btw, file_len);
 	btw.flush();
-	tw2 = tick_count::now();
-	//cerr << endl << "Time for all writing (buffer): " << (tw2-tw1).seconds() << " sec" << endl;
 
 	// Write on HDD
-	tick_count twhd1, twhd2;
-	twhd1 = tick_count::now();
-	if(_file_out.size() != 0)
-		output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
+	write_output(output_file, btw);
 	output_file.close();
-	file_in.close();
-	twhd2 = tick_count::now();
-	//cerr << "Time for all writing (Hard Disk): " << (twhd2-twhd1).seconds() << " sec" << endl;
+	mapped.close();
 	cerr << endl;
+	if(output_file.fail())
+		cerr << "Error: cannot write " << _output_filename << endl;
 
 	tt2 = tick_count::now();
+	if(_timer)
+		_timer->add(HUF_STAGE_TOTAL, (tt2-tt1).seconds(), file_len);
 	cerr << "Total time for compression: " <<  (tt2 - tt1).seconds() << " sec" << endl << endl;
+
+	return !output_file.fail();
 }
 
-void SeqHuffman::decompress_chunked (string filename){
+bool SeqHuffman::decompress_chunked (string filename){
+	// Utility
+	tick_count tt1, tt2;
+	tt1 = tick_count::now();
 
-	// Check for chunking 
 	ifstream file_in(filename, ifstream::in|ifstream::binary|fstream::ate);
 	// Whitespaces are accepted
 	file_in.unsetf (ifstream::skipws);
-
-	// leggo quanto basta per leggere tutto l'header
-	read_file(file_in, 0, HUF_HEADER_DIM);
-
-	BitReader btr(_file_in);
-	BitWriter btw(_file_out);
+	uint64_t compressed_len = (uint64_t) file_in.tellg();
 
 	cerr << "Reading the header..." << endl << endl;
-	// leggo il magic number
-	uint32_t magic_number = btr.read(32);
-	if(magic_number != HUF_MAGIC_NUMBER){
-		cerr << "Error: unknown format, wrong magic number..." << endl;
-		exit(1);
-	}
-
-	// leggo la lunghezza del nome del file
-	uint32_t fname_length = btr.read(32);
-	// leggo il nome del file originale e setto output filename
-	vector<uint8_t> fname = btr.read_n_bytes(fname_length);
-	_output_filename.assign(fname.begin(), fname.end());
+	DepthMap depthmap;
+	uint64_t file_len;
+	uint32_t block_dim;
+	uint64_t data_start = read_header(file_in, depthmap, file_len, block_dim);
+	default_output_filename(filename);
 
 	// creo il file di output
 	ofstream output_file(_output_filename, fstream::out|fstream::binary);
 
-	// leggo il numero di simboli totali
-	uint32_t tot_symbols = btr.read(32);
-
-	// creo un vettore di coppie <lunghezza_simbolo, simbolo>
-	// In realt legge coppie <simbolo, lunghezza_codice>, non viceversa!!! come fa a funzionare???
-	DepthMap depthmap;
-	for(unsigned i=0; i<tot_symbols; ++i)
-		depthmap.push_back(DepthMapElement(btr.read(8), btr.read(8)));
-
-	// creo i codici canonici usando la depthmap e li scrivo in codes
-	vector<Triplet> codes;
-	canonical_codes(depthmap, codes);
-
-	// crea una mappa <codice, <simbolo, lunghezza_codice>>
-	map<uint32_t, pair<uint8_t,uint32_t>> codes_map; 
-	for(unsigned i=0; i<codes.size(); ++i)
-		codes_map.insert(pair<uint32_t, pair<uint8_t,uint32_t>>(codes[i].code,pair<uint8_t,uint32_t>(codes[i].symbol, codes[i].code_len)));
-
-	// segno da dove partono i dati e resetto il bitreader e _file_in per partire direttamente dai dati
-	uint32_t data_start = btr.tell_index();
-	_file_in.clear();
-	btr.reset_index();
-
-	// Check for chunking
-	// Check file length
-	file_in.seekg(0, ios::end);
-	uint64_t file_len = (uint64_t) file_in.tellg() - data_start;
-	uint64_t MAX_LEN = HUF_TEN_MB; 
-	uint64_t num_macrochunks = 1;
-	if(file_len > MAX_LEN) 
-		num_macrochunks = 1 + (file_len-1)/ MAX_LEN;
-	uint64_t macrochunk_dim = file_len / num_macrochunks;
+	cerr << "Decompression start" << endl;
+	uint64_t decoded = 0;
+	if(block_dim == 0){
+		// BCP1: la lunghezza non e' nell'header, decodifico tutti i codici interi fino alla fine dei dati
+		if(!depthmap.empty()){
+			HuffmanDecoder decoder(depthmap);
+			decoded = decode_bitstream(file_in, output_file, decoder, data_start, compressed_len, HUF_UNKNOWN_LENGTH);
+		}
+		file_len = decoded;
+	}
+	else if(file_len > 0){
+		HuffmanDecoder decoder(depthmap);
+		decoded = decode_blocks(file_in, output_file, decoder, data_start, compressed_len, file_len);
+	}
+	cerr << endl;
 
-	cerr << "Chunks partitioning:" << endl;
-	cerr << "Macrochunks number: " << num_macrochunks << ", macrochunk dim: " << macrochunk_dim << endl;
-	cerr << "Data start offset: " << data_start << endl << endl;
+	if(decoded != file_len)
+		cerr << "Error: corrupted file, " << decoded << " bytes decoded out of " << file_len << endl;
 
-	// riporto il file all'inizio dei dati
-	//file_in.seekg(data_start, ios::beg);
+	file_in.close();
+	output_file.close();
 
-	// leggo il file compresso e scrivo l'output
-	read_file(file_in, data_start, macrochunk_dim);
+	tt2 = tick_count::now();
+	if(_timer)
+		_timer->add(HUF_STAGE_TOTAL, (tt2-tt1).seconds(), decoded);
+	cerr << "Total time for decompression: " << (tt2-tt1).seconds() << " sec" << endl << endl;
 
-	bool reload = false;
-	uint32_t tmp_code = 0;
-	uint32_t tmp_code_len = depthmap[0].first;
-	tmp_code = btr.read(depthmap[0].first);
+	return decoded == file_len;
+}
 
-	cerr << "Decompression start" << endl;
-	for(unsigned i=0; i<num_macrochunks; ++i){
-		cerr << "Decompressing macrochunk n " << i+1 << endl;
-		// leggo un macrochunk rispettando l'offset di inizio dei dati, il primo giro no perch _file_in  gi stato riempito
-		if(i!=0){
-			// svuoto _file_in
-			_file_in.clear();
-			btr.reset_index();
-			read_file(file_in, data_start + (i * macrochunk_dim), macrochunk_dim);
-		}
+uint64_t SeqHuffman::decode_bitstream(ifstream& file_in, ofstream& output_file, const HuffmanDecoder& decoder, uint64_t data_start, uint64_t compressed_len, uint64_t file_len){
 
-		while(btr.good()){
-			//tmp_code = btr.read(depthmap[0].first);
-
-			while(codes_map.find(tmp_code) == codes_map.end() || (codes_map.find(tmp_code) != codes_map.end() && tmp_code_len != codes_map[tmp_code].second )){
-				if(!btr.good()){
-					reload = true;	
-					break;
-				}
-
-				tmp_code = (tmp_code << 1) | (1 & btr.read_bit());
-				tmp_code_len++;
-			}
-
-			if(!reload){
-				// se esco dal while ho trovato un codice, lo leggo, e lo scrivo sul file di output
-				pair<uint32_t,uint32_t> tmp_sym_pair = codes_map[tmp_code];
-				btw.write(tmp_sym_pair.first, 8); 
-
-				tmp_code = 0;
-				tmp_code_len = depthmap[0].first;
-				tmp_code = btr.read(depthmap[0].first);
-			}
-			else break;
+	// Check for chunking
+	uint64_t MAX_LEN = HUF_TEN_MB;
+	cerr << "Chunk dim: " << MAX_LEN << ", data start offset: " << data_start << endl << endl;
+
+	uint64_t decoded = 0;
+	uint64_t chunk_start = data_start;
+	uint64_t start_bit = 0;
+	while(decoded < file_len && chunk_start < compressed_len){
+		// leggo un chunk che riparte dal byte che contiene il primo codice non ancora decodificato
+		TraceSpan span(_trace, "decode chunk");
+		read_file(file_in, chunk_start, min(MAX_LEN, compressed_len-chunk_start));
+		uint64_t end_bit = _file_in.size()*8;
+		BitReader btr(_file_in);
+		btr.seek_bit(start_bit);
+
+		// decodifico tutti i codici interi contenuti nel chunk, l'ultimo codice a cavallo
+		// con il chunk successivo verra' letto al prossimo giro.
+		// Ogni codice e' lungo almeno min_len bit, quindi so quanti simboli posso trovare al massimo
+		uint64_t max_symbols = min(file_len-decoded, (end_bit-start_bit)/decoder.min_len());
+		uint64_t n;
+		{
+			StageTimer stage(_timer, HUF_STAGE_DECODE);
+			StageCounters counters(_counters, HUF_STAGE_DECODE);
+			_file_out.resize(max_symbols);
+			n = decoder.decode_run(btr, end_bit, _file_out.data(), max_symbols);
+			_file_out.resize(n);
+			stage.set_bytes(n);
+			counters.set_bytes(n);
 		}
-
-		reload = false;
+		decoded += n;
+		uint64_t pos = btr.tell_bit();
 
 		// scrivo su file _file_out e lo svuoto
-		// cerr << _file_out[_file_out.size()-5] << _file_out[_file_out.size()-4] << _file_out[_file_out.size()-3] << _file_out[_file_out.size()-2] << _file_out[_file_out.size()-1] << endl;
-		output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
+		if(_file_out.size() != 0){
+			StageTimer stage(_timer, HUF_STAGE_WRITE, _file_out.size());
+			output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
+		}
 		_file_out.clear();
 
-	}
-
-	// leggo e decomprimo i byte avanzati se ce ne sono
-	// tolto l'offset da file_len
-	file_len += data_start;
-
-	if( data_start+(num_macrochunks*macrochunk_dim) < file_len ){ 
-		cerr << endl << "Exceeding bytes decompression:" << endl;
-		cerr << "Exceeding bytes: " << file_len - (data_start+(num_macrochunks*macrochunk_dim)) << endl;
+		// se non ho avanzato di almeno un byte il file e' finito (o e' corrotto)
+		if(pos/8 == 0)
+			break;
 
-		_file_in.clear();
-		btr.reset_index();
-		read_file(file_in, data_start+(num_macrochunks*macrochunk_dim), file_len - (data_start+(num_macrochunks*macrochunk_dim)));
-
-		while(btr.good()){
+		chunk_start += pos/8;
+		start_bit = pos%8;
+		cerr << "\rDecompression: " << ((100*(chunk_start-data_start))/(compressed_len-data_start)) << "%";
+	}
+	return decoded;
+}
 
-			while(codes_map.find(tmp_code) == codes_map.end() || (codes_map.find(tmp_code) != codes_map.end() && tmp_code_len != codes_map[tmp_code].second )){
-				tmp_code = (tmp_code << 1) | (1 & btr.read_bit());
-				tmp_code_len++;
-			}
+uint64_t SeqHuffman::decode_blocks(ifstream& file_in, ofstream& output_file, const HuffmanDecoder& decoder, uint64_t data_start, uint64_t compressed_len, uint64_t& file_len){
+
+	uint64_t decoded = 0;
+	uint64_t block_start = data_start;
+	while(block_start+HUF_BLOCK_HEADER_DIM <= compressed_len){
+		// leggo l'header del blocco, il blocco di chiusura contiene solo l'indice
+		TraceSpan span(_trace, "decode block");
+		read_file(file_in, block_start, HUF_BLOCK_HEADER_DIM);
+		BlockHeader bh = parse_block_header(_file_in.data());
+		if(block_start+HUF_BLOCK_HEADER_DIM+bh.size > compressed_len){
+			cerr << endl << "Error: truncated block at offset " << block_start << endl;
+			break;
+		}
+		read_file(file_in, block_start+HUF_BLOCK_HEADER_DIM, bh.size);
+
+		if(bh.type == HUF_BLOCK_END){
+			// in single-pass la lunghezza del file originale e' scritta solo nell'indice
+			uint64_t index_len;
+			if(parse_index(_file_in.data(), _file_in.size(), index_len) && file_len == HUF_UNKNOWN_LENGTH)
+				file_len = index_len;
+			break;
+		}
+		if(bh.dim > file_len-decoded){
+			cerr << endl << "Error: unknown block at offset " << block_start << endl;
+			break;
+		}
 
-			// se esco dal while ho trovato un codice, lo leggo, e lo scrivo sul file di output
-			pair<uint32_t,uint32_t> tmp_sym_pair = codes_map[tmp_code];
-			btw.write(tmp_sym_pair.first, 8); 
+		// i blocchi iniziano a un byte intero e contengono solo codici interi
+		bool ok;
+		{
+			StageTimer stage(_timer, HUF_STAGE_DECODE, bh.dim);
+			StageCounters counters(_counters, HUF_STAGE_DECODE, bh.dim);
+			_file_out.resize(bh.dim);
+			ok = decode_block(_file_in.data(), bh, decoder, _file_out.data());
+		}
+		if(!ok){
+			cerr << endl << "Error: corrupted block at offset " << block_start << endl;
+			break;
+		}
+		decoded += bh.dim;
 
-			tmp_code = 0;
-			tmp_code_len = depthmap[0].first;
-			tmp_code = btr.read(depthmap[0].first);
+		// scrivo su file _file_out e lo svuoto
+		if(bh.dim != 0){
+			StageTimer stage(_timer, HUF_STAGE_WRITE, bh.dim);
+			output_file.write(reinterpret_cast<char*>(&_file_out[0]), bh.dim);
 		}
-	}
+		_file_out.clear();
 
-	// finisco di leggere quello che  rimasto dentro il buffer del bitreader
-	cerr << endl << "Decompressing the byte left in the bitreader buffer" << endl;
-	while(codes_map.find(tmp_code) == codes_map.end() || (codes_map.find(tmp_code) != codes_map.end() && tmp_code_len != codes_map[tmp_code].second )){
-		tmp_code = (tmp_code << 1) | (1 & btr.read_bit());
-		tmp_code_len++;
+		block_start += HUF_BLOCK_HEADER_DIM + bh.size;
+		cerr << "\rDecompression: " << decoded/1000000 << " MB";
 	}
-
-	pair<uint32_t,uint32_t> tmp_sym_pair = codes_map[tmp_code];
-	btw.write(tmp_sym_pair.first, 8);
-
-	// scrivo gli ultimi dati su file e chiudo tutto
-	btw.flush();
-	cerr << _file_out.size() << endl;
-	output_file.write(reinterpret_cast<char*>(&_file_out[0]), _file_out.size());
-
-	file_in.close();
-	output_file.close();
-
+	return decoded;
 }
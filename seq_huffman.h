@@ -2,6 +2,8 @@
 #define SEQ_HUFFMAN_H
 
 #include "huffman.h"
+#include "huffman_histo.h"
+#include "huffman_decoder.h"
 
 
 //! SeqHuffman class, used to compress and decompress only in a sequential way.
@@ -16,11 +18,13 @@ public:
 
 	//! Create histogram function
     /*!
-	  This function computes the histogram over a specific chunk of the input file.
-      \param histo A uint32_t vector object used to create the histogram.
+	  This function computes the histogram over a specific chunk of the input file using the
+	  shared histogram engine (histo_accumulate).
+      \param histo A 256 bins histogram, the counts of the chunk are added to it.
+	  \param data The chunk.
 	  \param chunk_dim The chunk length.
     */
-	void create_histo(std::vector<uint32_t>& histo, std::uint64_t chunk_dim);
+	void create_histo(Histo& histo, const std::uint8_t* data, std::uint64_t chunk_dim);
 
 	//! Create code map function
     /*!
@@ -28,18 +32,36 @@ public:
       \param tbbhr The histogram object.
 	  \return returns a map that contains symbols, canonical codes and codes lengths( <symbol, <code, code_len>>).
     */
-	CodeVector create_code_map(std::vector<uint32_t>& histo);
+	CodeVector create_code_map(Histo& histo);
+
+	//! Create block code map function
+    /*!
+	  This function assigns the canonical codes to the symbols of a single block, used by the single-pass mode.
+      \param histo The histogram of the block.
+	  \return The codes map of the block.
+    */
+	CodeVector create_block_code_map(Histo& histo);
+
+	//! Segment histograms function
+    /*!
+	  This function counts the histograms of the segments of plan_blocks() one after the other with histo_accumulate.
+      \param in The input file content.
+	  \param segments The segments, their histograms are filled.
+	  \param histo The histogram of the file, the counts of the segments are added to it.
+    */
+	void segment_histos(const std::uint8_t* in, std::vector<BlockPlan>& segments, Histo& histo);
 
 	//! Write compressed chunks function
     /*!
 	  This function write a compressed chunk of the original file into the output vector.
 	  NOTE: this function does not write anything on the hard drive.
-      \param available_ram A uint64_t containing the total amount of available ram.
+      \param block_budget The memory available to encode the block, it sets the number of microchunks.
+	  \param data The current file chunk to compress.
 	  \param macrochunk_dim A uint64_t containing the length of the current file chunk to compress.
 	  \param codes_map The codes map computed from the histogram.
 	  \param btw A reference to the bit writer object used to write to the output vector.
     */
-	void write_chunks_compressed(std::uint64_t available_ram, std::uint64_t macrochunk_dim, CodeVector codes_map, BitWriter& btw);
+	void write_chunks_compressed(std::uint64_t block_budget, const std::uint8_t* data, std::uint64_t macrochunk_dim, CodeVector codes_map, BitWriter& btw);
 	
 	//! Compress function
     /*!
@@ -54,18 +76,46 @@ public:
     /*!
 	  This function compresses the the given file.
       \param filename The current file's name.
+	  \return false if the file cannot be read or the compressed file cannot be written.
     */
-	void compress_chunked(std::string filename);
+	bool compress_chunked(std::string filename);
 
 	//! Chunked decompress function
     /*!
 	  This function decompresses the the given file.
       \param filename The current file's name.
+	  \return false if the file is truncated or corrupted.
     */
-	void decompress_chunked(std::string filename);
+	bool decompress_chunked(std::string filename);
 
 private:
 
+	//! Decode bitstream function
+    /*!
+	  This function decodes the single bitstream of a BCP1 file, one chunk at a time.
+      \param file_in The compressed file.
+	  \param output_file The decompressed file.
+	  \param decoder The canonical decoder built from the header.
+	  \param data_start The offset of the bitstream.
+	  \param compressed_len The length of the compressed file.
+	  \param file_len The number of symbols to decode, HUF_UNKNOWN_LENGTH to decode every whole code up to the end of the file.
+	  \return The number of decoded bytes.
+    */
+	std::uint64_t decode_bitstream(std::ifstream& file_in, std::ofstream& output_file, const HuffmanDecoder& decoder, std::uint64_t data_start, std::uint64_t compressed_len, std::uint64_t file_len);
+
+	//! Decode blocks function
+    /*!
+	  This function decodes the blocks of a BCP2 file one after the other, following the block headers.
+      \param file_in The compressed file.
+	  \param output_file The decompressed file.
+	  \param decoder The canonical decoder built from the header.
+	  \param data_start The offset of the first block.
+	  \param compressed_len The length of the compressed file.
+	  \param file_len The length of the original file, if it is HUF_UNKNOWN_LENGTH (single-pass) it is read from the index.
+	  \return The number of decoded bytes.
+    */
+	std::uint64_t decode_blocks(std::ifstream& file_in, std::ofstream& output_file, const HuffmanDecoder& decoder, std::uint64_t data_start, std::uint64_t compressed_len, std::uint64_t& file_len);
+
 };
 
 #endif /*SEQ_HUFFMAN_H*/
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include "test_utils.h"
+#include "../seq_huffman.h"
+#include "../huffman_api.h"
+
+using namespace std;
+
+typedef huf::Span<const uint8_t> InSpan;
+typedef huf::Span<uint8_t> OutSpan;
+
+// compressione in un buffer di compress_bound(), decompressione e lunghezza letta dall'header
+static bool check_roundtrip(huf::HuffmanContext& ctx, const vector<uint8_t>& data, vector<uint8_t>& compressed){
+	compressed.assign(huf::compress_bound(data.size()), 0);
+	size_t written = 0;
+	if(huf::compress(ctx, InSpan(data), OutSpan(compressed), written) != HUF_OK || written > compressed.size())
+		return false;
+	compressed.resize(written);
+
+	uint64_t size = 0;
+	if(huf::decompressed_size(InSpan(compressed), size) != HUF_OK || size != data.size())
+		return false;
+	vector<uint8_t> out(data.size());
+	return huf::decompress(ctx, InSpan(compressed), OutSpan(out), written) == HUF_OK && written == data.size() && out == data;
+}
+
+// un buffer lungo esattamente quanto i dati compressi basta, un byte in meno no: da entrambe le parti
+static bool check_exact_buffers(huf::HuffmanContext& ctx, const vector<uint8_t>& data, const vector<uint8_t>& compressed){
+	vector<uint8_t> exact(compressed.size());
+	size_t written = 0;
+	if(huf::compress(ctx, InSpan(data), OutSpan(exact), written) != HUF_OK || exact != compressed)
+		return false;
+	if(huf::compress(ctx, InSpan(data), OutSpan(exact.data(), exact.size()-1), written) != HUF_ERROR_DST_TOO_SMALL)
+		return false;
+	if(data.empty())
+		return true;
+	vector<uint8_t> out(data.size()-1);
+	return huf::decompress(ctx, InSpan(compressed), OutSpan(out), written) == HUF_ERROR_DST_TOO_SMALL;
+}
+
+// il programma a riga di comando legge i buffer dell'API
+static bool check_engine(const vector<uint8_t>& data, const vector<uint8_t>& compressed){
+	SeqHuffman seq_huff;
+	istringstream input(string(compressed.begin(), compressed.end()));
+	ostringstream output;
+	bool ok;
+	{
+		Silence silence;
+		ok = seq_huff.decompress_stream(input, output, false);
+	}
+	string s = output.str();
+	return ok && vector<uint8_t>(s.begin(), s.end()) == data;
+}
+
+// un buffer troncato non viene mai accettato, un bit cambiato da' un errore o un output della lunghezza giusta
+static bool check_corrupted(huf::HuffmanContext& ctx, const vector<uint8_t>& data, const vector<uint8_t>& compressed){
+	vector<uint8_t> out(data.size());
+	size_t written = 0;
+	uint64_t step = compressed.size()/64 + 1;
+	for(uint64_t len=0; len<compressed.size(); len+=step)
+		if(huf::decompress(ctx, InSpan(compressed.data(), len), OutSpan(out), written) == HUF_OK)
+			return false;
+
+	uint64_t state = compressed.size();
+	for(int k=0; k<200; ++k){
+		vector<uint8_t> corrupted = compressed;
+		corrupted[test_random(state)%corrupted.size()] ^= (uint8_t)(1 << (test_random(state)%8));
+		if(huf::decompress(ctx, InSpan(corrupted), OutSpan(out), written) == HUF_OK && written != data.size())
+			return false;
+	}
+
+	vector<uint8_t> wrong_magic = compressed;
+	wrong_magic[0] ^= 0xFF;
+	uint64_t size = 0;
+	return huf::decompress(ctx, InSpan(wrong_magic), OutSpan(out), written) == HUF_ERROR_FORMAT
+		&& huf::decompressed_size(InSpan(wrong_magic), size) == HUF_ERROR_FORMAT;
+}
+
+// l'interfaccia C: parametri nulli e codici fuori dai limiti vengono rifiutati
+static bool check_c_interface(const vector<uint8_t>& data){
+	HufContext* ctx = huf_create_context();
+	if(ctx == NULL)
+		return false;
+	bool ok = huf_set_max_code_len(ctx, HUF_MAX_CODE_LEN_MAX+1) == HUF_ERROR_PARAMETER;
+	ok = ok && huf_set_max_code_len(ctx, HUF_MAX_CODE_LEN_MIN) == HUF_OK;
+
+	vector<uint8_t> compressed(huf_compress_bound(data.size()));
+	size_t written = 0;
+	ok = ok && huf_compress(NULL, data.data(), data.size(), compressed.data(), compressed.size(), &written) == HUF_ERROR_PARAMETER;
+	ok = ok && huf_compress(ctx, data.data(), data.size(), compressed.data(), compressed.size(), NULL) == HUF_ERROR_PARAMETER;
+	ok = ok && huf_compress(ctx, data.data(), data.size(), compressed.data(), compressed.size(), &written) == HUF_OK;
+
+	uint64_t size = 0;
+	ok = ok && huf_decompressed_size(compressed.data(), written, NULL) == HUF_ERROR_PARAMETER;
+	ok = ok && huf_decompressed_size(compressed.data(), written, &size) == HUF_OK && size == data.size();
+	vector<uint8_t> out(data.size());
+	size_t decoded = 0;
+	ok = ok && huf_decompress(ctx, compressed.data(), written, out.data(), out.size(), &decoded) == HUF_OK;
+	ok = ok && decoded == data.size() && out == data;
+	huf_free_context(ctx);
+	return ok;
+}
+
+//! Buffer API test.
+/*!
+Compresses buffers of different lengths and statistics with huf::compress(), the last one longer than
+HUF_BLOCK_DIM, with the default and the shortest maximum code length. Checks compress_bound(), output
+buffers of exactly the compressed or decompressed size and one byte shorter, the command line decoder on
+the same buffers, truncated and corrupted input and the C interface.
+\return 0, 1 if a check fails.
+*/
+int main(){
+	int failures = 0;
+
+	vector<vector<uint8_t> > inputs;
+	inputs.push_back(vector<uint8_t>());
+	inputs.push_back(vector<uint8_t>(1, 'a'));
+	inputs.push_back(test_data(100, 100, 1));
+	inputs.push_back(test_data(65537, 20000, 2));
+	inputs.push_back(test_data(3*HUF_ONE_MB, 500000, 3));
+	inputs.push_back(test_data(HUF_BLOCK_DIM+1, HUF_BLOCK_DIM/4, 4));
+	uint32_t code_lengths[] = {HUF_MAX_CODE_LEN, HUF_MAX_CODE_LEN_MIN};
+
+	huf::HuffmanContext ctx;
+	for(size_t i=0; i<inputs.size(); ++i){
+		for(int l=0; l<2; ++l){
+			ctx.max_code_len = code_lengths[l];
+			vector<uint8_t> compressed;
+			ostringstream what;
+			what << inputs[i].size() << " bytes, codes up to " << code_lengths[l] << " bits: ";
+			bool ok = check_roundtrip(ctx, inputs[i], compressed);
+			check(ok, what.str() + "round trip", failures);
+			if(!ok)
+				continue;
+			check(check_exact_buffers(ctx, inputs[i], compressed), what.str() + "exact and short buffers", failures);
+			check(check_engine(inputs[i], compressed), what.str() + "decompress_stream", failures);
+			if(inputs[i].size() < HUF_ONE_MB)
+				check(check_corrupted(ctx, inputs[i], compressed), what.str() + "truncated and corrupted input", failures);
+		}
+	}
+
+	// il nome originale va nell'header, oltre compress_bound()
+	vector<uint8_t> name_data = test_data(1000, 300, 5);
+	string name = "name_test.txt";
+	vector<uint8_t> compressed(huf::compress_bound(name_data.size()) + name.size());
+	size_t written = 0;
+	bool ok = huf::compress(ctx, InSpan(name_data), OutSpan(compressed), written, huf::Span<const char>(name.data(), name.size())) == HUF_OK;
+	compressed.resize(written);
+	ok = ok && string(compressed.begin()+8, compressed.begin()+8+name.size()) == name;
+	vector<uint8_t> out(name_data.size());
+	ok = ok && huf::decompress(ctx, InSpan(compressed), OutSpan(out), written) == HUF_OK && out == name_data;
+	check(ok, "original filename in the header", failures);
+
+	check(check_c_interface(inputs[3]), "C interface", failures);
+
+	return failures ? 1 : 0;
+}
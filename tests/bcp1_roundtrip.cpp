@@ -0,0 +1,82 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include "test_utils.h"
+#include "../seq_huffman.h"
+#include "../par_huffman.h"
+#include "../huffman_api.h"
+
+using namespace std;
+
+// decomprime con un motore: l'header di prova.bcp non ha il nome, l'output e' il nome senza estensione
+static bool check_engine(const string& engine, const string& compressed, const vector<uint8_t>& original){
+	string output;
+	bool ok;
+	{
+		Silence silence;
+		if(engine == "par"){
+			ParHuffman par_huff;
+			ok = par_huff.decompress_chunked(compressed);
+			output = par_huff._output_filename;
+		} else {
+			SeqHuffman seq_huff;
+			ok = seq_huff.decompress_chunked(compressed);
+			output = seq_huff._output_filename;
+		}
+	}
+
+	vector<uint8_t> decoded;
+	ok = ok && read_all(output, decoded) && decoded == original;
+	remove(output.c_str());
+	cout << (ok ? "OK   " : "FAIL ") << engine << " decompress_chunked " << compressed << endl;
+	return ok;
+}
+
+static bool check_api(const string& compressed, const vector<uint8_t>& original){
+	vector<uint8_t> in;
+	if(!read_all(compressed, in))
+		return false;
+
+	uint64_t size = 0;
+	bool ok = huf::decompressed_size(huf::Span<const uint8_t>(in.data(), in.size()), size) == HUF_OK && size == original.size();
+
+	huf::HuffmanContext ctx;
+	vector<uint8_t> out(original.size());
+	size_t written = 0;
+	ok = ok && huf::decompress(ctx, huf::Span<const uint8_t>(in.data(), in.size()), huf::Span<uint8_t>(out.data(), out.size()), written) == HUF_OK;
+	ok = ok && written == original.size() && out == original;
+
+	// un byte in meno non basta
+	if(!original.empty())
+		ok = ok && huf::decompress(ctx, huf::Span<const uint8_t>(in.data(), in.size()), huf::Span<uint8_t>(out.data(), out.size()-1), written) == HUF_ERROR_DST_TOO_SMALL;
+
+	cout << (ok ? "OK   " : "FAIL ") << "huf::decompress " << compressed << endl;
+	return ok;
+}
+
+//! Round trip of the BCP1 sample file.
+/*!
+Decompresses Debug/prova.bcp, a file of the first BCP1 layout, with SeqHuffman, ParHuffman and
+huf::decompress() and compares the output with Debug/prova.txt. To be run from the repository root,
+or with the two paths as arguments.
+\return 0, 1 if an output is not the original file.
+*/
+int main(int argc, char* argv[]){
+	string compressed = (argc > 1) ? argv[1] : "Debug/prova.bcp";
+	string original_name = (argc > 2) ? argv[2] : "Debug/prova.txt";
+
+	vector<uint8_t> original;
+	if(!read_all(original_name, original)){
+		cout << "Cannot read " << original_name << endl;
+		return 1;
+	}
+
+	bool ok = check_engine("seq", compressed, original);
+	ok = check_engine("par", compressed, original) && ok;
+	ok = check_api(compressed, original) && ok;
+	return ok ? 0 : 1;
+}
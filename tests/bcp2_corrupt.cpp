@@ -0,0 +1,122 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include "test_utils.h"
+#include "../seq_huffman.h"
+#include "../par_huffman.h"
+
+using namespace std;
+
+#define TEST_FILENAME	"corrupt_test.txt"
+#define TEST_COMPRESSED	"corrupt_test.bcp"
+
+// comprime i dati con il motore a chunk (o in una passata), il file compresso resta in TEST_COMPRESSED
+static bool compress(const vector<uint8_t>& data, bool single_pass, vector<uint8_t>& compressed){
+	if(!write_all(TEST_FILENAME, data))
+		return false;
+	bool ok;
+	{
+		Silence silence;
+		SeqHuffman seq_huff;
+		if(single_pass)
+			ok = seq_huff.compress_single_pass(TEST_FILENAME, false);
+		else
+			ok = seq_huff.compress_chunked(TEST_FILENAME);
+	}
+	return ok && read_all(TEST_COMPRESSED, compressed);
+}
+
+// decomprime un file compresso (eventualmente corrotto) con un motore:
+// deve dare errore oppure, se la corruzione non cambia niente, l'originale
+static bool decompress(const string& engine, const vector<uint8_t>& compressed, const vector<uint8_t>& original, bool& ok){
+	write_all(TEST_COMPRESSED, compressed);
+	remove(TEST_FILENAME);
+	{
+		Silence silence;
+		if(engine == "par"){
+			ParHuffman par_huff;
+			ok = par_huff.decompress_chunked(TEST_COMPRESSED);
+		} else {
+			SeqHuffman seq_huff;
+			ok = seq_huff.decompress_chunked(TEST_COMPRESSED);
+		}
+	}
+	vector<uint8_t> decoded;
+	bool same = read_all(TEST_FILENAME, decoded) && decoded == original;
+	return !ok || same;
+}
+
+//! Corrupted index test.
+/*!
+Corrupts the block index at the end of a BCP2 file: every byte of the entries and of the trailer in turn,
+then a few targeted fields (a block size, a block offset, the file length). The decoders must reject the
+file, or decode the original when the change does not matter, and never allocate what a corrupted entry says.
+\return 0, 1 if a decoder accepted a corrupted index or crashed.
+*/
+int main(){
+	int failures = 0;
+	vector<uint8_t> original = test_data(3*HUF_ONE_MB, 500000, 7);
+	vector<uint8_t> compressed;
+	if(!compress(original, false, compressed)){
+		cout << "Cannot compress " << TEST_FILENAME << endl;
+		return 1;
+	}
+	uint64_t entries = index_start(compressed);
+	uint64_t num_blocks = (compressed.size()-HUF_INDEX_TRAILER_DIM-entries)/HUF_INDEX_ENTRY_DIM;
+	cout << compressed.size() << " bytes, " << num_blocks << " blocks" << endl;
+
+	bool ok;
+	check(decompress("par", compressed, original, ok) && ok, "par intact file", failures);
+	check(decompress("seq", compressed, original, ok) && ok, "seq intact file", failures);
+
+	// ogni byte dell'indice e della sua chiusura
+	bool all_rejected = true;
+	for(uint64_t pos=entries; pos<compressed.size(); ++pos){
+		vector<uint8_t> corrupted = compressed;
+		corrupted[pos] ^= 0x80;
+		if(!decompress("par", corrupted, original, ok) || !decompress("seq", corrupted, original, ok)){
+			cout << "     byte " << pos << " of the index" << endl;
+			all_rejected = false;
+		}
+	}
+	check(all_rejected, "every byte of the index flipped", failures);
+
+	// dimensione di un blocco oltre la fine del file
+	vector<uint8_t> corrupted = compressed;
+	set_u64(corrupted, entries + (num_blocks-1)*HUF_INDEX_ENTRY_DIM + 16, 0x960000ead8ull);
+	check(decompress("par", corrupted, original, ok) && !ok, "block size past the end of the file", failures);
+
+	// blocco prima dell'header
+	corrupted = compressed;
+	set_u64(corrupted, entries + 8, 0);
+	check(decompress("par", corrupted, original, ok) && !ok, "block offset inside the header", failures);
+
+	// blocchi non in ordine
+	if(num_blocks > 1){
+		corrupted = compressed;
+		set_u64(corrupted, entries + HUF_INDEX_ENTRY_DIM, 0);
+		check(decompress("par", corrupted, original, ok) && !ok, "uncompressed offsets not increasing", failures);
+	}
+
+	// lunghezza dell'indice diversa da quella dell'header
+	corrupted = compressed;
+	set_u64(corrupted, compressed.size()-HUF_INDEX_TRAILER_DIM, original.size()+1);
+	check(decompress("par", corrupted, original, ok) && !ok, "index file length different from the header", failures);
+
+	// in una passata la lunghezza e' solo nell'indice
+	if(!compress(original, true, compressed)){
+		cout << "Cannot compress " << TEST_FILENAME << " in a single pass" << endl;
+		return 1;
+	}
+	check(decompress("par", compressed, original, ok) && ok, "par intact single-pass file", failures);
+	corrupted = compressed;
+	set_u64(corrupted, compressed.size()-HUF_INDEX_TRAILER_DIM, 0xFFFFFFFFFFFFull);
+	check(decompress("par", corrupted, original, ok) && !ok, "single-pass file length too long", failures);
+	check(decompress("seq", corrupted, original, ok) && !ok, "seq single-pass file length too long", failures);
+
+	remove(TEST_FILENAME);
+	remove(TEST_COMPRESSED);
+	return failures ? 1 : 0;
+}
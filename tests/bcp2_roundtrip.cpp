@@ -0,0 +1,171 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include "test_utils.h"
+#include "../seq_huffman.h"
+#include "../par_huffman.h"
+#include "../huffman_api.h"
+
+using namespace std;
+
+#define TEST_FILENAME	"roundtrip_test.txt"
+#define TEST_COMPRESSED	"roundtrip_test.bcp"
+
+// comprime con un motore in uno dei tre modi: a chunk, in una passata dal file o da uno stream in memoria
+static bool compress(const string& engine, const string& mode, uint32_t streams, const vector<uint8_t>& data, vector<uint8_t>& compressed){
+	bool parallel = (engine == "par");
+	SeqHuffman seq_huff;
+	ParHuffman par_huff;
+	Huffman& huff = parallel ? (Huffman&)par_huff : (Huffman&)seq_huff;
+	huff._streams = streams;
+
+	Silence silence;
+	if(mode == "stream"){
+		istringstream input(string(data.begin(), data.end()));
+		ostringstream output;
+		bool ok = huff.compress_stream(input, output, parallel);
+		string s = output.str();
+		compressed.assign(s.begin(), s.end());
+		return ok;
+	}
+	if(!write_all(TEST_FILENAME, data))
+		return false;
+	bool ok = (mode == "single-pass") ? huff.compress_single_pass(TEST_FILENAME, parallel) : huff.compress_chunked(TEST_FILENAME);
+	return ok && read_all(TEST_COMPRESSED, compressed);
+}
+
+// decomprime un file con decompress_chunked(), l'output ha il nome scritto nell'header
+static bool decompress_file(const string& engine, const vector<uint8_t>& compressed, const vector<uint8_t>& original){
+	if(!write_all(TEST_COMPRESSED, compressed))
+		return false;
+	SeqHuffman seq_huff;
+	ParHuffman par_huff;
+	Huffman& huff = (engine == "par") ? (Huffman&)par_huff : (Huffman&)seq_huff;
+	bool ok;
+	{
+		Silence silence;
+		ok = huff.decompress_chunked(TEST_COMPRESSED);
+	}
+	vector<uint8_t> decoded;
+	ok = ok && read_all(huff._output_filename, decoded) && decoded == original;
+	remove(huff._output_filename.c_str());
+	return ok;
+}
+
+static bool decompress_stream(const string& engine, const vector<uint8_t>& compressed, const vector<uint8_t>& original){
+	bool parallel = (engine == "par");
+	SeqHuffman seq_huff;
+	ParHuffman par_huff;
+	Huffman& huff = parallel ? (Huffman&)par_huff : (Huffman&)seq_huff;
+	istringstream input(string(compressed.begin(), compressed.end()));
+	ostringstream output;
+	bool ok;
+	{
+		Silence silence;
+		ok = huff.decompress_stream(input, output, parallel);
+	}
+	string s = output.str();
+	return ok && vector<uint8_t>(s.begin(), s.end()) == original;
+}
+
+static bool decompress_api(const vector<uint8_t>& compressed, const vector<uint8_t>& original){
+	uint64_t size = 0;
+	if(huf::decompressed_size(huf::Span<const uint8_t>(compressed), size) != HUF_OK || size != original.size())
+		return false;
+	huf::HuffmanContext ctx;
+	vector<uint8_t> out(original.size());
+	size_t written = 0;
+	return huf::decompress(ctx, huf::Span<const uint8_t>(compressed), huf::Span<uint8_t>(out), written) == HUF_OK
+		&& written == original.size() && out == original;
+}
+
+// numero di simboli della tabella globale, dopo nome, lunghezza del file e dimensione dei blocchi
+static uint32_t header_symbols(const vector<uint8_t>& compressed){
+	uint64_t name_length = get_u64(compressed, 0) & 0xFFFFFFFF;
+	return (uint32_t)get_u64(compressed, 8+name_length+8);
+}
+
+// i tipi dei blocchi sono esattamente quelli attesi, interleaved se ci sono piu' bitstream,
+// e l'header ha la tabella globale solo se qualche blocco la usa
+static bool check_blocks(const vector<uint8_t>& compressed, uint32_t streams, const vector<uint8_t>& expected){
+	vector<uint8_t> types = block_types(compressed);
+	vector<bool> found(expected.size(), false);
+	bool global = false;
+	for(size_t i=0; i<types.size(); ++i){
+		uint8_t type = types[i] & ~HUF_BLOCK_INTERLEAVED;
+		bool interleaved = (types[i] & HUF_BLOCK_INTERLEAVED) != 0;
+		if(interleaved != (streams > 1 && type != HUF_BLOCK_STORED))
+			return false;
+		size_t k = find(expected.begin(), expected.end(), type) - expected.begin();
+		if(k == expected.size())
+			return false;
+		found[k] = true;
+		global = global || (type == HUF_BLOCK_HUFFMAN);
+	}
+	if(find(found.begin(), found.end(), false) != found.end())
+		return false;
+	return (header_symbols(compressed) > 0) == global;
+}
+
+//! BCP2 round trip test.
+/*!
+Compresses text, data with parts of different statistics, random bytes and an empty file with both engines,
+1, 2, 4 and 8 bitstreams per block, chunked, in a single pass and from a stream. Every file must have the
+expected blocks (HUFFMAN for the text, LOCAL and STORED for the mixed data, STORED for the random bytes) and
+decompress to the original with both engines from a file and from a stream, and with huf::decompress().
+\return 0, 1 if a file does not have the expected blocks or does not decompress to the original.
+*/
+int main(){
+	int failures = 0;
+
+	vector<uint8_t> text = test_data(3*HUF_ONE_MB, 3*HUF_ONE_MB, 1);
+	vector<uint8_t> mixed = test_data(3*HUF_ONE_MB, 500000, 2);
+	vector<uint8_t> random, empty;
+	uint64_t state = 3;
+	for(uint64_t i=0; i<HUF_ONE_MB; ++i)
+		random.push_back((uint8_t)test_random(state));
+
+	const char* names[] = {"text", "mixed", "random", "empty"};
+	const vector<uint8_t>* inputs[] = {&text, &mixed, &random, &empty};
+	const string engines[] = {"seq", "par"};
+	const string modes[] = {"chunked", "single-pass", "stream"};
+
+	for(int in=0; in<4; ++in){
+		const vector<uint8_t>& data = *inputs[in];
+		for(int m=0; m<3; ++m){
+			// in una passata non c'e' la tabella globale e i blocchi sono lunghi HUF_BLOCK_DIM
+			vector<uint8_t> expected;
+			if(in == 0)
+				expected.push_back(m == 0 ? HUF_BLOCK_HUFFMAN : HUF_BLOCK_LOCAL);
+			else if(in == 1){
+				expected.push_back(HUF_BLOCK_LOCAL);
+				if(m == 0)
+					expected.push_back(HUF_BLOCK_STORED);
+			}
+			else if(in == 2)
+				expected.push_back(HUF_BLOCK_STORED);
+
+			for(int e=0; e<2; ++e){
+				for(uint32_t streams=1; streams<=HUF_MAX_STREAMS; streams*=2){
+					vector<uint8_t> compressed;
+					bool ok = compress(engines[e], modes[m], streams, data, compressed);
+					ok = ok && check_blocks(compressed, streams, expected);
+					ok = ok && decompress_file("seq", compressed, data) && decompress_file("par", compressed, data);
+					ok = ok && decompress_stream("seq", compressed, data) && decompress_stream("par", compressed, data);
+					ok = ok && decompress_api(compressed, data);
+					ostringstream what;
+					what << names[in] << ", " << engines[e] << " " << modes[m] << ", " << streams << " streams";
+					check(ok, what.str(), failures);
+				}
+			}
+		}
+	}
+
+	remove(TEST_FILENAME);
+	remove(TEST_COMPRESSED);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "test_utils.h"
+#include "../seq_huffman.h"
+#include "../par_huffman.h"
+
+using namespace std;
+
+// pianifica i blocchi con un motore, in chunks pezzi come fa compress_chunked() con i macrochunk
+static void plan(const string& engine, const vector<uint8_t>& data, uint64_t chunks, Histo& histo, vector<BlockPlan>& blocks){
+	SeqHuffman seq_huff;
+	ParHuffman par_huff;
+	Huffman& huff = (engine == "par") ? (Huffman&)par_huff : (Huffman&)seq_huff;
+	histo.assign(256, 0);
+	blocks.clear();
+	uint64_t chunk_dim = data.size()/chunks;
+	for(uint64_t k=0; k<chunks; ++k){
+		uint64_t len = (k+1 < chunks) ? chunk_dim : data.size()-k*chunk_dim;
+		huff.plan_blocks(data.data(), k*chunk_dim, len, data.size(), histo, blocks);
+	}
+}
+
+// i blocchi coprono i dati in ordine, senza buchi, nessuno oltre HUF_BLOCK_DIM,
+// e ognuno ha l'istogramma dei suoi byte: la somma e' l'istogramma del file
+static bool check_cover(const vector<uint8_t>& data, const Histo& histo, const vector<BlockPlan>& blocks){
+	Histo total(256, 0);
+	uint64_t next = 0;
+	for(size_t i=0; i<blocks.size(); ++i){
+		if(blocks[i].offset != next || blocks[i].dim == 0 || blocks[i].dim > HUF_BLOCK_DIM)
+			return false;
+		Histo count(256, 0);
+		for(uint64_t j=blocks[i].offset; j<blocks[i].offset+blocks[i].dim; ++j)
+			count[data[j]]++;
+		if(blocks[i].histo != count)
+			return false;
+		for(int s=0; s<256; ++s)
+			total[s] += count[s];
+		next += blocks[i].dim;
+	}
+	return next == data.size() && histo == total;
+}
+
+// i blocchi finiscono esattamente dove cambiano le statistiche dei dati
+static bool check_boundaries(const vector<BlockPlan>& blocks, uint64_t part, uint64_t n){
+	vector<uint64_t> ends;
+	for(size_t i=0; i<blocks.size(); ++i)
+		ends.push_back(blocks[i].offset + blocks[i].dim);
+	vector<uint64_t> expected;
+	for(uint64_t end=part; end<n; end+=part)
+		expected.push_back(end);
+	expected.push_back(n);
+	return ends == expected;
+}
+
+// blocchi di dati uniformi: tutti lunghi HUF_BLOCK_DIM tranne l'ultimo
+static size_t full_blocks(uint64_t n){
+	return (size_t)((n + HUF_BLOCK_DIM-1)/HUF_BLOCK_DIM);
+}
+
+//! Block-split planner test.
+/*!
+Plans the blocks of data with parts of different statistics, of uniform text and of uniform text longer
+than HUF_PLAN_SEGMENTS segments, with both engines, in one piece and in macrochunks. The blocks must cover
+the data in order with the histograms of their bytes, be at most HUF_BLOCK_DIM long, end where the
+statistics change and not split uniform data more than HUF_BLOCK_DIM requires.
+\return 0, 1 if a plan is wrong.
+*/
+int main(){
+	int failures = 0;
+
+	// le parti sono multipli di HUF_SEGMENT_DIM, i segmenti non le attraversano
+	uint64_t part = 2*HUF_SEGMENT_DIM;
+	vector<uint8_t> mixed = test_data(12*part, part, 11);
+	vector<uint8_t> text = test_data(25*HUF_ONE_MB, 25*HUF_ONE_MB, 12);
+	vector<uint8_t> long_text = test_data(HUF_PLAN_SEGMENTS*HUF_SEGMENT_DIM + 3*HUF_ONE_MB, HUF_PLAN_SEGMENTS*HUF_SEGMENT_DIM + 3*HUF_ONE_MB, 13);
+
+	const string engines[] = {"seq", "par"};
+	uint64_t chunks[] = {1, 3};
+	for(int e=0; e<2; ++e){
+		for(int c=0; c<2; ++c){
+			ostringstream what;
+			what << engines[e] << ", " << chunks[c] << " chunks: ";
+			Histo histo;
+			vector<BlockPlan> blocks;
+
+			plan(engines[e], mixed, chunks[c], histo, blocks);
+			check(check_cover(mixed, histo, blocks), what.str() + "mixed data covered", failures);
+			// i chunk tagliano i dati a un terzo, i confini vanno controllati solo in un pezzo
+			if(chunks[c] == 1)
+				check(check_boundaries(blocks, part, mixed.size()), what.str() + "mixed data split where it changes", failures);
+
+			plan(engines[e], text, chunks[c], histo, blocks);
+			check(check_cover(text, histo, blocks), what.str() + "text covered", failures);
+			if(chunks[c] == 1)
+				check(blocks.size() == full_blocks(text.size()), what.str() + "text in blocks of HUF_BLOCK_DIM", failures);
+
+			plan(engines[e], long_text, chunks[c], histo, blocks);
+			check(check_cover(long_text, histo, blocks), what.str() + "text of more than HUF_PLAN_SEGMENTS segments covered", failures);
+			if(chunks[c] == 1)
+				check(blocks.size() == full_blocks(long_text.size()), what.str() + "text of more than HUF_PLAN_SEGMENTS segments in blocks of HUF_BLOCK_DIM", failures);
+		}
+	}
+
+	// un file vuoto non ha blocchi
+	Histo histo;
+	vector<BlockPlan> blocks;
+	plan("seq", vector<uint8_t>(), 1, histo, blocks);
+	check(blocks.empty() && histo == Histo(256, 0), "empty data", failures);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include "test_utils.h"
+#include "../seq_huffman.h"
+#include "../par_huffman.h"
+#include "../huffman_api.h"
+
+using namespace std;
+
+#define TEST_FILENAME	"table_test.txt"
+#define TEST_COMPRESSED	"table_test.bcp"
+
+static bool compress(const vector<uint8_t>& data, bool single_pass, uint32_t streams, vector<uint8_t>& compressed){
+	if(!write_all(TEST_FILENAME, data))
+		return false;
+	bool ok;
+	{
+		Silence silence;
+		SeqHuffman seq_huff;
+		seq_huff._streams = streams;
+		ok = single_pass ? seq_huff.compress_single_pass(TEST_FILENAME, false) : seq_huff.compress_chunked(TEST_FILENAME);
+	}
+	return ok && read_all(TEST_COMPRESSED, compressed);
+}
+
+// nessun decoder accetta il file: gli stream dei due motori e huf::decompress(). I decoder a chunk
+// escono dal programma su un header non valido, provano il file solo se l'header e' intatto
+static bool rejected(const vector<uint8_t>& compressed, size_t original_size, bool header_intact){
+	string s(compressed.begin(), compressed.end());
+	bool accepted = false;
+	{
+		Silence silence;
+		SeqHuffman seq_huff;
+		ParHuffman par_huff;
+		istringstream seq_input(s), par_input(s);
+		ostringstream seq_output, par_output;
+		accepted = seq_huff.decompress_stream(seq_input, seq_output, false) || par_huff.decompress_stream(par_input, par_output, true);
+		if(header_intact){
+			write_all(TEST_COMPRESSED, compressed);
+			SeqHuffman seq_file;
+			ParHuffman par_file;
+			accepted = seq_file.decompress_chunked(TEST_COMPRESSED) || par_file.decompress_chunked(TEST_COMPRESSED) || accepted;
+		}
+	}
+
+	huf::HuffmanContext ctx;
+	vector<uint8_t> out(original_size);
+	size_t written = 0;
+	accepted = huf::decompress(ctx, huf::Span<const uint8_t>(compressed), huf::Span<uint8_t>(out), written) == HUF_OK || accepted;
+
+	FileHeader h;
+	if(!header_intact)
+		accepted = Huffman::parse_header(compressed.data(), compressed.size(), h) || accepted;
+	return !accepted;
+}
+
+//! Corrupted code tables test.
+/*!
+Writes code lengths out of range (0, above HUF_MAX_CODE_LEN_MAX, above the 56 bits of a decoder refill)
+and lengths that are not a prefix code into the global table of a file header and into the table of a
+HUF_BLOCK_LOCAL block, with one and four bitstreams, then truncates the files. Every decoder must reject
+the file without hanging or reading out of the buffers.
+\return 0, 1 if a decoder accepted a corrupted file.
+*/
+int main(){
+	int failures = 0;
+	vector<uint8_t> original = test_data(HUF_ONE_MB, HUF_ONE_MB, 21);
+	uint32_t lengths[] = {0, HUF_MAX_CODE_LEN_MAX+1, 60};
+
+	for(uint32_t streams=1; streams<=4; streams*=4){
+		ostringstream what;
+		what << streams << " streams: ";
+
+		// tabella globale nell'header di un file a chunk
+		vector<uint8_t> compressed;
+		FileHeader h;
+		if(!compress(original, false, streams, compressed) || !Huffman::parse_header(compressed.data(), compressed.size(), h) || h.num_symbols < 3){
+			check(false, what.str() + "compress with a global table", failures);
+			continue;
+		}
+		check(!rejected(compressed, original.size(), true), what.str() + "intact global table", failures);
+		for(int l=0; l<3; ++l){
+			vector<uint8_t> corrupted = compressed;
+			corrupted[h.table_start+1] = (uint8_t)lengths[l];
+			ostringstream length;
+			length << what.str() << "global code length " << lengths[l];
+			check(rejected(corrupted, original.size(), false), length.str(), failures);
+		}
+		vector<uint8_t> corrupted = compressed;
+		for(uint32_t i=0; i<h.num_symbols; ++i)
+			corrupted[h.table_start+2*i+1] = 1;
+		check(rejected(corrupted, original.size(), false), what.str() + "global lengths not a prefix code", failures);
+		corrupted.assign(compressed.begin(), compressed.begin()+h.table_start+h.num_symbols);
+		check(rejected(corrupted, original.size(), false), what.str() + "header truncated in the table", failures);
+		corrupted.assign(compressed.begin(), compressed.begin()+(h.data_start+compressed.size())/2);
+		check(rejected(corrupted, original.size(), true), what.str() + "file truncated in a block", failures);
+
+		// tabella di un blocco HUF_BLOCK_LOCAL, subito dopo l'header del blocco e il numero di simboli
+		if(!compress(original, true, streams, compressed) || !Huffman::parse_header(compressed.data(), compressed.size(), h)
+			|| (compressed[h.data_start] & ~HUF_BLOCK_INTERLEAVED) != HUF_BLOCK_LOCAL){
+			check(false, what.str() + "compress with a local table", failures);
+			continue;
+		}
+		check(!rejected(compressed, original.size(), true), what.str() + "intact local table", failures);
+		uint64_t table = h.data_start + HUF_BLOCK_HEADER_DIM;
+		uint32_t num_symbols = (compressed[table] << 8) | compressed[table+1];
+		for(int l=0; l<3; ++l){
+			corrupted = compressed;
+			corrupted[table+3] = (uint8_t)lengths[l];
+			ostringstream length;
+			length << what.str() << "local code length " << lengths[l];
+			check(rejected(corrupted, original.size(), true), length.str(), failures);
+		}
+		corrupted = compressed;
+		for(uint32_t i=0; i<num_symbols; ++i)
+			corrupted[table+2+2*i+1] = 1;
+		check(rejected(corrupted, original.size(), true), what.str() + "local lengths not a prefix code", failures);
+		corrupted = compressed;
+		corrupted[table] = 0x01;
+		corrupted[table+1] = 0x2C;
+		check(rejected(corrupted, original.size(), true), what.str() + "local table of 300 symbols", failures);
+	}
+
+	remove(TEST_FILENAME);
+	remove(TEST_COMPRESSED);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+#ifndef TEST_UTILS_H
+#define TEST_UTILS_H
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include "../huffman_utils.h"
+
+// zittisce i messaggi dei motori
+class NullBuffer : public std::streambuf {
+protected:
+	int overflow(int c){
+		return c;
+	}
+};
+
+//! Silence class
+/*!
+Sends cerr to nowhere while it is alive, the engines print their progress there.
+*/
+class Silence {
+	NullBuffer _null_buffer;
+	std::streambuf* _old_cerr;
+
+public:
+	Silence() : _old_cerr(std::cerr.rdbuf(&_null_buffer)) {}
+	~Silence() { std::cerr.rdbuf(_old_cerr); }
+};
+
+static bool read_all(const std::string& filename, std::vector<std::uint8_t>& data){
+	std::ifstream in(filename, std::ifstream::in|std::ifstream::binary);
+	if(!in)
+		return false;
+	data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return true;
+}
+
+static bool write_all(const std::string& filename, const std::vector<std::uint8_t>& data){
+	std::ofstream out(filename, std::ofstream::out|std::ofstream::binary);
+	if(!data.empty())
+		out.write(reinterpret_cast<const char*>(data.data()), data.size());
+	out.close();
+	return !out.fail();
+}
+
+// generatore deterministico, i test danno lo stesso risultato su ogni macchina
+static std::uint32_t test_random(std::uint64_t& state){
+	state = state*6364136223846793005ull + 1442695040888963407ull;
+	return (std::uint32_t)(state >> 33);
+}
+
+//! Test data function
+/*!
+Builds n bytes made of parts with different statistics, one after the other: text with a few symbols,
+random bytes that do not compress and long runs of a single byte. The block-split optimizer gives
+each part its own block, so one file has HUFFMAN, LOCAL and STORED blocks.
+\param n The length of the data.
+\param part The length of every part.
+\param seed The seed of the generator.
+\return The data.
+*/
+static std::vector<std::uint8_t> test_data(std::uint64_t n, std::uint64_t part, std::uint64_t seed){
+	std::vector<std::uint8_t> data(n);
+	std::uint64_t state = seed;
+	for(std::uint64_t i=0; i<n; ++i){
+		switch((i/part)%3){
+			case 0: data[i] = "etaoin shrdlu"[test_random(state)%13]; break;
+			case 1: data[i] = (std::uint8_t)test_random(state); break;
+			default: data[i] = (test_random(state)%64 == 0) ? 'x' : '0'; break;
+		}
+	}
+	return data;
+}
+
+// interi a 64 bit del formato, big endian
+static std::uint64_t get_u64(const std::vector<std::uint8_t>& buf, std::uint64_t pos){
+	std::uint64_t value = 0;
+	for(int k=0; k<8; ++k)
+		value = (value<<8) | buf[pos+k];
+	return value;
+}
+
+static void set_u64(std::vector<std::uint8_t>& buf, std::uint64_t pos, std::uint64_t value){
+	for(int k=0; k<8; ++k)
+		buf[pos+k] = (std::uint8_t)(value>>(56-8*k));
+}
+
+// posizione della prima entry dell'indice, in fondo al file dopo l'header del blocco di chiusura
+static std::uint64_t index_start(const std::vector<std::uint8_t>& compressed){
+	std::uint64_t num_blocks = get_u64(compressed, compressed.size()-12);
+	return compressed.size() - HUF_INDEX_TRAILER_DIM - num_blocks*HUF_INDEX_ENTRY_DIM;
+}
+
+// tipo di ogni blocco di un file BCP2, dal primo byte dell'header del blocco puntato dall'indice
+static std::vector<std::uint8_t> block_types(const std::vector<std::uint8_t>& compressed){
+	std::vector<std::uint8_t> types;
+	for(std::uint64_t pos=index_start(compressed); pos+HUF_INDEX_TRAILER_DIM<compressed.size(); pos+=HUF_INDEX_ENTRY_DIM)
+		types.push_back(compressed[get_u64(compressed, pos+8)/8]);
+	return types;
+}
+
+static void check(bool ok, const std::string& what, int& failures){
+	std::cout << (ok ? "OK   " : "FAIL ") << what << std::endl;
+	if(!ok)
+		failures++;
+}
+
+#endif /*TEST_UTILS_H*/